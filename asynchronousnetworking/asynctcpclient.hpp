@@ -4,48 +4,719 @@
 #include <boost/asio.hpp>
 
 #include <boost/system/detail/error_code.hpp>
+#include <atomic>
 #include <thread>
 #include <mutex>
 #include <memory>
 #include <iostream>
 #include <map>
 #include <list>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <deque>
+#include <chrono>
+#include <unordered_set>
+
+#include "../common/framing.hpp"
+#include "../common/recyclingallocator.hpp"
+#include "../common/timerwheel.hpp"
+#include "../common/metrics.hpp"
+#include "../common/logger.hpp"
+#include "../common/iouring.hpp"
+#include "../common/sockettuning.hpp"
+#include "../common/streamendpoint.hpp"
+#include "../common/shmring.hpp"
+
+#ifdef NET_HAS_IO_URING
+#include <cstring>
+#include <future>
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#endif
 
 using namespace boost;
 
 typedef void(*Callback) (unsigned int request_id, const std::string &response, const system::error_code &ec);
 
+/*
+ * Settings for AsyncTCPClient's connection pool.
+ */
+struct PoolOptions
+{
+    bool enabled{false};
+    std::size_t max_idle_per_endpoint{8};                // idle connections kept per endpoint, extra ones are closed
+    std::chrono::milliseconds idle_timeout{30000};       // idle connections older than this are evicted
+};
+
+/*
+ * Keeps idle, connected sockets per endpoint so a request can skip the connect. Sockets are
+ * handed out most recently used first and health checked on checkout; a socket the server
+ * closed, or that has unexpected data waiting, is dropped. The lock only guards the idle lists,
+ * health checks and closes run after a socket has been taken off them.
+ */
+class ConnectionPool : public asio::noncopyable {
+    private:
+        struct IdleConnection
+        {
+            StreamSocket m_sock;
+            std::chrono::steady_clock::time_point m_since;
+        };
+
+        PoolOptions m_options;
+        std::map<StreamEndpoint, std::deque<IdleConnection>> m_idle;
+        std::mutex m_idle_gaurd;
+
+        /* Moves connections idle for longer than the timeout into expired, oldest sit at the front. */
+        void evictExpired(std::deque<IdleConnection> &idle, std::chrono::steady_clock::time_point now,
+                          std::vector<StreamSocket> &expired)
+        {
+            while(!idle.empty() && now - idle.front().m_since > m_options.idle_timeout)
+            {
+                expired.push_back(std::move(idle.front().m_sock));
+                idle.pop_front();
+            }
+        }
+
+        /*
+         * Connection is usable if open and a non-blocking peek would block: no EOF, no stray bytes.
+         * A socket whose blocking mode cannot be switched is treated as unhealthy.
+         */
+        static bool isHealthy(StreamSocket &sock)
+        {
+            if(!sock.is_open())
+                return false;
+
+            system::error_code ec;
+            char byte;
+
+            sock.non_blocking(true, ec);
+            if(ec)
+                return false;
+
+            sock.receive(asio::buffer(&byte, 1), asio::socket_base::message_peek, ec);
+            bool healthy = ec == asio::error::would_block;
+
+            sock.non_blocking(false, ec);
+            return healthy && !ec;
+        }
+
+        static void close(StreamSocket &sock)
+        {
+            system::error_code ignored_ec;
+
+            sock.shutdown(StreamSocket::shutdown_both, ignored_ec);
+            sock.close(ignored_ec);
+        }
+
+    public:
+
+        /* Constructor */
+        ConnectionPool(const PoolOptions &options)
+            :m_options(options)
+        {}
+
+        bool enabled() const { return m_options.enabled; }
+
+        /*
+         * Moves a healthy idle connection for endpoint into sock.
+         *
+         * @param: {const StreamEndpoint &} ep: endpoint to connect to.
+         *         {StreamSocket &} sock: receives pooled connection.
+         *
+         * @return: true if a connection was handed out, false if caller must connect.
+         */
+        bool checkout(const StreamEndpoint &ep, StreamSocket &sock)
+        {
+            if(!m_options.enabled)
+                return false;
+
+            std::vector<StreamSocket> expired;
+
+            // one candidate at a time off the list, checked without the lock held
+            while(true)
+            {
+                std::unique_lock<std::mutex> lock(m_idle_gaurd);
+
+                auto it = m_idle.find(ep);
+                if(it == m_idle.end())
+                    return false;
+
+                evictExpired(it->second, std::chrono::steady_clock::now(), expired);
+                if(it->second.empty())
+                {
+                    lock.unlock();
+
+                    for(StreamSocket &stale: expired)
+                        close(stale);
+                    return false;
+                }
+
+                StreamSocket candidate(std::move(it->second.back().m_sock));
+                it->second.pop_back();
+                lock.unlock();
+
+                for(StreamSocket &stale: expired)
+                    close(stale);
+                expired.clear();
+
+                if(isHealthy(candidate))
+                {
+                    sock = std::move(candidate);
+                    return true;
+                }
+
+                close(candidate);
+            }
+        }
+
+        /*
+         * Returns a connection to the pool, closes it instead if pool for endpoint is full.
+         *
+         * @param: {const StreamEndpoint &} ep: endpoint socket is connected to.
+         *         {StreamSocket &} sock: connection, left moved-from.
+         */
+        void checkin(const StreamEndpoint &ep, StreamSocket &sock)
+        {
+            if(!m_options.enabled || !sock.is_open())
+            {
+                close(sock);
+                return;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            std::vector<StreamSocket> expired;
+            std::unique_lock<std::mutex> lock(m_idle_gaurd);
+
+            auto &idle = m_idle[ep];
+            evictExpired(idle, now, expired);
+
+            bool full = idle.size() >= m_options.max_idle_per_endpoint;
+            if(!full)
+                idle.push_back(IdleConnection{std::move(sock), now});
+            lock.unlock();
+
+            if(full)
+                close(sock);
+
+            for(StreamSocket &stale: expired)
+                close(stale);
+        }
+
+        /* Closes every idle connection. */
+        void clear()
+        {
+            std::unique_lock<std::mutex> lock(m_idle_gaurd);
+
+            for(auto &entry: m_idle)
+                for(auto &conn: entry.second)
+                    close(conn.m_sock);
+
+            m_idle.clear();
+        }
+};
+
+/*
+ * AsyncTCPClient settings.
+ */
+struct ClientOptions
+{
+    PoolOptions pool;
+    Framing framing{Framing::Newline};
+    std::size_t max_frame_size{DEFAULT_MAX_FRAME_SIZE};
+    std::chrono::milliseconds request_timeout{0};        // default deadline per request, zero disables
+    std::chrono::milliseconds timer_tick{10};            // resolution of the deadline timer wheel
+    bool multiplexed{false};                             // share one connection per endpoint between all requests, needs a multiplexed server
+    std::size_t write_high_water{1 << 20};               // multiplexed only, requests fail with no_buffer_space while this many bytes are unsent, zero for no limit
+    bool shared_memory{false};                           // requests to a Unix domain endpoint go over a shared memory ring pair, needs a server with shm_path there, Linux only
+    std::size_t shm_ring_size{1 << 20};                  // bytes of each ring, a request or response may take up to half
+    IoBackend backend{IoBackend::Reactor};               // io_uring runs one ring per client thread, see UringConnector
+    SocketTuning tuning;                                 // socket options of every connection
+};
+
+/* True if requests to ep go over a ShmChannel rather than a socket. */
+inline bool overSharedMemory(const ClientOptions &options, const StreamEndpoint &ep)
+{
+#ifdef NET_HAS_SHM
+    return options.shared_memory && isLocal(ep);
+#else
+    (void)options;
+    (void)ep;
+    return false;
+#endif
+}
+
+class AsyncTCPClient;
+struct Session;
+struct UringConnector;
+
+/*
+ * Connection shared by every request to an endpoint in multiplexed mode. Requests are written
+ * as tagged frames; those queued while a write is in progress go out together in one gathered
+ * write straight from their sessions, without being copied. A single read loop hands each
+ * response to the request whose id it carries.
+ */
+struct MuxConnection
+{
+    static constexpr std::size_t GATHER{64};             // requests per gathered write, asio's writev limit
+
+    AsyncTCPClient &m_client;
+    StreamSocket m_sock;
+    StreamEndpoint m_ep;
+    FrameBuffer m_read_buf;
+
+    std::mutex m_gaurd;                                  // everything below, and initiating socket operations
+    bool m_connected;
+    bool m_failed;
+    bool m_writing;
+    std::deque<std::shared_ptr<Session>> m_pending;      // requests waiting for the current write
+    std::vector<std::shared_ptr<Session>> m_outgoing;    // requests being written, kept alive until it completes
+    std::vector<asio::const_buffer> m_gather;
+    std::size_t m_unsent;                                // bytes of pending and outgoing requests
+    std::unordered_set<unsigned int> m_in_flight;        // ids failed together if the connection drops
+
+    MuxConnection(AsyncTCPClient &client, asio::io_service &ios, const StreamEndpoint &ep,
+                  std::size_t max_frame_size):
+        m_client(client),
+        m_sock(ios),
+        m_ep(ep),
+        m_read_buf(Framing::LengthPrefixed, max_frame_size),
+        m_connected(false),
+        m_failed(false),
+        m_writing(false),
+        m_unsent(0)
+    {}
+};
+
+#ifdef NET_HAS_SHM
+/*
+ * Shared memory channel, ClientOptions::shared_memory, used by every request to a Unix domain
+ * endpoint like a multiplexed connection. The segment and doorbells are set up right away and
+ * requests are pushed before the control socket even connects; the server picks them up once
+ * the handshake arrives. Pushes are serialized by m_gaurd, responses are drained by a single
+ * chain of doorbell reads, so each ring keeps one producer and one consumer.
+ */
+struct ShmChannel
+{
+    AsyncTCPClient &m_client;
+    StreamSocket m_control;
+    asio::posix::stream_descriptor m_doorbell;           // rung by the server
+    int m_server_bell;
+    int m_memfd;                                         // until handed to the server
+    ShmSegment m_segment;
+    std::uint64_t m_rung;
+    char m_probe;
+
+    std::mutex m_gaurd;                                  // everything below, pushing requests, and initiating descriptor operations
+    bool m_failed;
+    system::error_code m_error;                          // why it failed
+    std::deque<std::shared_ptr<Session>> m_waiting;      // requests waiting for room in the request ring
+    std::unordered_set<unsigned int> m_in_flight;        // ids failed together if the channel drops
+
+    ShmChannel(AsyncTCPClient &client, asio::io_service &ios):
+        m_client(client),
+        m_control(ios),
+        m_doorbell(ios),
+        m_server_bell(-1),
+        m_memfd(-1),
+        m_rung(0),
+        m_probe(0),
+        m_failed(false)
+    {}
+
+    ~ShmChannel()
+    {
+        if(m_server_bell >= 0)
+            ::close(m_server_bell);
+        if(m_memfd >= 0)
+            ::close(m_memfd);
+    }
+};
+#endif
+
+#ifdef NET_HAS_IO_URING
+/*
+ * io_uring counterpart of the client's io_service threads, ClientOptions::backend IoUring: one
+ * ring and the thread running it. The ring takes submissions from its own thread only, so other
+ * threads hand requests and cancellations over through m_inbox and m_cancels and ring
+ * m_doorbell; everything queued while handling a batch of completions is submitted together
+ * with the wait for the next batch, one system call per loop iteration.
+ *
+ * A request runs connect, send and receive as ring operations, the response landing in a
+ * provided buffer ring so a request holds no receive buffer while it waits. Idle connections
+ * are pooled per ring as plain descriptors, under the same PoolOptions, and deadlines are swept
+ * every timer_tick.
+ */
+struct UringConnector
+{
+    static constexpr unsigned RING_ENTRIES{1024};
+    static constexpr unsigned BUFFER_COUNT{256};         // power of two
+    static constexpr std::size_t BUFFER_SIZE{4096};
+    static constexpr std::uint16_t BUFFER_GROUP{0};
+
+    // completion kind, kept in the low bits of user_data next to the request pointer
+    enum Op : std::uint64_t
+    {
+        OpConnect,
+        OpSend,
+        OpRecv,
+        OpDoorbell,
+        OpTick,
+        OpCancel
+    };
+
+    static constexpr std::uint64_t OP_MASK{7};
+
+    /* A request on the ring, kept for the next one in m_spare once it is done. */
+    struct alignas(8) Request
+    {
+        std::shared_ptr<Session> m_session;
+        int m_fd{-1};
+        std::size_t m_index{0};                          // position in m_requests
+        std::size_t m_sent{0};
+        Op m_op{OpConnect};                              // operation in flight
+        unsigned int m_cancels{0};                       // cancellations in flight, they refer to the request
+        bool m_done{false};
+        std::chrono::steady_clock::time_point m_deadline_at;
+    };
+
+    struct Queued
+    {
+        std::shared_ptr<Session> m_session;
+        std::chrono::steady_clock::time_point m_deadline_at;
+    };
+
+    struct IdleConnection
+    {
+        int m_fd;
+        std::chrono::steady_clock::time_point m_since;
+    };
+
+    std::unique_ptr<IoUring> m_ring;
+    std::unique_ptr<ProvidedBuffers> m_buffers;
+    int m_doorbell;                                      // eventfd, rung by threads queueing work
+    std::uint64_t m_rung;
+    __kernel_timespec m_tick;
+    std::thread::id m_thread_id;
+    std::unique_ptr<std::thread> m_thread;
+
+    std::mutex m_gaurd;                                  // the four below
+    std::vector<Queued> m_inbox;
+    std::vector<std::shared_ptr<Session>> m_cancels;
+    bool m_stopped;                                      // close() asked, the loop ends once nothing is in flight
+    bool m_exited;                                       // loop ended, requests fail right away
+
+    // the ring thread's own, no lock
+    std::vector<Queued> m_starting;
+    std::vector<std::shared_ptr<Session>> m_cancelling;
+    std::vector<std::unique_ptr<Request>> m_requests;
+    std::vector<std::unique_ptr<Request>> m_spare;
+    std::map<StreamEndpoint, std::deque<IdleConnection>> m_idle;
+
+    UringConnector(std::chrono::milliseconds timer_tick):
+        m_doorbell(-1),
+        m_rung(0),
+        m_stopped(false),
+        m_exited(false)
+    {
+        std::chrono::nanoseconds tick = timer_tick;
+        m_tick.tv_sec = tick.count() / 1000000000;
+        m_tick.tv_nsec = tick.count() % 1000000000;
+    }
+
+    ~UringConnector()
+    {
+        if(m_doorbell >= 0)
+            ::close(m_doorbell);
+    }
+
+    static std::uint64_t tag(Request *req, Op op)
+    {
+        return reinterpret_cast<std::uint64_t>(req) | op;
+    }
+
+    /* Next submission entry, flushing the queue to the kernel when it is full. */
+    io_uring_sqe *sqe()
+    {
+        io_uring_sqe *entry;
+        while((entry = m_ring->sqe()) == nullptr)
+            m_ring->submit();
+
+        return entry;
+    }
+
+    void armDoorbell()
+    {
+        io_uring_sqe *entry = sqe();
+        entry->opcode = IORING_OP_READ;
+        entry->fd = m_doorbell;
+        entry->addr = reinterpret_cast<std::uint64_t>(&m_rung);
+        entry->len = sizeof(m_rung);
+        entry->user_data = tag(nullptr, OpDoorbell);
+    }
+
+    void armTick()
+    {
+        io_uring_sqe *entry = sqe();
+        entry->opcode = IORING_OP_TIMEOUT;
+        entry->addr = reinterpret_cast<std::uint64_t>(&m_tick);
+        entry->len = 1;
+        entry->user_data = tag(nullptr, OpTick);
+    }
+
+    /* Wakes the ring thread, any thread. */
+    void ring()
+    {
+        std::uint64_t one = 1;
+        if(::write(m_doorbell, &one, sizeof(one)) < 0)
+        {
+            // only fails once the counter is saturated, the thread is woken already
+        }
+    }
+};
+#endif
+
 /*
  * Structure to hold information on client request.
+ *
+ * m_cancel_gaurd is held while a step starts the next socket operation and while a cancel
+ * aborts it, so a cancel never lands between the two and is lost.
  */
 struct Session
 {
-    asio::ip::tcp::socket m_sock;
-    asio::ip::tcp::endpoint m_ep;
-    std::string m_request;
+    StreamSocket m_sock;
+    StreamEndpoint m_ep;
+    std::string m_request;         // framed request, as sent on the wire
     unsigned int m_id;             // unique ID assigned to the request
 
-    asio::streambuf m_response_buf;
+    FrameBuffer m_response_buf;
     std::string m_response;
 
     system::error_code m_ec;
     Callback m_callback;
     bool m_was_cacelled;
+    bool m_reused;                 // socket came from the connection pool
+    std::shared_ptr<MuxConnection> m_conn;               // set in multiplexed mode, m_sock is then unused
+    std::shared_ptr<ShmChannel> m_shm;                   // set over shared memory, m_sock is then unused
+    UringConnector *m_uring;                             // set on the io_uring backend, m_sock is then unused
+    TimerId m_deadline;
     std::mutex m_cancel_gaurd;
 
+    Metrics::TimePoint m_stage_at;                       // start of the stage in progress
+    bool m_first_byte;
+
     Session(asio::io_service &ios,
-            const std::string &raw_ip_address,
-            unsigned short port_num,
+            const StreamEndpoint &ep,
             const std::string &request,
             unsigned int id,
-            Callback callback):
+            Callback callback,
+            const ClientOptions &options):
         m_sock(ios),
-        m_ep(asio::ip::address::from_string(raw_ip_address), port_num),
-        m_request(request),
+        m_ep(ep),
         m_id(id),
+        m_response_buf(options.framing, options.max_frame_size, 512),
         m_callback(callback),
-        m_was_cacelled(false)
-    {}
+        m_was_cacelled(false),
+        m_reused(false),
+        m_uring(nullptr),
+        m_first_byte(false)
+    {
+        // ring records carry their own size and id
+        if(overSharedMemory(options, ep))
+            m_request = request;
+        else if(options.multiplexed)
+            encodeTaggedFrame(id, request, m_request);
+        else
+            encodeFrame(options.framing, request, m_request);
+    }
+
+    bool carriedBy(const MuxConnection &conn) const { return m_conn.get() == &conn; }
+#ifdef NET_HAS_SHM
+    bool carriedBy(const ShmChannel &channel) const { return m_shm.get() == &channel; }
+#endif
+};
+
+/*
+ * Registry of in-flight requests keyed by request ID. Split into SHARDS independently locked
+ * open addressing tables (linear probing) so concurrent completions and cancellations rarely
+ * contend, and lookups walk a flat array instead of tree nodes. Each shard sits on its own
+ * cache line.
+ */
+template <typename T>
+class SessionRegistry : public asio::noncopyable {
+    private:
+        static constexpr std::size_t SHARDS{64};
+        static constexpr std::size_t INITIAL_CAPACITY{16};
+
+        enum class SlotState : unsigned char
+        {
+            Empty,
+            Used,
+            Deleted
+        };
+
+        struct Slot
+        {
+            unsigned int m_key{0};
+            SlotState m_state{SlotState::Empty};
+            std::shared_ptr<T> m_value;
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex m_gaurd;
+            std::vector<Slot> m_slots;
+            std::size_t m_used{0};
+            std::size_t m_deleted{0};
+
+            Shard(): m_slots(INITIAL_CAPACITY) {}
+        };
+
+        std::array<Shard, SHARDS> m_shards;
+
+        /* Fibonacci hash, sequential IDs land in different shards and slots. */
+        static std::uint32_t hash(unsigned int key)
+        {
+            return static_cast<std::uint32_t>(key) * 0x9E3779B1u;
+        }
+
+        Shard &shardOf(std::uint32_t h)
+        {
+            return m_shards[h >> 26];
+        }
+
+        /* Index of key's slot, or of first free slot along its probe sequence if absent. */
+        static std::size_t probe(const std::vector<Slot> &slots, unsigned int key, std::uint32_t h, bool &found)
+        {
+            std::size_t mask = slots.size() - 1;
+            std::size_t i = h & mask;
+            std::size_t free = slots.size();
+
+            found = false;
+            while(slots[i].m_state != SlotState::Empty)
+            {
+                if(slots[i].m_state == SlotState::Used && slots[i].m_key == key)
+                {
+                    found = true;
+                    return i;
+                }
+
+                if(slots[i].m_state == SlotState::Deleted && free == slots.size())
+                    free = i;
+
+                i = (i + 1) & mask;
+            }
+
+            return free != slots.size() ? free : i;
+        }
+
+        /* Rehashes shard, doubling capacity unless most occupied slots are tombstones. */
+        static void rehash(Shard &shard)
+        {
+            std::size_t capacity = shard.m_slots.size();
+            if(shard.m_used * 4 >= capacity)
+                capacity *= 2;
+
+            std::vector<Slot> slots(capacity);
+            for(Slot &slot: shard.m_slots)
+            {
+                if(slot.m_state != SlotState::Used)
+                    continue;
+
+                bool found;
+                std::size_t i = probe(slots, slot.m_key, hash(slot.m_key), found);
+                slots[i] = std::move(slot);
+            }
+
+            shard.m_slots.swap(slots);
+            shard.m_deleted = 0;
+        }
+
+    public:
+
+        /* Adds or replaces value for key. */
+        void insert(unsigned int key, std::shared_ptr<T> value)
+        {
+            std::uint32_t h = hash(key);
+            Shard &shard = shardOf(h);
+            std::lock_guard<std::mutex> lock(shard.m_gaurd);
+
+            // keep load, including tombstones, at or under one half
+            if((shard.m_used + shard.m_deleted + 1) * 2 > shard.m_slots.size())
+                rehash(shard);
+
+            bool found;
+            std::size_t i = probe(shard.m_slots, key, h, found);
+            Slot &slot = shard.m_slots[i];
+
+            if(!found)
+            {
+                if(slot.m_state == SlotState::Deleted)
+                    --shard.m_deleted;
+
+                ++shard.m_used;
+                slot.m_key = key;
+                slot.m_state = SlotState::Used;
+            }
+
+            slot.m_value = std::move(value);
+        }
+
+        /* Removes key, if present. */
+        void erase(unsigned int key)
+        {
+            std::uint32_t h = hash(key);
+            Shard &shard = shardOf(h);
+            std::lock_guard<std::mutex> lock(shard.m_gaurd);
+
+            bool found;
+            std::size_t i = probe(shard.m_slots, key, h, found);
+            if(!found)
+                return;
+
+            Slot &slot = shard.m_slots[i];
+            slot.m_state = SlotState::Deleted;
+            slot.m_value.reset();
+
+            --shard.m_used;
+            ++shard.m_deleted;
+        }
+
+        /* Removes key and returns its value, nullptr if absent; at most one caller gets it. */
+        std::shared_ptr<T> take(unsigned int key)
+        {
+            std::uint32_t h = hash(key);
+            Shard &shard = shardOf(h);
+            std::lock_guard<std::mutex> lock(shard.m_gaurd);
+
+            bool found;
+            std::size_t i = probe(shard.m_slots, key, h, found);
+            if(!found)
+                return nullptr;
+
+            Slot &slot = shard.m_slots[i];
+            std::shared_ptr<T> value = std::move(slot.m_value);
+            slot.m_state = SlotState::Deleted;
+
+            --shard.m_used;
+            ++shard.m_deleted;
+
+            return value;
+        }
+
+        /* Value for key, nullptr if absent. */
+        std::shared_ptr<T> find(unsigned int key)
+        {
+            std::uint32_t h = hash(key);
+            Shard &shard = shardOf(h);
+            std::lock_guard<std::mutex> lock(shard.m_gaurd);
+
+            bool found;
+            std::size_t i = probe(shard.m_slots, key, h, found);
+
+            return found ? shard.m_slots[i].m_value : nullptr;
+        }
 };
 
 /*
@@ -53,7 +724,19 @@ struct Session
  * Client applicaiton creates multiple threads that wait for asynchronous operations,
  * class is noncopyable to avoid having multiple instances of the client. Recives work via
  * function method, that takes in endpoint and function pointer. Creating a object of type Session
- * to continue handling request.
+ * to continue handling request. Sessions and completion handlers are allocated from the
+ * per-thread Recycler, so steady state requests do not go to malloc. Stage latencies, in-flight
+ * requests and bytes in and out are recorded under MetricScope::AsyncClient.
+ *
+ * With ClientOptions::multiplexed every request to an endpoint shares one MuxConnection;
+ * responses are matched to callbacks by request id in whatever order the server sends them.
+ * Request ids must then be unique among the requests in flight.
+ *
+ * With ClientOptions::shared_memory requests to a Unix domain endpoint share one ShmChannel
+ * instead, a pair of rings in memory mapped by both processes; callbacks and ids work the same.
+ *
+ * With ClientOptions::backend IoUring each thread runs a UringConnector instead of the io_service,
+ * requests spread over the rings in turn; callbacks then run on the ring threads.
  *
  * @behavior: Starts work event loop and launches multiple threads to run event loop until client signals to stop working.
  *            Uses user provided function to handle asnync callback.
@@ -61,8 +744,19 @@ struct Session
 class AsyncTCPClient : public asio::noncopyable {
     private:
         asio::io_service m_ios;
-        std::map<int, std::shared_ptr<Session>> m_active_sessions;
-        std::mutex m_active_sessions_gaurd;
+        TimerWheel m_wheel;
+        SessionRegistry<Session> m_active_sessions;
+        ClientOptions m_options;
+        ConnectionPool m_pool;
+        std::map<StreamEndpoint, std::shared_ptr<MuxConnection>> m_mux;
+#ifdef NET_HAS_SHM
+        std::map<StreamEndpoint, std::shared_ptr<ShmChannel>> m_shm;
+#endif
+        std::mutex m_mux_gaurd;                          // both maps
+#ifdef NET_HAS_IO_URING
+        std::vector<std::unique_ptr<UringConnector>> m_urings;   // IoUring backend, the io_service threads are not started then
+        std::atomic<unsigned int> m_next_uring{0};
+#endif
         std::unique_ptr<asio::io_service::work> m_work;
         std::list<std::unique_ptr<std::thread>> m_threads;
 
@@ -73,20 +767,33 @@ class AsyncTCPClient : public asio::noncopyable {
          * @param: {std::shared_ptr<Session>} session: struct holds information related to request.
          *
          * @behavior: checks if request has been canceled; otherwise, calls callback function.
+         *            A connection that completed cleanly goes back to the pool, if enabled.
          */
         void onRequestComplete(std::shared_ptr<Session> session)
         {
-            system::error_code ignored_ec;
-
-            session->m_sock.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_ec);
+            m_wheel.cancel(session->m_deadline);
+            Metrics::add(MetricScope::AsyncClient, MetricGauge::ActiveSessions, -1);
 
-            std::unique_lock<std::mutex> lock(m_active_sessions_gaurd);
-
-            auto it = m_active_sessions.find(session->m_id);
-            if(it != m_active_sessions.end())
-                m_active_sessions.erase(it);
+            if(session->m_conn || session->m_shm || session->m_uring)
+            {
+                // connection is shared, it stays open; or its ring pooled or closed it already
+            }
+            else
+            {
+                // a deadline may be cancelling the socket right now
+                std::lock_guard<std::mutex> cancel_lock(session->m_cancel_gaurd);
+                if(session->m_ec.value() == 0 && !session->m_was_cacelled)
+                {
+                    m_pool.checkin(session->m_ep, session->m_sock);
+                }
+                else
+                {
+                    system::error_code ignored_ec;
+                    session->m_sock.shutdown(StreamSocket::shutdown_both, ignored_ec);
+                }
+            }
 
-            lock.unlock();
+            m_active_sessions.erase(session->m_id);
 
             system::error_code ec;
 
@@ -99,80 +806,80 @@ class AsyncTCPClient : public asio::noncopyable {
             session->m_callback(session->m_id, session->m_response, ec);
         }
 
-    public:
-
-        /* Contructor */
-        AsyncTCPClient(std::size_t threads)
-        {
-            // keeps threads running event loop from exiting when no async operation is pending.
-            m_work.reset(new asio::io_service::work(m_ios));
-
-            //loop creating all the threads and appending them to the list
-            for(std::size_t i = 0; i < threads; ++i)
-            {
-                std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(std::thread([this] () { m_ios.run();}));
-
-                m_threads.push_back(thread);
-            }
-        }
-
         /*
-         * Cancels a request session given an ID.
-         *
-         * @param: {unsigned int} request_id: session ID.
-         *
-         * @behavior: marks sessions as canceled.
+         * Marks session cancelled and aborts its pending socket operation, or hands it to its
+         * ring's thread with the io_uring backend. A multiplexed request completes right away
+         * instead, its response is dropped if it still arrives.
          */
-        void cancelrequest(unsigned int request_id)
+        static void cancelSession(const std::shared_ptr<Session> &session)
         {
-            std::unique_lock<std::mutex> lock(m_active_sessions_gaurd);
+            if(session->m_conn)
+            {
+                session->m_conn->m_client.completeMultiplexed(*session->m_conn, session->m_id, std::string_view(),
+                        asio::error::operation_aborted);
+                return;
+            }
 
-            auto it = m_active_sessions.find(request_id);
-            if(it != m_active_sessions.end())
+#ifdef NET_HAS_SHM
+            if(session->m_shm)
             {
-                std::unique_lock<std::mutex> cancel_lock(it->second->m_cancel_gaurd);
+                session->m_shm->m_client.completeMultiplexed(*session->m_shm, session->m_id, std::string_view(),
+                        asio::error::operation_aborted);
+                return;
+            }
+#endif
 
-                it->second->m_was_cacelled = true;
-                it->second->m_sock.cancel();
+#ifdef NET_HAS_IO_URING
+            if(session->m_uring)
+            {
+                cancelUring(session);
+                return;
             }
+#endif
+
+            std::lock_guard<std::mutex> cancel_lock(session->m_cancel_gaurd);
+
+            system::error_code ignored_ec;
+            session->m_was_cacelled = true;
+            session->m_sock.cancel(ignored_ec);
         }
 
-        /* Closes io_service work, causing all threads to stop looping event loop and joins threads.*/
-        void close()
+        /* Wheel callback for a request that ran past its deadline, completes with operation_aborted. */
+        static void onDeadline(const std::shared_ptr<void> &owner)
         {
-            m_work.reset(NULL);
-            for(auto& thread: m_threads)
-                thread->join();
+            cancelSession(std::static_pointer_cast<Session>(owner));
         }
 
         /*
-         * Example function meant to test connecting, writing, and reading to server. Acomplished
-         * using nested callback functions.
-         *
-         * @param: {const std::string &} raw_ip_address: servers IP address to connect to.
-         *         {unsigned short} port_num: port on which server will be listening on.
-         *         {Callback} callback: user provided function pointer to handle callback.
-         *         {unsigned int} request_id: request ID.
+         * A pooled connection can still be closed by the server between the health check and
+         * the write, such a failure is retried once on a fresh connection. Called only while the
+         * request cannot have been handled: on a failed write, or on end of stream before any
+         * byte of the response. Other read errors are reported, resending could run the request twice.
          *
-         * @behavior: creats a new session for request, connects to server, writes to server, then reads from server.
+         * @return: true if request was restarted.
          */
-        void emulateLongComputationOp(const std::string &raw_ip_address,
-                                      unsigned short port_num, Callback callback, unsigned int request_id)
+        bool retryOnFreshConnection(std::shared_ptr<Session> session, const system::error_code &ec)
         {
+            std::lock_guard<std::mutex> cancel_lock(session->m_cancel_gaurd);
+            if(!session->m_reused || session->m_was_cacelled || ec == asio::error::operation_aborted)
+                return false;
 
-            std::string request{"Hello Server\n"};
-            std::shared_ptr<Session> session = std::make_shared<Session>(m_ios, raw_ip_address,
-                                                                       port_num, request, request_id, callback);
+            system::error_code ignored_ec;
+            session->m_sock.close(ignored_ec);
+            session->m_reused = false;
+            session->m_response_buf.clear();
 
             session->m_sock.open(session->m_ep.protocol());
+            tuneConnection(session->m_sock, m_options.tuning, true);
+            connect(session);
+            return true;
+        }
 
-            // add new session
-            std::unique_lock<std::mutex> lock(m_active_sessions_gaurd);
-            m_active_sessions[request_id] = session;
-            lock.unlock();
-
-            // simulate reading and writing from server
-            session->m_sock.async_connect(session->m_ep,
+        /* Connects session socket to its endpoint, then writes request. Called with m_cancel_gaurd held. */
+        void connect(std::shared_ptr<Session> session)
+        {
+            session->m_stage_at = Metrics::now();
+            session->m_sock.async_connect(session->m_ep, makeRecyclingHandler(
                     [this, session](const system::error_code &ec)
                     {
                         if(ec.value() != 0)
@@ -182,48 +889,1338 @@ class AsyncTCPClient : public asio::noncopyable {
                             return;
                         }
 
-                        std::unique_lock<std::mutex> cancel_lock(session->m_cancel_gaurd);
+                        Metrics::recordSince(MetricScope::AsyncClient, MetricStage::Accept, session->m_stage_at);
 
+                        std::unique_lock<std::mutex> cancel_lock(session->m_cancel_gaurd);
                         if(session->m_was_cacelled)
                         {
+                            cancel_lock.unlock();
                             onRequestComplete(session);
                             return;
                         }
 
-                        asio::async_write(session->m_sock, asio::buffer(session->m_request),
-                                [this, session](const system::error_code &ec, std::size_t bytes_transferred)
-                                {
-                                    if(ec.value() != 0)
-                                    {
-                                        session->m_ec = ec;
-                                        onRequestComplete(session);
-                                        return;
-                                    }
+                        write(session);
+                    }));
+        }
+
+        /* Writes request to server, then reads response. Called with m_cancel_gaurd held. */
+        void write(std::shared_ptr<Session> session)
+        {
+            session->m_stage_at = Metrics::now();
+            asio::async_write(session->m_sock, asio::buffer(session->m_request), makeRecyclingHandler(
+                    [this, session](const system::error_code &ec, std::size_t bytes_transferred)
+                    {
+                        if(ec.value() != 0)
+                        {
+                            if(retryOnFreshConnection(session, ec))
+                                return;
+
+                            session->m_ec = ec;
+                            onRequestComplete(session);
+                            return;
+                        }
+
+                        Metrics::recordSince(MetricScope::AsyncClient, MetricStage::WriteComplete, session->m_stage_at);
+                        Metrics::add(MetricScope::AsyncClient, MetricGauge::BytesOut, bytes_transferred);
+
+                        std::unique_lock<std::mutex> cancel_lock(session->m_cancel_gaurd);
+                        if(session->m_was_cacelled)
+                        {
+                            cancel_lock.unlock();
+                            onRequestComplete(session);
+                            return;
+                        }
+
+                        session->m_stage_at = Metrics::now();
+                        session->m_first_byte = false;
+                        read(session);
+                    }));
+        }
+
+        /* Reads a single framed response from server. Called with m_cancel_gaurd held. */
+        void read(std::shared_ptr<Session> session)
+        {
+            session->m_sock.async_read_some(session->m_response_buf.prepare(), makeRecyclingHandler(
+                    [this, session](const system::error_code &ec, std::size_t bytes_transferred)
+                    {
+                        if(ec.value() != 0)
+                        {
+                            // closed unanswered, the server dropped the idle connection instead of reading it
+                            if(ec == asio::error::eof && !session->m_first_byte
+                                    && retryOnFreshConnection(session, ec))
+                                return;
+
+                            session->m_ec = ec;
+                            onRequestComplete(session);
+                            return;
+                        }
+
+                        session->m_response_buf.commit(bytes_transferred);
+                        Metrics::add(MetricScope::AsyncClient, MetricGauge::BytesIn, bytes_transferred);
+
+                        if(!session->m_first_byte)
+                        {
+                            session->m_first_byte = true;
+                            Metrics::recordSince(MetricScope::AsyncClient, MetricStage::FirstByte, session->m_stage_at);
+                            session->m_stage_at = Metrics::now();
+                        }
+
+                        std::string_view response;
+                        if(!session->m_response_buf.nextFrame(response, session->m_ec))
+                        {
+                            // partial response, keep reading unless frame was too large or cancelled
+                            std::unique_lock<std::mutex> cancel_lock(session->m_cancel_gaurd);
+                            if(session->m_ec.value() == 0 && !session->m_was_cacelled)
+                            {
+                                read(session);
+                                return;
+                            }
+
+                            cancel_lock.unlock();
+                            onRequestComplete(session);
+                            return;
+                        }
+
+                        session->m_response.assign(response.data(), response.size());
+                        Metrics::recordSince(MetricScope::AsyncClient, MetricStage::ReadComplete, session->m_stage_at);
+                        onRequestComplete(session);
+                    }));
+        }
+
+        /* Multiplexed connection to ep, opening one if there is none or the last one failed. */
+        std::shared_ptr<MuxConnection> muxConnection(const StreamEndpoint &ep)
+        {
+            std::unique_lock<std::mutex> lock(m_mux_gaurd);
+
+            std::shared_ptr<MuxConnection> &conn = m_mux[ep];
+            if(conn)
+            {
+                std::lock_guard<std::mutex> conn_lock(conn->m_gaurd);
+                if(!conn->m_failed)
+                    return conn;
+            }
+
+            conn = std::allocate_shared<MuxConnection>(RecyclingAllocator<MuxConnection>(), *this, m_ios, ep,
+                    m_options.max_frame_size);
+            std::shared_ptr<MuxConnection> fresh = conn;
+            lock.unlock();
+
+            std::lock_guard<std::mutex> conn_lock(fresh->m_gaurd);
+            fresh->m_sock.open(ep.protocol());
+            tuneConnection(fresh->m_sock, m_options.tuning, true);
+            fresh->m_sock.async_connect(ep, makeRecyclingHandler(
+                    [this, fresh](const system::error_code &ec)
+                    {
+                        if(ec.value() != 0)
+                        {
+                            failMultiplexed(fresh, ec);
+                            return;
+                        }
+
+                        std::lock_guard<std::mutex> conn_lock(fresh->m_gaurd);
+                        fresh->m_connected = true;
+
+                        // TCP only, fails harmlessly on a Unix domain socket
+                        system::error_code ignored_ec;
+                        fresh->m_sock.set_option(asio::ip::tcp::no_delay(true), ignored_ec);
+
+                        writeMultiplexed(fresh);
+                        readMultiplexed(fresh);
+                    }));
+
+            return fresh;
+        }
+
+        /*
+         * Queues session's request on its connection. Past write_high_water unsent bytes the
+         * server is not keeping up, the request fails with no_buffer_space so the caller backs off.
+         */
+        void sendMultiplexed(std::shared_ptr<Session> session)
+        {
+            MuxConnection &conn = *session->m_conn;
+            std::unique_lock<std::mutex> lock(conn.m_gaurd);
+
+            system::error_code ec;
+            if(conn.m_failed)
+                ec = asio::error::connection_aborted;
+            else if(m_options.write_high_water != 0 && conn.m_unsent >= m_options.write_high_water)
+                ec = asio::error::no_buffer_space;
+
+            if(ec)
+            {
+                lock.unlock();
+                completeMultiplexed(conn, session->m_id, std::string_view(), ec);
+                return;
+            }
+
+            conn.m_in_flight.insert(session->m_id);
+            conn.m_unsent += session->m_request.size();
+            conn.m_pending.push_back(session);
+
+            writeMultiplexed(session->m_conn);
+        }
+
+        /*
+         * Writes up to GATHER queued requests in one gathered write unless a write is in
+         * progress, called with conn lock held.
+         */
+        void writeMultiplexed(const std::shared_ptr<MuxConnection> &conn)
+        {
+            if(!conn->m_connected || conn->m_writing || conn->m_pending.empty())
+                return;
+
+            conn->m_writing = true;
+            conn->m_gather.clear();
+
+            while(!conn->m_pending.empty() && conn->m_outgoing.size() < MuxConnection::GATHER)
+            {
+                conn->m_outgoing.push_back(std::move(conn->m_pending.front()));
+                conn->m_pending.pop_front();
+                conn->m_gather.push_back(asio::buffer(conn->m_outgoing.back()->m_request));
+            }
+
+            Metrics::TimePoint started = Metrics::now();
+            asio::async_write(conn->m_sock, conn->m_gather, makeRecyclingHandler(
+                    [this, conn, started](const system::error_code &ec, std::size_t bytes_transferred)
+                    {
+                        if(ec.value() != 0)
+                        {
+                            std::unique_lock<std::mutex> conn_lock(conn->m_gaurd);
+                            conn->m_outgoing.clear();
+                            conn_lock.unlock();
+
+                            failMultiplexed(conn, ec);
+                            return;
+                        }
+
+                        Metrics::recordSince(MetricScope::AsyncClient, MetricStage::WriteComplete, started);
+                        Metrics::add(MetricScope::AsyncClient, MetricGauge::BytesOut, bytes_transferred);
+
+                        std::lock_guard<std::mutex> conn_lock(conn->m_gaurd);
+                        conn->m_writing = false;
+                        conn->m_outgoing.clear();
+                        conn->m_unsent -= bytes_transferred;
+                        writeMultiplexed(conn);
+                    }));
+        }
+
+        /* Read loop, completes each request as its response arrives; called with conn lock held. */
+        void readMultiplexed(const std::shared_ptr<MuxConnection> &conn)
+        {
+            conn->m_sock.async_read_some(conn->m_read_buf.prepare(), makeRecyclingHandler(
+                    [this, conn](const system::error_code &ec, std::size_t bytes_transferred)
+                    {
+                        if(ec.value() != 0)
+                        {
+                            failMultiplexed(conn, ec);
+                            return;
+                        }
+
+                        conn->m_read_buf.commit(bytes_transferred);
+                        Metrics::add(MetricScope::AsyncClient, MetricGauge::BytesIn, bytes_transferred);
+
+                        system::error_code frame_ec;
+                        std::string_view frame;
+
+                        while(conn->m_read_buf.nextFrame(frame, frame_ec))
+                        {
+                            std::uint32_t id;
+                            std::string_view response;
+
+                            if(!splitTaggedFrame(frame, id, response))
+                            {
+                                frame_ec = asio::error::invalid_argument;
+                                break;
+                            }
+
+                            completeMultiplexed(*conn, id, response, system::error_code());
+                        }
+
+                        if(frame_ec)
+                        {
+                            failMultiplexed(conn, frame_ec);
+                            return;
+                        }
+
+                        std::lock_guard<std::mutex> conn_lock(conn->m_gaurd);
+                        readMultiplexed(conn);
+                    }));
+        }
+
+        /*
+         * Completes request id of conn, a MuxConnection or ShmChannel, once: the first of response,
+         * cancel, deadline or connection failure wins, later ones find it gone.
+         */
+        template <typename Connection>
+        void completeMultiplexed(Connection &conn, unsigned int id, std::string_view response,
+                                 const system::error_code &ec)
+        {
+            std::shared_ptr<Session> session = m_active_sessions.take(id);
+            if(!session || !session->carriedBy(conn))
+            {
+                // id reused by a request on another connection, put it back
+                if(session)
+                    m_active_sessions.insert(id, session);
+
+                return;
+            }
+
+            std::unique_lock<std::mutex> lock(conn.m_gaurd);
+            conn.m_in_flight.erase(id);
+            lock.unlock();
+
+            session->m_response.assign(response.data(), response.size());
+            session->m_ec = ec;
+            if(ec == asio::error::operation_aborted)
+                session->m_was_cacelled = true;
+
+            if(!ec)
+                Metrics::recordSince(MetricScope::AsyncClient, MetricStage::ReadComplete, session->m_stage_at);
+
+            onRequestComplete(session);
+        }
+
+        /* Closes conn and fails every request still waiting on it. */
+        void failMultiplexed(const std::shared_ptr<MuxConnection> &conn, const system::error_code &ec)
+        {
+            std::unique_lock<std::mutex> lock(conn->m_gaurd);
 
-                                    std::unique_lock<std::mutex> cancel_lock(session->m_cancel_gaurd);
-                                    if(session->m_was_cacelled)
+            conn->m_failed = true;
+            std::unordered_set<unsigned int> in_flight;
+            in_flight.swap(conn->m_in_flight);
+
+            // queued sessions hold the connection, drop them; the outgoing ones go when the write fails
+            conn->m_pending.clear();
+
+            system::error_code ignored_ec;
+            conn->m_sock.close(ignored_ec);
+            lock.unlock();
+
+            for(unsigned int id: in_flight)
+                completeMultiplexed(*conn, id, std::string_view(), ec);
+        }
+
+#ifdef NET_HAS_SHM
+        /*
+         * Shared memory channel to ep, setting one up if there is none or the last one failed.
+         * The segment and doorbells are ready on return, the control socket connects meanwhile
+         * and hands them to the server.
+         */
+        std::shared_ptr<ShmChannel> shmChannel(const StreamEndpoint &ep)
+        {
+            std::unique_lock<std::mutex> lock(m_mux_gaurd);
+
+            std::shared_ptr<ShmChannel> &channel = m_shm[ep];
+            if(channel)
+            {
+                std::lock_guard<std::mutex> channel_lock(channel->m_gaurd);
+                if(!channel->m_failed)
+                    return channel;
+            }
+
+            channel = std::allocate_shared<ShmChannel>(RecyclingAllocator<ShmChannel>(), *this, m_ios);
+            std::shared_ptr<ShmChannel> fresh = channel;
+            lock.unlock();
+
+            std::lock_guard<std::mutex> channel_lock(fresh->m_gaurd);
+
+            system::error_code ec;
+            fresh->m_memfd = fresh->m_segment.create(m_options.shm_ring_size, ec);
+
+            int client_bell = -1;
+            if(!ec)
+                client_bell = makeDoorbell(ec);
+            if(!ec)
+                fresh->m_doorbell.assign(client_bell, ec);
+            if(!ec)
+                fresh->m_server_bell = makeDoorbell(ec);
+
+            if(ec)
+            {
+                if(client_bell >= 0 && !fresh->m_doorbell.is_open())
+                    ::close(client_bell);
+
+                // requests fail with ec, see sendShm
+                fresh->m_failed = true;
+                fresh->m_error = ec;
+                return fresh;
+            }
+
+            fresh->m_control.open(ep.protocol());
+            fresh->m_control.async_connect(ep, makeRecyclingHandler(
+                    [this, fresh, client_bell](const system::error_code &ec)
+                    {
+                        if(ec.value() != 0)
+                        {
+                            failShm(fresh, ec);
+                            return;
+                        }
+
+                        std::lock_guard<std::mutex> channel_lock(fresh->m_gaurd);
+                        if(fresh->m_failed)
+                            return;
+
+                        system::error_code handshake_ec;
+                        const int fds[SHM_HANDSHAKE_FDS] = {fresh->m_memfd, client_bell, fresh->m_server_bell};
+                        sendShmHandshake(fresh->m_control.native_handle(), fds, handshake_ec);
+
+                        // the mapping stays, the server has its own descriptor now
+                        ::close(fresh->m_memfd);
+                        fresh->m_memfd = -1;
+
+                        if(handshake_ec)
+                        {
+                            asio::post(m_ios, makeRecyclingHandler([this, fresh, handshake_ec]()
                                     {
-                                        onRequestComplete(session);
-                                        return;
-                                    }
-
-                                    asio::async_read_until(session->m_sock, session->m_response_buf, '\n',
-                                            [this, session](const system::error_code &ec, std::size_t bytes_transferred)
-                                            {
-                                                if(ec.value() != 0)
-                                                {
-                                                    session->m_ec = ec;
-                                                }
-                                                else
-                                                {
-                                                   std::istream is(&session->m_response_buf);
-                                                   std::getline(is, session->m_response);
-                                                }
-
-                                                onRequestComplete(session);
-                                            });
-                                });
-                    });
+                                        failShm(fresh, handshake_ec);
+                                    }));
+                            return;
+                        }
+
+                        watchShm(fresh);
+                    }));
+
+            readShm(fresh);
+            return fresh;
+        }
+
+        /* Pushes session's request onto its channel's request ring, or queues it while the ring is full. */
+        void sendShm(std::shared_ptr<Session> session)
+        {
+            ShmChannel &channel = *session->m_shm;
+            std::unique_lock<std::mutex> lock(channel.m_gaurd);
+
+            if(channel.m_failed || session->m_request.size() > channel.m_segment.requests().maxPayload())
+            {
+                system::error_code ec = channel.m_failed ? channel.m_error : asio::error::message_size;
+                lock.unlock();
+                completeMultiplexed(channel, session->m_id, std::string_view(), ec);
+                return;
+            }
+
+            channel.m_in_flight.insert(session->m_id);
+            channel.m_waiting.push_back(std::move(session));
+
+            flushShm(channel);
+        }
+
+        /*
+         * Moves waiting requests into the request ring while it has room, ringing the server if it
+         * sleeps; called with channel lock held. A full ring flags the server to ring back once
+         * it made room.
+         */
+        void flushShm(ShmChannel &channel)
+        {
+            ShmRing &requests = channel.m_segment.requests();
+            bool pushed = false;
+
+            while(!channel.m_waiting.empty())
+            {
+                const Session &session = *channel.m_waiting.front();
+
+                if(!requests.push(session.m_id, session.m_request))
+                {
+                    if(requests.prepareWaitForSpace(session.m_request.size()))
+                        break;
+
+                    continue;
+                }
+
+                Metrics::add(MetricScope::AsyncClient, MetricGauge::BytesOut, session.m_request.size());
+                channel.m_waiting.pop_front();
+                pushed = true;
+            }
+
+            if(pushed && requests.wakeConsumer())
+                ringDoorbell(channel.m_server_bell);
+        }
+
+        /* Waits for the server's doorbell; called with channel lock held. */
+        void readShm(const std::shared_ptr<ShmChannel> &channel)
+        {
+            channel->m_doorbell.async_read_some(asio::buffer(&channel->m_rung, sizeof(channel->m_rung)),
+                    makeRecyclingHandler(
+                    [this, channel](const system::error_code &ec, std::size_t)
+                    {
+                        if(ec.value() != 0)
+                        {
+                            failShm(channel, ec);
+                            return;
+                        }
+
+                        drainShm(channel);
+                    }));
+        }
+
+        /*
+         * Completes requests whose responses are in the ring, up to a batch, then refills the
+         * request ring and goes back to waiting. Only one drain runs at a time per channel.
+         */
+        void drainShm(const std::shared_ptr<ShmChannel> &channel)
+        {
+            static constexpr std::size_t BATCH{64};
+
+            ShmRing &responses = channel->m_segment.responses();
+            std::size_t drained = 0;
+            std::uint32_t id;
+            std::string_view response;
+
+            while(drained < BATCH && responses.front(id, response))
+            {
+                Metrics::add(MetricScope::AsyncClient, MetricGauge::BytesIn, response.size());
+                completeMultiplexed(*channel, id, response, system::error_code());
+
+                responses.pop();
+                ++drained;
+            }
+
+            if(drained != 0 && responses.wakeProducer())
+                ringDoorbell(channel->m_server_bell);
+
+            std::unique_lock<std::mutex> lock(channel->m_gaurd);
+            if(channel->m_failed)
+                return;
+
+            // the server popped requests as well, and may have rung for that alone
+            flushShm(*channel);
+
+            if(drained == BATCH || !responses.prepareWait())
+            {
+                lock.unlock();
+                asio::post(m_ios, makeRecyclingHandler([this, channel]()
+                        {
+                            drainShm(channel);
+                        }));
+                return;
+            }
+
+            readShm(channel);
+        }
+
+        /* The control socket carries nothing after the handshake, its end means the server left. */
+        void watchShm(const std::shared_ptr<ShmChannel> &channel)
+        {
+            channel->m_control.async_read_some(asio::buffer(&channel->m_probe, 1), makeRecyclingHandler(
+                    [this, channel](const system::error_code &ec, std::size_t)
+                    {
+                        failShm(channel, ec ? ec : asio::error::invalid_argument);
+                    }));
+        }
+
+        /* Closes channel and fails every request still waiting on it. */
+        void failShm(const std::shared_ptr<ShmChannel> &channel, const system::error_code &ec)
+        {
+            std::unique_lock<std::mutex> lock(channel->m_gaurd);
+
+            if(!channel->m_failed)
+            {
+                channel->m_failed = true;
+                channel->m_error = ec;
+            }
+
+            std::unordered_set<unsigned int> in_flight;
+            in_flight.swap(channel->m_in_flight);
+            channel->m_waiting.clear();
+
+            system::error_code ignored_ec;
+            channel->m_control.close(ignored_ec);
+            channel->m_doorbell.close(ignored_ec);
+            lock.unlock();
+
+            for(unsigned int id: in_flight)
+                completeMultiplexed(*channel, id, std::string_view(), ec);
+        }
+#endif
+
+#ifdef NET_HAS_IO_URING
+        /* Queues session on its ring, the ring thread starts it. */
+        void queueUring(std::shared_ptr<Session> session, std::chrono::milliseconds timeout)
+        {
+            UringConnector &uring = *session->m_uring;
+            std::chrono::steady_clock::time_point deadline_at = timeout.count() > 0
+                ? std::chrono::steady_clock::now() + timeout : std::chrono::steady_clock::time_point::max();
+
+            std::unique_lock<std::mutex> lock(uring.m_gaurd);
+            if(uring.m_exited)
+            {
+                lock.unlock();
+                session->m_ec = asio::error::operation_aborted;
+                onRequestComplete(session);
+                return;
+            }
+
+            // work already queued means the thread was woken, or is itself queueing from a callback
+            bool wake = uring.m_inbox.empty() && uring.m_cancels.empty()
+                && std::this_thread::get_id() != uring.m_thread_id;
+            uring.m_inbox.push_back(UringConnector::Queued{std::move(session), deadline_at});
+            lock.unlock();
+
+            if(wake)
+                uring.ring();
+        }
+
+        /* Hands a cancellation to session's ring, see abortUring. */
+        static void cancelUring(const std::shared_ptr<Session> &session)
+        {
+            UringConnector &uring = *session->m_uring;
+
+            std::unique_lock<std::mutex> lock(uring.m_gaurd);
+            bool wake = uring.m_inbox.empty() && uring.m_cancels.empty()
+                && std::this_thread::get_id() != uring.m_thread_id;
+            uring.m_cancels.push_back(session);
+            lock.unlock();
+
+            if(wake)
+                uring.ring();
+        }
+
+        /*
+         * One UringConnector and thread per client thread, each ring set up on its own thread.
+         *
+         * @return: false, leaving the reactor to serve, if io_uring is not available or the
+         *          options ask for something only the reactor implements.
+         */
+        bool startUring(std::size_t threads)
+        {
+            if(m_options.multiplexed || m_options.shared_memory)
+            {
+                Logger::warn("io_uring backend has no multiplexing or shared memory, using the reactor");
+                return false;
+            }
+
+            if(!IoUring::supported())
+            {
+                Logger::warn("io_uring not supported by this kernel, using the reactor");
+                return false;
+            }
+
+            for(std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i)
+            {
+                std::unique_ptr<UringConnector> uring(new UringConnector(m_options.timer_tick));
+                UringConnector *connector = uring.get();
+
+                // the thread owns the promise, the shared state outlives whichever side finishes last
+                std::promise<system::error_code> ready;
+                std::future<system::error_code> result = ready.get_future();
+
+                uring->m_thread.reset(new std::thread([this, connector, ready = std::move(ready)]() mutable
+                            {
+                                runUring(*connector, ready);
+                            }));
+                uring->m_thread_id = uring->m_thread->get_id();
+
+                system::error_code ec = result.get();
+                if(ec)
+                {
+                    uring->m_thread->join();
+                    stopUring();
+
+                    Logger::warn("io_uring setup failed, using the reactor: ", ec.message());
+                    return false;
+                }
+
+                m_urings.push_back(std::move(uring));
+            }
+
+            return true;
+        }
+
+        /* Lets every ring finish the requests in flight, then joins its thread. */
+        void stopUring()
+        {
+            for(auto &uring: m_urings)
+            {
+                std::unique_lock<std::mutex> lock(uring->m_gaurd);
+                uring->m_stopped = true;
+                lock.unlock();
+
+                uring->ring();
+            }
+
+            for(auto &uring: m_urings)
+                uring->m_thread->join();
+        }
+
+        /* Ring thread: sets the ring up, reports on ready, then loops until stopped and idle. */
+        void runUring(UringConnector &uring, std::promise<system::error_code> &ready)
+        {
+            try
+            {
+                uring.m_doorbell = ::eventfd(0, EFD_CLOEXEC);
+                if(uring.m_doorbell < 0)
+                    throw system::system_error(system::error_code(errno, system::system_category()));
+
+                uring.m_ring.reset(new IoUring(UringConnector::RING_ENTRIES));
+                uring.m_buffers.reset(new ProvidedBuffers(*uring.m_ring, UringConnector::BUFFER_GROUP,
+                            UringConnector::BUFFER_COUNT, UringConnector::BUFFER_SIZE));
+            }
+            catch(system::system_error &e)
+            {
+                uring.m_buffers.reset();
+                uring.m_ring.reset();
+
+                ready.set_value(e.code());
+                return;
+            }
+
+            ready.set_value(system::error_code());
+
+            uring.armDoorbell();
+            uring.armTick();
+
+            while(takeUringWork(uring))
+            {
+                int ret = uring.m_ring->submit(1);
+                if(ret < 0 && ret != -EINTR && ret != -EBUSY)
+                {
+                    Logger::error("Error occured! Error code = ", -ret,
+                            ". Message: ", std::strerror(-ret));
+                    break;
+                }
+
+                uring.m_ring->completions([this, &uring](const io_uring_cqe &cqe) { onUringCompletion(uring, cqe); });
+            }
+
+            shutdownUring(uring);
+        }
+
+        /*
+         * Starts the requests and cancellations other threads queued.
+         *
+         * @return: false once stopped with nothing left in flight.
+         */
+        bool takeUringWork(UringConnector &uring)
+        {
+            std::unique_lock<std::mutex> lock(uring.m_gaurd);
+            uring.m_starting.swap(uring.m_inbox);
+            uring.m_cancelling.swap(uring.m_cancels);
+            bool stopped = uring.m_stopped;
+            lock.unlock();
+
+            for(UringConnector::Queued &queued: uring.m_starting)
+                beginUring(uring, queued);
+            uring.m_starting.clear();
+
+            // few are cancelled, a walk over the requests in flight is cheaper than an index
+            for(std::shared_ptr<Session> &session: uring.m_cancelling)
+            {
+                for(std::unique_ptr<UringConnector::Request> &req: uring.m_requests)
+                {
+                    if(req->m_session == session)
+                    {
+                        abortUring(uring, *req);
+                        break;
+                    }
+                }
+            }
+            uring.m_cancelling.clear();
+
+            return !stopped || !uring.m_requests.empty();
+        }
+
+        void beginUring(UringConnector &uring, UringConnector::Queued &queued)
+        {
+            std::unique_ptr<UringConnector::Request> fresh;
+            if(uring.m_spare.empty())
+            {
+                fresh.reset(new UringConnector::Request());
+            }
+            else
+            {
+                fresh = std::move(uring.m_spare.back());
+                uring.m_spare.pop_back();
+            }
+
+            fresh->m_session = std::move(queued.m_session);
+            fresh->m_deadline_at = queued.m_deadline_at;
+            fresh->m_index = uring.m_requests.size();
+            fresh->m_sent = 0;
+            fresh->m_done = false;
+
+            uring.m_requests.push_back(std::move(fresh));
+            UringConnector::Request &req = *uring.m_requests.back();
+            Session &session = *req.m_session;
+
+            req.m_fd = checkoutUring(uring, session.m_ep);
+            session.m_reused = req.m_fd >= 0;
+
+            if(session.m_reused)
+                sendUring(uring, req);
+            else
+                connectUring(uring, req);
+        }
+
+        void connectUring(UringConnector &uring, UringConnector::Request &req)
+        {
+            Session &session = *req.m_session;
+            session.m_stage_at = Metrics::now();
+
+            req.m_fd = ::socket(session.m_ep.protocol().family(), SOCK_STREAM | SOCK_CLOEXEC,
+                    session.m_ep.protocol().protocol());
+            if(req.m_fd < 0)
+            {
+                finishUring(uring, req, system::error_code(errno, system::system_category()));
+                return;
+            }
+
+            tuneConnection(req.m_fd, m_options.tuning, true);
+
+            io_uring_sqe *entry = uring.sqe();
+            entry->opcode = IORING_OP_CONNECT;
+            entry->fd = req.m_fd;
+            entry->addr = reinterpret_cast<std::uint64_t>(session.m_ep.data());
+            entry->off = session.m_ep.size();
+            entry->user_data = UringConnector::tag(&req, UringConnector::OpConnect);
+
+            req.m_op = UringConnector::OpConnect;
+        }
+
+        /* Sends what is left of the request. */
+        void sendUring(UringConnector &uring, UringConnector::Request &req)
+        {
+            Session &session = *req.m_session;
+            if(req.m_sent == 0)
+                session.m_stage_at = Metrics::now();
+
+            io_uring_sqe *entry = uring.sqe();
+            entry->opcode = IORING_OP_SEND;
+            entry->fd = req.m_fd;
+            entry->addr = reinterpret_cast<std::uint64_t>(session.m_request.data() + req.m_sent);
+            entry->len = static_cast<std::uint32_t>(session.m_request.size() - req.m_sent);
+            entry->msg_flags = MSG_NOSIGNAL;
+            entry->user_data = UringConnector::tag(&req, UringConnector::OpSend);
+
+            req.m_op = UringConnector::OpSend;
+        }
+
+        void recvUring(UringConnector &uring, UringConnector::Request &req)
+        {
+            io_uring_sqe *entry = uring.sqe();
+            entry->opcode = IORING_OP_RECV;
+            entry->fd = req.m_fd;
+            entry->flags = IOSQE_BUFFER_SELECT;
+            entry->buf_group = uring.m_buffers->group();
+            entry->user_data = UringConnector::tag(&req, UringConnector::OpRecv);
+
+            req.m_op = UringConnector::OpRecv;
+        }
+
+        void onUringCompletion(UringConnector &uring, const io_uring_cqe &cqe)
+        {
+            UringConnector::Request *req = reinterpret_cast<UringConnector::Request *>(cqe.user_data & ~UringConnector::OP_MASK);
+
+            switch(static_cast<UringConnector::Op>(cqe.user_data & UringConnector::OP_MASK))
+            {
+                case UringConnector::OpConnect: onUringConnect(uring, *req, cqe.res); break;
+                case UringConnector::OpSend: onUringSend(uring, *req, cqe.res); break;
+                case UringConnector::OpRecv: onUringRecv(uring, *req, cqe); break;
+                case UringConnector::OpDoorbell: uring.armDoorbell(); break;
+                case UringConnector::OpTick: onUringTick(uring); break;
+                case UringConnector::OpCancel:
+                    if(--req->m_cancels == 0 && req->m_done)
+                        releaseUring(uring, *req);
+                    break;
+            }
+        }
+
+        void onUringConnect(UringConnector &uring, UringConnector::Request &req, int res)
+        {
+            Session &session = *req.m_session;
+
+            if(session.m_was_cacelled)
+            {
+                finishUring(uring, req, asio::error::operation_aborted);
+                return;
+            }
+
+            if(res < 0)
+            {
+                finishUring(uring, req, system::error_code(-res, system::system_category()));
+                return;
+            }
+
+            Metrics::recordSince(MetricScope::AsyncClient, MetricStage::Accept, session.m_stage_at);
+            sendUring(uring, req);
+        }
+
+        void onUringSend(UringConnector &uring, UringConnector::Request &req, int res)
+        {
+            Session &session = *req.m_session;
+
+            if(session.m_was_cacelled)
+            {
+                finishUring(uring, req, asio::error::operation_aborted);
+                return;
+            }
+
+            if(res < 0)
+            {
+                if(!retryUring(uring, req))
+                    finishUring(uring, req, system::error_code(-res, system::system_category()));
+                return;
+            }
+
+            req.m_sent += static_cast<std::size_t>(res);
+            Metrics::add(MetricScope::AsyncClient, MetricGauge::BytesOut, res);
+
+            if(req.m_sent < session.m_request.size())
+            {
+                sendUring(uring, req);
+                return;
+            }
+
+            Metrics::recordSince(MetricScope::AsyncClient, MetricStage::WriteComplete, session.m_stage_at);
+
+            session.m_stage_at = Metrics::now();
+            session.m_first_byte = false;
+            recvUring(uring, req);
+        }
+
+        void onUringRecv(UringConnector &uring, UringConnector::Request &req, const io_uring_cqe &cqe)
+        {
+            Session &session = *req.m_session;
+
+            if(cqe.res > 0)
+            {
+                // copied out and handed back at once, the buffers are shared by every request
+                std::uint16_t id = ProvidedBuffers::bufferId(cqe);
+                const char *data = uring.m_buffers->data(id);
+                std::size_t size = static_cast<std::size_t>(cqe.res);
+
+                while(size > 0)
+                {
+                    asio::mutable_buffer space = session.m_response_buf.prepare();
+                    std::size_t n = std::min(space.size(), size);
+                    if(n == 0)
+                        break;
+
+                    std::memcpy(space.data(), data, n);
+                    session.m_response_buf.commit(n);
+                    data += n;
+                    size -= n;
+                }
+
+                uring.m_buffers->recycle(id);
+            }
+
+            if(session.m_was_cacelled)
+            {
+                finishUring(uring, req, asio::error::operation_aborted);
+                return;
+            }
+
+            if(cqe.res == -ENOBUFS)
+            {
+                recvUring(uring, req);
+                return;
+            }
+
+            if(cqe.res == 0)
+            {
+                // closed unanswered, the server dropped the idle connection instead of reading it
+                if(!session.m_first_byte && retryUring(uring, req))
+                    return;
+
+                finishUring(uring, req, asio::error::eof);
+                return;
+            }
+
+            if(cqe.res < 0)
+            {
+                finishUring(uring, req, system::error_code(-cqe.res, system::system_category()));
+                return;
+            }
+
+            Metrics::add(MetricScope::AsyncClient, MetricGauge::BytesIn, cqe.res);
+
+            if(!session.m_first_byte)
+            {
+                session.m_first_byte = true;
+                Metrics::recordSince(MetricScope::AsyncClient, MetricStage::FirstByte, session.m_stage_at);
+                session.m_stage_at = Metrics::now();
+            }
+
+            system::error_code ec;
+            std::string_view response;
+            if(!session.m_response_buf.nextFrame(response, ec))
+            {
+                // partial response, keep reading unless frame was too large
+                if(ec)
+                    finishUring(uring, req, ec);
+                else
+                    recvUring(uring, req);
+
+                return;
+            }
+
+            session.m_response.assign(response.data(), response.size());
+            Metrics::recordSince(MetricScope::AsyncClient, MetricStage::ReadComplete, session.m_stage_at);
+            finishUring(uring, req, ec);
+        }
+
+        /* Cancels requests past their deadline. */
+        void onUringTick(UringConnector &uring)
+        {
+            uring.armTick();
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            for(std::unique_ptr<UringConnector::Request> &req: uring.m_requests)
+            {
+                if(!req->m_done && req->m_deadline_at <= now)
+                    abortUring(uring, *req);
+            }
+        }
+
+        /* Marks the request cancelled and cancels its operation, which then completes it with operation_aborted. */
+        void abortUring(UringConnector &uring, UringConnector::Request &req)
+        {
+            if(req.m_done || req.m_session->m_was_cacelled)
+                return;
+
+            req.m_session->m_was_cacelled = true;
+
+            io_uring_sqe *entry = uring.sqe();
+            entry->opcode = IORING_OP_ASYNC_CANCEL;
+            entry->addr = UringConnector::tag(&req, req.m_op);
+            entry->user_data = UringConnector::tag(&req, UringConnector::OpCancel);
+
+            ++req.m_cancels;
+        }
+
+        /* As retryOnFreshConnection: a pooled connection that failed before the request could be handled. */
+        bool retryUring(UringConnector &uring, UringConnector::Request &req)
+        {
+            Session &session = *req.m_session;
+            if(!session.m_reused)
+                return false;
+
+            ::close(req.m_fd);
+            req.m_fd = -1;
+            req.m_sent = 0;
+            session.m_reused = false;
+            session.m_response_buf.clear();
+
+            connectUring(uring, req);
+            return true;
+        }
+
+        /* Pools or closes the connection, frees the request and runs the callback. */
+        void finishUring(UringConnector &uring, UringConnector::Request &req, const system::error_code &ec)
+        {
+            std::shared_ptr<Session> session = std::move(req.m_session);
+
+            if(req.m_fd >= 0)
+            {
+                if(!ec && !session->m_was_cacelled)
+                    checkinUring(uring, session->m_ep, req.m_fd);
+                else
+                    ::close(req.m_fd);
+            }
+
+            req.m_fd = -1;
+            req.m_done = true;
+            if(req.m_cancels == 0)
+                releaseUring(uring, req);
+
+            session->m_ec = ec;
+            onRequestComplete(session);
+        }
+
+        /* Moves a done request out of m_requests into m_spare. */
+        void releaseUring(UringConnector &uring, UringConnector::Request &req)
+        {
+            std::size_t index = req.m_index;
+            std::unique_ptr<UringConnector::Request> done = std::move(uring.m_requests[index]);
+
+            if(index + 1 != uring.m_requests.size())
+            {
+                uring.m_requests[index] = std::move(uring.m_requests.back());
+                uring.m_requests[index]->m_index = index;
+            }
+            uring.m_requests.pop_back();
+
+            uring.m_spare.push_back(std::move(done));
+        }
+
+        /* Healthy idle connection to ep from the ring's pool, -1 if the caller must connect. See ConnectionPool. */
+        int checkoutUring(UringConnector &uring, const StreamEndpoint &ep)
+        {
+            if(!m_options.pool.enabled)
+                return -1;
+
+            auto it = uring.m_idle.find(ep);
+            if(it == uring.m_idle.end())
+                return -1;
+
+            std::deque<UringConnector::IdleConnection> &idle = it->second;
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+            while(!idle.empty() && now - idle.front().m_since > m_options.pool.idle_timeout)
+            {
+                ::close(idle.front().m_fd);
+                idle.pop_front();
+            }
+
+            while(!idle.empty())
+            {
+                int fd = idle.back().m_fd;
+                idle.pop_back();
+
+                // no EOF and no stray bytes: the peek would block
+                char byte;
+                if(::recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return fd;
+
+                ::close(fd);
+            }
+
+            return -1;
+        }
+
+        void checkinUring(UringConnector &uring, const StreamEndpoint &ep, int fd)
+        {
+            if(!m_options.pool.enabled)
+            {
+                ::close(fd);
+                return;
+            }
+
+            std::deque<UringConnector::IdleConnection> &idle = uring.m_idle[ep];
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+            while(!idle.empty() && now - idle.front().m_since > m_options.pool.idle_timeout)
+            {
+                ::close(idle.front().m_fd);
+                idle.pop_front();
+            }
+
+            if(idle.size() >= m_options.pool.max_idle_per_endpoint)
+            {
+                ::close(fd);
+                return;
+            }
+
+            idle.push_back(UringConnector::IdleConnection{fd, now});
+        }
+
+        /* Fails whatever is left, closes the pool and the ring; its close cancels the operations. */
+        void shutdownUring(UringConnector &uring)
+        {
+            std::unique_lock<std::mutex> lock(uring.m_gaurd);
+            uring.m_exited = true;
+            uring.m_starting.swap(uring.m_inbox);
+            uring.m_cancels.clear();
+            lock.unlock();
+
+            for(UringConnector::Queued &queued: uring.m_starting)
+            {
+                queued.m_session->m_ec = asio::error::operation_aborted;
+                onRequestComplete(queued.m_session);
+            }
+            uring.m_starting.clear();
+
+            for(std::unique_ptr<UringConnector::Request> &req: uring.m_requests)
+            {
+                if(req->m_done)
+                    continue;
+
+                if(req->m_fd >= 0)
+                    ::close(req->m_fd);
+
+                std::shared_ptr<Session> session = std::move(req->m_session);
+                session->m_ec = asio::error::operation_aborted;
+                onRequestComplete(session);
+            }
+            uring.m_requests.clear();
+
+            for(auto &entry: uring.m_idle)
+                for(UringConnector::IdleConnection &conn: entry.second)
+                    ::close(conn.m_fd);
+            uring.m_idle.clear();
+
+            uring.m_buffers.reset();
+            uring.m_ring.reset();
+        }
+#endif
+
+    public:
+
+        /* Contructor */
+        AsyncTCPClient(std::size_t threads, const ClientOptions &options = ClientOptions())
+            :m_wheel(m_ios, options.timer_tick, threads + 1),
+            m_options(options),
+            m_pool(options.pool)
+        {
+            m_wheel.start();
+
+            // keeps threads running event loop from exiting when no async operation is pending.
+            m_work.reset(new asio::io_service::work(m_ios));
+
+#ifdef NET_HAS_IO_URING
+            // the rings' threads run every request, the io_service would stay idle
+            if(m_options.backend == IoBackend::IoUring && startUring(threads))
+                return;
+#else
+            if(m_options.backend == IoBackend::IoUring)
+                Logger::warn("built without io_uring, using the reactor");
+#endif
+
+            //loop creating all the threads and appending them to the list
+            for(std::size_t i = 0; i < threads; ++i)
+            {
+                std::unique_ptr<std::thread> thread = std::make_unique<std::thread>(std::thread([this] () { m_ios.run();}));
+
+                m_threads.push_back(std::move(thread));
+            }
+        }
+
+        /*
+         * Cancels a request session given an ID.
+         *
+         * @param: {unsigned int} request_id: session ID.
+         *
+         * @behavior: marks sessions as canceled.
+         */
+        void cancelrequest(unsigned int request_id)
+        {
+            std::shared_ptr<Session> session = m_active_sessions.find(request_id);
+            if(session)
+                cancelSession(session);
+        }
+
+        /* Closes io_service work, causing all threads to stop looping event loop and joins threads.*/
+        void close()
+        {
+            m_wheel.stop();
+
+            // shared connections keep a read pending, closing them lets the threads run dry
+            std::unique_lock<std::mutex> lock(m_mux_gaurd);
+            for(auto &entry: m_mux)
+            {
+                std::lock_guard<std::mutex> conn_lock(entry.second->m_gaurd);
+                system::error_code ignored_ec;
+                entry.second->m_sock.close(ignored_ec);
+            }
+#ifdef NET_HAS_SHM
+            for(auto &entry: m_shm)
+            {
+                std::lock_guard<std::mutex> channel_lock(entry.second->m_gaurd);
+                system::error_code ignored_ec;
+                entry.second->m_control.close(ignored_ec);
+                entry.second->m_doorbell.close(ignored_ec);
+            }
+#endif
+            lock.unlock();
+
+#ifdef NET_HAS_IO_URING
+            stopUring();
+#endif
+
+            m_work.reset(NULL);
+            for(auto& thread: m_threads)
+                thread->join();
+
+            m_pool.clear();
+        }
+
+        /*
+         * Example function meant to test connecting, writing, and reading to server. Acomplished
+         * using nested callback functions. With pooling enabled an idle connection to the same
+         * endpoint is reused and the connect is skipped.
+         *
+         * @param: {const StreamEndpoint &} ep: server to connect to, TCP or Unix domain (see localEndpoint).
+         *         {Callback} callback: user provided function pointer to handle callback.
+         *         {unsigned int} request_id: request ID.
+         *         {std::chrono::milliseconds} timeout: deadline for whole request, zero uses
+         *                                             ClientOptions::request_timeout. A request
+         *                                             past its deadline completes with operation_aborted.
+         *
+         * @behavior: creats a new session for request, connects to server, writes to server, then reads from server.
+         */
+        void emulateLongComputationOp(const StreamEndpoint &ep, Callback callback, unsigned int request_id,
+                                      std::chrono::milliseconds timeout = std::chrono::milliseconds::zero())
+        {
+
+            std::string request{"Hello Server"};
+            std::shared_ptr<Session> session = std::allocate_shared<Session>(RecyclingAllocator<Session>(), m_ios,
+                                                                       ep, request, request_id, callback, m_options);
+
+#ifdef NET_HAS_SHM
+            if(overSharedMemory(m_options, session->m_ep))
+                session->m_shm = shmChannel(session->m_ep);
+            else
+#endif
+#ifdef NET_HAS_IO_URING
+            if(!m_urings.empty())
+                session->m_uring = m_urings[m_next_uring.fetch_add(1, std::memory_order_relaxed) % m_urings.size()].get();
+            else
+#endif
+            if(m_options.multiplexed)
+                session->m_conn = muxConnection(session->m_ep);
+            else
+                session->m_reused = m_pool.checkout(session->m_ep, session->m_sock);
+
+            if(!session->m_reused && !session->m_conn && !session->m_shm && !session->m_uring)
+            {
+                session->m_sock.open(session->m_ep.protocol());
+                tuneConnection(session->m_sock, m_options.tuning, true);
+            }
+
+            // add new session
+            m_active_sessions.insert(request_id, session);
+            Metrics::add(MetricScope::AsyncClient, MetricGauge::ActiveSessions, 1);
+
+            if(timeout.count() <= 0)
+                timeout = m_options.request_timeout;
+
+#ifdef NET_HAS_IO_URING
+            // the ring sweeps its own deadlines
+            if(session->m_uring)
+            {
+                queueUring(std::move(session), timeout);
+                return;
+            }
+#endif
+
+            if(timeout.count() > 0)
+                session->m_deadline = m_wheel.schedule(timeout, session, &AsyncTCPClient::onDeadline);
+
+            // simulate reading and writing from server
+#ifdef NET_HAS_SHM
+            if(session->m_shm)
+            {
+                session->m_stage_at = Metrics::now();
+                sendShm(session);
+            }
+            else
+#endif
+            if(session->m_conn)
+            {
+                session->m_stage_at = Metrics::now();
+                sendMultiplexed(session);
+            }
+            else
+            {
+                // the deadline or a cancelrequest may already be racing the first step
+                std::unique_lock<std::mutex> cancel_lock(session->m_cancel_gaurd);
+                if(session->m_was_cacelled)
+                {
+                    cancel_lock.unlock();
+                    onRequestComplete(session);
+                }
+                else if(session->m_reused)
+                    write(session);
+                else
+                    connect(session);
+            }
+        }
+
+        /* As above, to a TCP server at raw_ip_address and port_num. */
+        void emulateLongComputationOp(const std::string &raw_ip_address,
+                                      unsigned short port_num, Callback callback, unsigned int request_id,
+                                      std::chrono::milliseconds timeout = std::chrono::milliseconds::zero())
+        {
+            emulateLongComputationOp(tcpEndpoint(raw_ip_address, port_num), callback, request_id, timeout);
         }
 };
  #endif // !ASYNC_TCPCLIENTTCPCLIENT
@@ -7,178 +7,2304 @@
 #include <boost/asio/ip/address_v4.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/system/detail/error_code.hpp>
+#include <algorithm>
+#include <chrono>
 #include <string>
 #include <thread>
 #include <atomic>
 #include <memory>
 #include <iostream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "../common/framing.hpp"
+#include "../common/recyclingallocator.hpp"
+#include "../common/timerwheel.hpp"
+#include "../common/metrics.hpp"
+#include "../common/logger.hpp"
+#include "../common/iouring.hpp"
+#include "../common/shmring.hpp"
+#include "../common/sockettuning.hpp"
+#include "../common/streamendpoint.hpp"
+#include "../common/requesthandler.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef NET_HAS_IO_URING
+#include <netinet/in.h>
+#include <sys/socket.h>
+#endif
 
 using namespace boost;
 
-class Service
-{
-    private:
-        std::shared_ptr<asio::ip::tcp::socket> m_sock;
-        std::string m_response;
-        asio::streambuf m_request;
+/*
+ * How AsyncTCPServer spreads work over its threads.
+ *
+ * SharedPool: all threads run one io_service and share a single Acceptor.
+ * Sharded: one io_service, thread and SO_REUSEPORT Acceptor per shard, the kernel spreads
+ *          connections across shards and a connection stays on its shard for its whole life.
+ *          TCP only, a Unix domain socket always runs the shared pool.
+ */
+enum class ThreadingMode
+{
+    SharedPool,
+    Sharded
+};
+
+/*
+ * Server wide settings, handed down from AsyncTCPServer to every Acceptor and Service.
+ */
+struct ServerOptions
+{
+    ThreadingMode threading{ThreadingMode::SharedPool};
+    IoBackend backend{IoBackend::Reactor};               // io_uring runs one shard per thread whatever threading says
+    bool reuse_port{false};                              // set SO_REUSEPORT on listening socket, forced on when sharded
+    bool pin_threads{true};                              // sharded only, pin each shard thread to its own core
+    bool keep_alive{false};                              // keep reading from a connection after each response
+    std::chrono::milliseconds idle_timeout{30000};       // keep-alive connection is closed after this long without a request
+    std::chrono::milliseconds read_timeout{30000};       // whole request must arrive within this, zero disables
+    std::chrono::milliseconds write_timeout{30000};      // response must be written within this, zero disables
+    std::chrono::milliseconds timer_tick{10};            // resolution of the deadline timer wheel
+    Framing framing{Framing::Newline};
+    std::size_t max_frame_size{DEFAULT_MAX_FRAME_SIZE};
+    unsigned int compute_threads{0};                     // run request handlers on a pool this size, zero runs them on the I/O threads
+    std::size_t max_sessions{0};                         // connections served at once, zero for no limit
+    SocketTuning tuning;                                 // socket options and listen backlog of every acceptor and connection
+    std::string local_path;                              // listen on this Unix domain socket instead of the TCP port, same host clients only
+    unsigned int accept_batch{1};                        // accepts kept outstanding per acceptor
+    bool reject_when_full{false};                        // at max_sessions answer new connections with reject_response and close
+    std::string reject_response{"Server Busy"};
+    bool multiplexed{false};                             // requests carry an id and may be answered out of order, implies keep_alive and length prefixed framing
+    std::string shm_path;                                // also serve shared memory clients handing over their rings on this Unix domain socket, reactor only
+    bool broadcast{false};                               // every connection subscribes to publish(), implies keep_alive, reactor and unmultiplexed only
+    std::size_t broadcast_backlog{1024};                 // published messages queued per subscriber, one more and it is dropped as too slow
+    std::size_t write_high_water{1 << 20};               // multiplexed only, stop reading requests while this many response bytes are unsent, zero for no limit
+};
+
+/*
+ * What AdmissionControl sees of an acceptor parked for a session slot. It is called once per
+ * released slot, never per request, so this one virtual call stays off the request path.
+ */
+class ParkedAcceptor
+{
+    public:
+        /* Arms a parked accept with a slot released by a finished session, any thread. */
+        virtual void resume() = 0;
+
+    protected:
+        ~ParkedAcceptor() = default;
+};
+
+/*
+ * Server wide cap on concurrent sessions. An acceptor reserves a slot before it arms an accept;
+ * when none is free the acceptor parks itself and the next released slot is handed straight to
+ * it, so accepting pauses under overload and resumes as sessions finish.
+ *
+ * @behavior: with max_sessions zero every call succeeds without locking.
+ */
+class AdmissionControl : public asio::noncopyable {
+    private:
+        std::size_t m_max;
+        std::size_t m_active;
+        std::atomic<std::size_t> m_rejected;
+
+        std::mutex m_gaurd;
+        std::vector<ParkedAcceptor *> m_waiting;               // one entry per parked accept
+
+    public:
+
+        /* Constructor */
+        AdmissionControl(std::size_t max_sessions = 0)
+            :m_max(max_sessions),
+            m_active(0),
+            m_rejected(0)
+        {}
+
+        bool limited() const { return m_max != 0; }
+
+        /* Takes a slot; if none is free and acceptor is given, parks it for the next release. */
+        bool acquire(ParkedAcceptor *acceptor = nullptr)
+        {
+            if(m_max == 0)
+                return true;
+
+            std::lock_guard<std::mutex> lock(m_gaurd);
+
+            if(m_active < m_max)
+            {
+                ++m_active;
+                return true;
+            }
+
+            if(acceptor != nullptr)
+                m_waiting.push_back(acceptor);
+
+            return false;
+        }
+
+        /* Returns a slot, or passes it on to a parked acceptor. */
+        void release();
+
+        /* Drops every parked accept of acceptor, called when it stops. */
+        void forget(ParkedAcceptor *acceptor)
+        {
+            std::lock_guard<std::mutex> lock(m_gaurd);
+            m_waiting.erase(std::remove(m_waiting.begin(), m_waiting.end(), acceptor), m_waiting.end());
+        }
+
+        void reject() { m_rejected.fetch_add(1, std::memory_order_relaxed); }
+
+        /* Connections turned away with the reject response. */
+        std::size_t rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+};
+
+/* A published message, framed once and shared read-only by every subscriber it is queued to. */
+typedef std::shared_ptr<const std::string> SharedFrame;
+
+/*
+ * What the Broadcaster sees of a subscribed connection, one virtual call per subscriber and
+ * published message.
+ */
+class Subscriber
+{
+    public:
+        /*
+         * Queues frame for writing, any thread.
+         *
+         * @return: false if the subscriber is closing or was just dropped for falling behind.
+         */
+        virtual bool deliver(const SharedFrame &frame) = 0;
+
+    protected:
+        ~Subscriber() = default;
+};
+
+/*
+ * Fans published messages out to every subscribed connection. A message is framed into one
+ * immutable buffer and each subscriber queues a reference to it, so publishing costs one copy
+ * of the message whatever the number of subscribers. Subscribers are held weakly, a connection
+ * that went away without unsubscribing is pruned by the next publish.
+ */
+class Broadcaster : public asio::noncopyable {
+    private:
+        Framing m_framing;
+
+        std::mutex m_gaurd;
+        std::unordered_map<Subscriber *, std::weak_ptr<Subscriber>> m_subscribers;
+
+    public:
+
+        /* Constructor */
+        Broadcaster(Framing framing)
+            :m_framing(framing)
+        {}
+
+        void subscribe(const std::shared_ptr<Subscriber> &subscriber)
+        {
+            std::lock_guard<std::mutex> lock(m_gaurd);
+            m_subscribers.insert_or_assign(subscriber.get(), subscriber);
+        }
+
+        void unsubscribe(Subscriber *subscriber)
+        {
+            std::lock_guard<std::mutex> lock(m_gaurd);
+            m_subscribers.erase(subscriber);
+        }
+
+        std::size_t subscribers()
+        {
+            std::lock_guard<std::mutex> lock(m_gaurd);
+            return m_subscribers.size();
+        }
+
+        /*
+         * Frames message once and queues it to every subscriber. Subscribers are taken under the
+         * lock and delivered to outside it, so subscribing and other publishers are not held up
+         * by the outbox locks.
+         *
+         * @return: number of subscribers it was queued to.
+         */
+        std::size_t publish(std::string_view message)
+        {
+            std::shared_ptr<std::string> frame = std::make_shared<std::string>();
+            encodeFrame(m_framing, message, *frame);
+
+            SharedFrame shared(std::move(frame));
+            std::vector<std::shared_ptr<Subscriber>> snapshot;
+
+            std::unique_lock<std::mutex> lock(m_gaurd);
+            snapshot.reserve(m_subscribers.size());
+            for(auto it = m_subscribers.begin(); it != m_subscribers.end();)
+            {
+                std::shared_ptr<Subscriber> subscriber = it->second.lock();
+                if(!subscriber)
+                {
+                    it = m_subscribers.erase(it);
+                    continue;
+                }
+
+                snapshot.push_back(std::move(subscriber));
+                ++it;
+            }
+            lock.unlock();
+
+            // one unsubscribed meanwhile refuses the frame
+            std::size_t delivered = 0;
+            for(const std::shared_ptr<Subscriber> &subscriber: snapshot)
+            {
+                if(subscriber->deliver(shared))
+                    ++delivered;
+            }
+
+            return delivered;
+        }
+};
+
+/*
+ * Handles a single client connection. In keep-alive mode the service loops read, process, write
+ * on the same socket until the client closes or the idle timeout fires; otherwise the connection
+ * is finished after the first response. Requests pipelined into the same read are all answered
+ * by a single write, in the order they were received.
+ *
+ * Reads and writes run under a deadline kept in the io_service's shared TimerWheel, a client that
+ * stalls past it has its socket operations cancelled and the connection is closed.
+ *
+ * All handlers run on the services strand, the object is kept alive by the shared pointer each
+ * pending handler holds. Service, its buffers and its handlers are allocated from the per-thread
+ * Recycler, see Recycler::stats() for hit and miss counts.
+ *
+ * With a compute pool (ServerOptions::compute_threads) the parsed requests are handed to it and
+ * the response is posted back to the strand for writing, so slow handlers never hold up the
+ * io_service threads; the hops show up as the ComputeWait and ResumeWait stages and QueueDepth.
+ *
+ * In multiplexed mode every request frame carries its request id and the service keeps reading
+ * while requests are handled; each response is tagged with its id and queued for writing as soon
+ * as it is ready, so with a compute pool a slow request does not hold back the ones behind it.
+ * Responses that become ready while a write is in flight are queued without being copied and go
+ * out together in one gathered write. Once write_high_water bytes are unsent the service stops
+ * reading requests until the client catches up. The connection is then closed after idle_timeout
+ * without progress in either direction.
+ *
+ * With a Broadcaster (ServerOptions::broadcast) the service is also a Subscriber: published
+ * frames are queued by reference in its outbox and written, together with a ready response, in
+ * one gathered write while no other write is in progress. A subscriber waits for its next request
+ * without an idle deadline; one whose outbox overflows broadcast_backlog, or that does not take a
+ * gathered write within write_timeout, is closed instead, so a slow reader never holds up the
+ * publisher or the memory of every message since.
+ *
+ * Stage latencies, active sessions and bytes in and out are recorded under MetricScope::AsyncServer.
+ */
+template <typename Handler>
+class Service : public std::enable_shared_from_this<Service<Handler>>, public Subscriber
+{
+    private:
+        using std::enable_shared_from_this<Service<Handler>>::shared_from_this;
+        using std::enable_shared_from_this<Service<Handler>>::weak_from_this;
+
+        static constexpr std::size_t GATHER{64};         // buffers per gathered write, asio's writev limit
+
+        std::shared_ptr<StreamSocket> m_sock;
+        asio::strand<StreamSocket::executor_type> m_strand;
+        TimerWheel &m_wheel;
+        Handler &m_handler;
+        asio::thread_pool *m_compute;                    // runs the handler, inline on the strand if null
+        AdmissionControl &m_admission;                   // slot taken by the acceptor, returned on destruction
+        Broadcaster *m_broadcaster;                      // null unless connections subscribe
+        TimerId m_deadline;
+        std::chrono::steady_clock::time_point m_deadline_at;
+        std::chrono::milliseconds m_read_timeout;        // deadline of the read side, rearmed once broadcast writes drain
+        ServerOptions m_options;
+        bool m_timed_out;
+
+        std::string m_response;                          // handler output, framed in place
+        std::string m_pending;                           // multiplexed responses waiting for the current write, handled inline
+        std::deque<std::string> m_ready;                 // likewise, from the compute pool, moved rather than appended
+        std::vector<std::string> m_ready_sending;        // the ones in the write in progress
+        std::size_t m_unsent;                            // multiplexed bytes queued or being written
+        bool m_read_paused;                              // unsent reached write_high_water, reading resumes as it drains
+        bool m_writing;
+        FrameBuffer m_request;
+        std::vector<std::string_view> m_requests;       // frames of the current read, valid until next prepare
+
+        std::mutex m_outbox_gaurd;                       // outbox and the two flags, delivered from any thread
+        std::deque<SharedFrame> m_outbox;                // published frames waiting for a write
+        bool m_flush_scheduled;                          // a flush is posted, or the write in progress will pick the outbox up
+        bool m_unsubscribed;                             // closing or dropped, nothing more is queued
+        std::vector<SharedFrame> m_sending;              // published frames in the write in progress
+        std::vector<asio::const_buffer> m_gather;        // buffers of the gathered write in progress, broadcast or multiplexed
+        bool m_response_ready;                           // m_response waits for the write in progress
+        bool m_response_sending;                         // m_response is part of the write in progress
+
+        Metrics::TimePoint m_accepted_at;                // reset once first read is issued
+        Metrics::TimePoint m_read_started_at;
+        Metrics::TimePoint m_first_byte_at;              // reset once request is parsed
+        Metrics::TimePoint m_write_started_at;
+
+        /* Arms deadline for next request, idle timeout between keep-alive requests, and reads it. */
+        void readRequest()
+        {
+            bool between_requests = m_options.keep_alive && m_request.size() == 0;
+            std::chrono::milliseconds timeout =
+                between_requests || m_options.multiplexed ? m_options.idle_timeout : m_options.read_timeout;
+
+            // subscribers may listen without ever sending, falling behind is what closes them
+            if(between_requests && m_broadcaster != nullptr)
+                timeout = std::chrono::milliseconds(0);
+
+            // a broadcast write in progress keeps its write deadline, the read's is armed once it drains
+            m_read_timeout = timeout;
+            if(m_broadcaster == nullptr || !m_writing)
+                armDeadline(timeout);
+
+            m_read_started_at = Metrics::now();
+            if(m_accepted_at != Metrics::TimePoint())
+            {
+                Metrics::record(MetricScope::AsyncServer, MetricStage::Accept, m_read_started_at - m_accepted_at);
+                m_accepted_at = Metrics::TimePoint();
+            }
+
+            readSome();
+        }
+
+        /* Reads whatever the client has sent so far into the receive buffer. */
+        void readSome()
+        {
+            m_sock->async_read_some(m_request.prepare(),
+                    asio::bind_executor(m_strand, makeRecyclingHandler(
+                        [self = shared_from_this()](const system::error_code &ec, std::size_t bytes_transferred)
+                        {
+                            self->onRequestRecieved(ec, bytes_transferred);
+                        })));
+        }
+
+        void onRequestRecieved(const boost::system::error_code &ec, std::size_t bytes_transferred)
+        {
+            if(ec.value() != 0)
+            {
+                // client closing a keep-alive connection, idle timeout or a dropped subscriber is the normal way out
+                if(ec != asio::error::eof && !m_timed_out && m_sock->is_open())
+                {
+                    Logger::error("Error code in Service class ! Error code = ", ec.value(),
+                            ". Message: ", ec.message());
+                }
+
+                onFinish();
+                return;
+            }
+
+            m_request.commit(bytes_transferred);
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::BytesIn, bytes_transferred);
+
+            if(m_first_byte_at == Metrics::TimePoint())
+            {
+                m_first_byte_at = Metrics::now();
+                Metrics::record(MetricScope::AsyncServer, MetricStage::FirstByte, m_first_byte_at - m_read_started_at);
+            }
+
+            // collect every complete request in the buffer, responses go out in a single write
+            system::error_code frame_ec;
+            std::string_view request;
+
+            m_requests.clear();
+            while(m_request.nextFrame(request, frame_ec))
+                m_requests.push_back(request);
+
+            if(frame_ec)
+            {
+                Logger::error("Error code in Service class ! Error code = ", frame_ec.value(),
+                        ". Message: ", frame_ec.message());
+
+                onFinish();
+                return;
+            }
+
+            // partial request, keep reading
+            if(m_requests.empty())
+            {
+                readSome();
+                return;
+            }
+
+            Metrics::recordSince(MetricScope::AsyncServer, MetricStage::ReadComplete, m_first_byte_at);
+            m_first_byte_at = Metrics::TimePoint();
+
+            if(m_options.multiplexed)
+            {
+                if(!dispatchTagged())
+                {
+                    onFinish();
+                    return;
+                }
+
+                // client is not taking its responses as fast as it sends requests, stop reading
+                if(m_options.write_high_water != 0 && m_unsent >= m_options.write_high_water)
+                    m_read_paused = true;
+                else
+                    readRequest();
+
+                return;
+            }
+
+            if(m_compute == nullptr)
+            {
+                processRequests();
+                writeResponse();
+                return;
+            }
+
+            // time spent queued for and on the compute pool is not charged to the read deadline
+            m_read_timeout = std::chrono::milliseconds(0);
+            if(m_broadcaster == nullptr || !m_writing)
+                armDeadline(m_read_timeout);
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::QueueDepth, 1);
+
+            asio::post(*m_compute, makeRecyclingHandler(
+                    [self = shared_from_this(), queued_at = Metrics::now()]()
+                    {
+                        Metrics::add(MetricScope::AsyncServer, MetricGauge::QueueDepth, -1);
+                        Metrics::recordSince(MetricScope::AsyncServer, MetricStage::ComputeWait, queued_at);
+
+                        self->processRequests();
+
+                        asio::post(self->m_strand, makeRecyclingHandler(
+                                [self, processed_at = Metrics::now()]()
+                                {
+                                    Metrics::recordSince(MetricScope::AsyncServer, MetricStage::ResumeWait, processed_at);
+                                    self->writeResponse();
+                                }));
+                    }));
+        }
+
+        /*
+         * Runs the handler over every collected request, on the strand or, when offloaded, on a
+         * compute pool thread while no other operation of this service is pending.
+         */
+        void processRequests()
+        {
+            m_response.clear();
+
+            for(std::string_view request: m_requests)
+            {
+                Metrics::TimePoint started = Metrics::now();
+
+                std::size_t frame = beginFrame(m_options.framing, m_response);
+                m_handler(request, m_response);
+                endFrame(m_options.framing, m_response, frame);
+
+                Metrics::recordSince(MetricScope::AsyncServer, MetricStage::Process, started);
+            }
+        }
+
+        /*
+         * Multiplexed: runs the handler for each collected request on its own, inline or on the
+         * compute pool, and queues its tagged response. Requests are copied for the pool since the
+         * receive buffer is reused by the next read.
+         *
+         * @return: false if a frame carried no request id.
+         */
+        bool dispatchTagged()
+        {
+            for(std::string_view frame: m_requests)
+            {
+                std::uint32_t id;
+                std::string_view request;
+
+                if(!splitTaggedFrame(frame, id, request))
+                {
+                    Logger::error("Error in Service class ! Frame without request id");
+                    return false;
+                }
+
+                if(m_compute == nullptr)
+                {
+                    Metrics::TimePoint started = Metrics::now();
+
+                    std::size_t frame = beginTaggedFrame(id, m_pending);
+                    m_handler(request, m_pending);
+                    endTaggedFrame(m_pending, frame);
+                    m_unsent += m_pending.size() - frame;
+
+                    Metrics::recordSince(MetricScope::AsyncServer, MetricStage::Process, started);
+
+                    if(!m_writing)
+                        writePending();
+                    continue;
+                }
+
+                Metrics::add(MetricScope::AsyncServer, MetricGauge::QueueDepth, 1);
+
+                asio::post(*m_compute, makeRecyclingHandler(
+                        [self = shared_from_this(), id, request = std::string(request), queued_at = Metrics::now()]()
+                        {
+                            Metrics::add(MetricScope::AsyncServer, MetricGauge::QueueDepth, -1);
+                            Metrics::recordSince(MetricScope::AsyncServer, MetricStage::ComputeWait, queued_at);
+
+                            Metrics::TimePoint started = Metrics::now();
+                            std::string response;
+                            std::size_t frame = beginTaggedFrame(id, response);
+                            self->m_handler(request, response);
+                            endTaggedFrame(response, frame);
+                            Metrics::recordSince(MetricScope::AsyncServer, MetricStage::Process, started);
+
+                            asio::post(self->m_strand, makeRecyclingHandler(
+                                    [self, response = std::move(response), processed_at = Metrics::now()]() mutable
+                                    {
+                                        Metrics::recordSince(MetricScope::AsyncServer, MetricStage::ResumeWait, processed_at);
+                                        self->queueResponse(std::move(response));
+                                    }));
+                        }));
+            }
+
+            return true;
+        }
+
+        /* Multiplexed: queues a tagged frame, writing it now unless a write is in progress. */
+        void queueResponse(std::string &&frame)
+        {
+            m_unsent += frame.size();
+            m_ready.push_back(std::move(frame));
+
+            if(!m_writing)
+                writePending();
+        }
+
+        /*
+         * Multiplexed: writes the responses handled inline and up to GATHER - 1 from the compute
+         * pool in one gathered write.
+         */
+        void writePending()
+        {
+            if((m_pending.empty() && m_ready.empty()) || !m_sock->is_open())
+                return;
+
+            m_writing = true;
+            m_response.swap(m_pending);
+            m_pending.clear();
+            m_write_started_at = Metrics::now();
+
+            while(!m_ready.empty() && m_ready_sending.size() + 1 < GATHER)
+            {
+                m_ready_sending.push_back(std::move(m_ready.front()));
+                m_ready.pop_front();
+            }
+
+            // buffers only once m_ready_sending stopped growing, a move may relocate short strings
+            m_gather.clear();
+            if(!m_response.empty())
+                m_gather.push_back(asio::buffer(m_response));
+            for(const std::string &frame: m_ready_sending)
+                m_gather.push_back(asio::buffer(frame));
+
+            asio::async_write(*m_sock.get(), m_gather,
+                    asio::bind_executor(m_strand, makeRecyclingHandler(
+                        [self = shared_from_this()](const system::error_code &ec, std::size_t bytes_transferred)
+                        {
+                            self->onPendingSent(ec, bytes_transferred);
+                        })));
+        }
+
+        void onPendingSent(const boost::system::error_code &ec, std::size_t bytes_transferred)
+        {
+            m_writing = false;
+            m_ready_sending.clear();
+
+            if(ec.value() != 0)
+            {
+                if(!m_timed_out && ec != asio::error::operation_aborted)
+                {
+                    Logger::error("Error code! Error code = ", ec.value(),
+                            ". Message: ", ec.message());
+                }
+
+                onFinish();
+                return;
+            }
+
+            Metrics::recordSince(MetricScope::AsyncServer, MetricStage::WriteComplete, m_write_started_at);
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::BytesOut, bytes_transferred);
+
+            // progress on the connection, push the idle deadline out
+            armDeadline(m_options.idle_timeout);
+            m_unsent -= bytes_transferred;
+            writePending();
+
+            if(m_read_paused && m_unsent < m_options.write_high_water)
+            {
+                m_read_paused = false;
+                readRequest();
+            }
+        }
+
+        void writeResponse()
+        {
+            armDeadline(m_options.write_timeout);
+            m_write_started_at = Metrics::now();
+
+            // the socket is shared with published frames, the response joins the next gathered write
+            if(m_broadcaster != nullptr)
+            {
+                m_response_ready = true;
+                if(!m_writing)
+                    writeQueued();
+
+                return;
+            }
+
+            //write operation
+            asio::async_write(*m_sock.get(), asio::buffer(m_response),
+                    asio::bind_executor(m_strand, makeRecyclingHandler(
+                        [self = shared_from_this()](const system::error_code &ec, std::size_t bytes_transferred)
+                        {
+                            self->onResponseSent(ec, bytes_transferred);
+                        })));
+        }
+
+        void onResponseSent(const boost::system::error_code &ec, std::size_t bytes_transferred)
+        {
+            if(ec.value() != 0)
+            {
+                Logger::error("Error code! Error code = ", ec.value(),
+                        ". Message: ", ec.message());
+
+                onFinish();
+                return;
+            }
+
+            Metrics::recordSince(MetricScope::AsyncServer, MetricStage::WriteComplete, m_write_started_at);
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::BytesOut, bytes_transferred);
+
+            if(m_options.keep_alive)
+                readRequest();
+            else
+                onFinish();
+        }
+
+        /* Broadcast: writes the ready response and up to GATHER published frames in one go. */
+        void writeQueued()
+        {
+            m_gather.clear();
+
+            m_response_sending = m_response_ready;
+            m_response_ready = false;
+            if(m_response_sending)
+                m_gather.push_back(asio::buffer(m_response));
+
+            std::unique_lock<std::mutex> lock(m_outbox_gaurd);
+            while(!m_outbox.empty() && m_gather.size() < GATHER)
+            {
+                m_sending.push_back(std::move(m_outbox.front()));
+                m_outbox.pop_front();
+                m_gather.push_back(asio::buffer(*m_sending.back()));
+            }
+
+            // the rest goes with the next write, started when this one completes
+            m_flush_scheduled = !m_outbox.empty();
+            lock.unlock();
+
+            if(m_gather.empty() || !m_sock->is_open())
+                return;
+
+            // every gathered write runs under write_timeout, a subscriber that stops reading is closed
+            armDeadline(m_options.write_timeout);
+
+            m_writing = true;
+            asio::async_write(*m_sock.get(), m_gather,
+                    asio::bind_executor(m_strand, makeRecyclingHandler(
+                        [self = shared_from_this()](const system::error_code &ec, std::size_t bytes_transferred)
+                        {
+                            self->onQueuedSent(ec, bytes_transferred);
+                        })));
+        }
+
+        void onQueuedSent(const boost::system::error_code &ec, std::size_t bytes_transferred)
+        {
+            m_writing = false;
+            m_sending.clear();
+
+            if(ec.value() != 0)
+            {
+                // closed under the write when the subscriber was dropped
+                if(!m_timed_out && ec != asio::error::operation_aborted && m_sock->is_open())
+                {
+                    Logger::error("Error code! Error code = ", ec.value(),
+                            ". Message: ", ec.message());
+                }
+
+                onFinish();
+                return;
+            }
+
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::BytesOut, bytes_transferred);
+
+            if(m_response_sending)
+            {
+                Metrics::recordSince(MetricScope::AsyncServer, MetricStage::WriteComplete, m_write_started_at);
+                m_response_sending = false;
+                readRequest();
+            }
+
+            writeQueued();
+
+            // nothing left to write, the read side gets its own deadline back
+            if(!m_writing)
+                armDeadline(m_read_timeout);
+        }
+
+        /* Replaces current deadline, zero timeout leaves the operation without one. */
+        void armDeadline(std::chrono::milliseconds timeout)
+        {
+            m_wheel.cancel(m_deadline);
+            m_deadline_at = std::chrono::steady_clock::time_point::max();
+
+            if(timeout.count() <= 0)
+                return;
+
+            m_deadline_at = std::chrono::steady_clock::now() + timeout;
+            m_deadline = m_wheel.schedule(timeout, weak_from_this(), &Service::onDeadline);
+        }
+
+        /* Wheel callback, runs on the wheel's thread; hops onto the strand. */
+        static void onDeadline(const std::shared_ptr<void> &owner)
+        {
+            std::shared_ptr<Service> self = std::static_pointer_cast<Service>(owner);
+
+            asio::post(self->m_strand, makeRecyclingHandler([self]()
+                    {
+                        self->onTimeout();
+                    }));
+        }
+
+        /*
+         * A deadline can fire while its replacement is being armed; only act once the
+         * current deadline has passed.
+         */
+        void onTimeout()
+        {
+            if(std::chrono::steady_clock::now() < m_deadline_at)
+                return;
+
+            m_timed_out = true;
+
+            system::error_code ignored_ec;
+            m_sock->cancel(ignored_ec);
+        }
+
+        void onFinish()
+        {
+            system::error_code ignored_ec;
+
+            if(m_broadcaster != nullptr)
+            {
+                m_broadcaster->unsubscribe(this);
+
+                std::lock_guard<std::mutex> lock(m_outbox_gaurd);
+                m_unsubscribed = true;
+                m_outbox.clear();
+            }
+
+            m_wheel.cancel(m_deadline);
+            m_deadline_at = std::chrono::steady_clock::time_point::max();
+            m_sock->shutdown(StreamSocket::shutdown_both, ignored_ec);
+            m_sock->close(ignored_ec);
+        }
+
+    public:
+
+        Service(std::shared_ptr<StreamSocket> sock, TimerWheel &wheel, Handler &handler, asio::thread_pool *compute,
+                AdmissionControl &admission, Broadcaster *broadcaster, const ServerOptions &options)
+            :m_sock(sock),
+            m_strand(m_sock->get_executor()),
+            m_wheel(wheel),
+            m_handler(handler),
+            m_compute(compute),
+            m_admission(admission),
+            m_broadcaster(broadcaster),
+            m_deadline_at(std::chrono::steady_clock::time_point::max()),
+            m_read_timeout(0),
+            m_options(options),
+            m_timed_out(false),
+            m_unsent(0),
+            m_read_paused(false),
+            m_writing(false),
+            m_request(options.framing, options.max_frame_size),
+            m_flush_scheduled(false),
+            m_unsubscribed(false),
+            m_response_ready(false),
+            m_response_sending(false),
+            m_accepted_at(Metrics::now())
+        {
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::ActiveSessions, 1);
+        }
+
+        ~Service()
+        {
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::ActiveSessions, -1);
+            m_admission.release();
+        }
+
+        /* Subscriber: queues a published frame, dropping the connection once backlog is exceeded. */
+        bool deliver(const SharedFrame &frame) override
+        {
+            std::unique_lock<std::mutex> lock(m_outbox_gaurd);
+
+            if(m_unsubscribed)
+                return false;
+
+            if(m_outbox.size() >= m_options.broadcast_backlog)
+            {
+                m_unsubscribed = true;
+                m_outbox.clear();
+                lock.unlock();
+
+                Metrics::add(MetricScope::AsyncServer, MetricGauge::Dropped, 1);
+                asio::post(m_strand, makeRecyclingHandler([self = shared_from_this()]()
+                        {
+                            Logger::warn("Subscriber dropped, more than ", self->m_options.broadcast_backlog,
+                                    " published messages behind");
+                            self->onFinish();
+                        }));
+                return false;
+            }
+
+            m_outbox.push_back(frame);
+
+            if(m_flush_scheduled)
+                return true;
+
+            m_flush_scheduled = true;
+            lock.unlock();
+
+            asio::post(m_strand, makeRecyclingHandler([self = shared_from_this()]()
+                    {
+                        if(!self->m_writing)
+                            self->writeQueued();
+                    }));
+            return true;
+        }
+
+        void startHandling()
+        {
+            if(m_broadcaster != nullptr)
+                m_broadcaster->subscribe(shared_from_this());
+
+            // read from Client
+            asio::dispatch(m_strand, makeRecyclingHandler([self = shared_from_this()]()
+                    {
+                        self->readRequest();
+                    }));
+        }
+};
+
+/*
+ * Accepts connections on one listening socket and starts a Service for each. Up to accept_batch
+ * accepts are kept outstanding, each holding a session slot from AdmissionControl; when the cap
+ * is reached the acceptor either stops accepting until a session finishes, leaving new clients
+ * in the kernel backlog, or with reject_when_full accepts and turns them away immediately.
+ */
+template <typename Handler>
+class Acceptor : public ParkedAcceptor
+{
+    private:
+        asio::io_service &m_ios;
+        StreamAcceptor m_acceptor;
+        TimerWheel &m_wheel;
+        Handler &m_handler;
+        asio::thread_pool *m_compute;
+        AdmissionControl &m_admission;
+        Broadcaster *m_broadcaster;
+        ServerOptions m_options;
+        std::string m_reject;                            // framed reject response
+        std::atomic<bool> m_isStopped;
+
+        /* Arms the next accept once a session slot is free, or without one to reject the client. */
+        void acceptNext()
+        {
+            if(m_isStopped.load())
+                return;
+
+            if(m_admission.acquire(m_options.reject_when_full ? nullptr : this))
+                InitAccept(true);
+            else if(m_options.reject_when_full)
+                InitAccept(false);
+
+            // otherwise parked, resume() arms the accept with the released slot
+        }
+
+        void InitAccept(bool admitted)
+        {
+            std::shared_ptr<StreamSocket> sock =
+                std::allocate_shared<StreamSocket>(RecyclingAllocator<StreamSocket>(), m_ios);
+
+            m_acceptor.async_accept(*sock.get(), makeRecyclingHandler(
+                    [this, sock, admitted](const system::error_code &ec)
+                    {
+                        onAccept(ec, sock, admitted);
+                    }));
+        }
+
+        void onAccept(const system::error_code &ec, std::shared_ptr<StreamSocket> sock, bool admitted)
+        {
+            // a slot may have freed up while a rejecting accept was pending
+            if(ec.value() == 0 && !admitted)
+                admitted = m_admission.acquire();
+
+            if(ec.value() == 0 && admitted)
+            {
+                tuneConnection(*sock, m_options.tuning, false);
+                std::allocate_shared<Service<Handler>>(RecyclingAllocator<Service<Handler>>(), sock, m_wheel,
+                        m_handler, m_compute, m_admission, m_broadcaster, m_options) -> startHandling();
+            }
+            else if(ec.value() == 0)
+            {
+                rejectClient(*sock);
+            }
+            else
+            {
+                if(admitted)
+                    m_admission.release();
+
+                Logger::error("Error occured! Error code = ", ec.value(),
+                        ". Message: ", ec.message());
+            }
+
+            // Init next socket to accept, unless stopped
+            if(!m_isStopped.load())
+            {
+                acceptNext();
+            }
+            else
+            {
+                m_acceptor.close();
+            }
+        }
+
+        /* Best effort reject response, never waits on the client. */
+        void rejectClient(StreamSocket &sock)
+        {
+            system::error_code ignored_ec;
+
+            sock.non_blocking(true, ignored_ec);
+            sock.write_some(asio::buffer(m_reject), ignored_ec);
+            sock.shutdown(StreamSocket::shutdown_both, ignored_ec);
+            sock.close(ignored_ec);
+
+            m_admission.reject();
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::Rejected, 1);
+        }
+
+    public:
+
+        Acceptor(asio::io_service &ios, unsigned short port_num, TimerWheel &wheel, Handler &handler,
+                 AdmissionControl &admission, asio::thread_pool *compute = nullptr, Broadcaster *broadcaster = nullptr,
+                 const ServerOptions &options = ServerOptions()):
+            m_ios(ios),
+            m_acceptor(m_ios),
+            m_wheel(wheel),
+            m_handler(handler),
+            m_compute(compute),
+            m_admission(admission),
+            m_broadcaster(broadcaster),
+            m_options(options),
+            m_isStopped(false)
+    {
+        openListener(m_acceptor, listenEndpoint(port_num, m_options.local_path), m_options.tuning,
+                m_options.reuse_port);
+
+        encodeFrame(m_options.framing, m_options.reject_response, m_reject);
+    }
+
+        ~Acceptor()
+        {
+            m_admission.forget(this);
+        }
+
+        void start()
+        {
+            m_acceptor.listen(m_options.tuning.backlog);
+
+            unsigned int batch = m_options.accept_batch ? m_options.accept_batch : 1;
+            for(unsigned int i{0}; i < batch; ++i)
+                acceptNext();
+        }
+
+        /* Arms a parked accept with a slot released by a finished session, any thread. */
+        void resume() override
+        {
+            asio::post(m_ios, makeRecyclingHandler([this]()
+                    {
+                        if(m_isStopped.load())
+                            m_admission.release();
+                        else
+                            InitAccept(true);
+                    }));
+        }
+
+        void stop()
+        {
+            m_isStopped.store(true);
+            m_admission.forget(this);
+            removeListenerFile(m_acceptor);
+        }
+};
+
+inline void AdmissionControl::release()
+{
+    if(m_max == 0)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_gaurd);
+
+    if(m_waiting.empty())
+    {
+        --m_active;
+        return;
+    }
+
+    ParkedAcceptor *acceptor = m_waiting.back();
+    m_waiting.pop_back();
+    lock.unlock();
+
+    acceptor->resume();
+}
+
+#ifdef NET_HAS_IO_URING
+
+/*
+ * Acceptor and its sessions on an io_uring instead of the epoll reactor: one per thread, with
+ * its own SO_REUSEPORT listening socket, the io_uring counterpart of a sharded Acceptor.
+ *
+ * One multishot accept keeps accepting and every connection has one multishot receive armed,
+ * drawing from a provided buffer ring, so an idle connection holds no receive buffer and its
+ * requests arrive without re-arming. Everything queued while handling a batch of completions
+ * is submitted together with the wait for the next batch, one system call per loop iteration.
+ *
+ * Requests are framed, processed and answered as in Service, pipelined requests in one send.
+ * Deadlines are checked by sweeping the connections every timer_tick. When max_sessions is
+ * reached accepted clients are either rejected or held back: the accept is cancelled, leaving
+ * the rest in the kernel backlog, and the held clients are admitted as slots free up.
+ *
+ * Stage latencies, active sessions and bytes in and out are recorded under MetricScope::AsyncServer.
+ *
+ * @behavior: ring and buffers are created by run(), on the thread that submits to them.
+ */
+template <typename Handler>
+class UringAcceptor
+{
+    private:
+        static constexpr unsigned RING_ENTRIES{1024};
+        static constexpr unsigned BUFFER_COUNT{512};     // power of two
+        static constexpr std::size_t BUFFER_SIZE{4096};
+        static constexpr std::uint16_t BUFFER_GROUP{0};
+
+        // completion kind, kept in the low bits of user_data next to the connection pointer
+        enum Op : std::uint64_t
+        {
+            OpAccept,
+            OpRecv,
+            OpSend,
+            OpTick,
+            OpCancel
+        };
+
+        static constexpr std::uint64_t OP_MASK{7};
+
+        struct alignas(8) Connection
+        {
+            int m_fd;
+            std::size_t m_index;                         // position in m_connections
+            FrameBuffer m_request;
+            std::string m_response;                      // being sent
+            std::string m_pending;                       // responses ready while a send is in flight, framed in place
+            std::size_t m_sent{0};
+            bool m_receiving{false};                     // a receive is armed
+            bool m_sending{false};
+            bool m_answered{false};                      // without keep-alive, nothing is read after the first response
+            bool m_closing{false};
+            std::chrono::steady_clock::time_point m_deadline_at{std::chrono::steady_clock::time_point::max()};
+
+            Metrics::TimePoint m_read_started_at;
+            Metrics::TimePoint m_first_byte_at;          // reset once request is parsed
+            Metrics::TimePoint m_write_started_at;
+
+            Connection(int fd, std::size_t index, const ServerOptions &options)
+                :m_fd(fd),
+                m_index(index),
+                m_request(options.framing, options.max_frame_size)
+            {}
+        };
+
+        int m_listener;
+        Handler &m_handler;
+        AdmissionControl &m_admission;
+        ServerOptions m_options;
+        std::string m_reject;                            // framed reject response
+        std::atomic<bool> m_isStopped;
+
+        std::unique_ptr<IoUring> m_ring;
+        std::unique_ptr<ProvidedBuffers> m_buffers;
+        bool m_multishot_recv;                           // cleared on kernels older than 6.0
+        bool m_accepting;                                // the multishot accept is armed
+        __kernel_timespec m_tick;
+
+        std::vector<std::unique_ptr<Connection>> m_connections;
+        std::vector<int> m_held;                         // accepted while at max_sessions, waiting for a slot
+
+        static std::uint64_t tag(Connection *conn, Op op)
+        {
+            return reinterpret_cast<std::uint64_t>(conn) | op;
+        }
+
+        static void throwErrno()
+        {
+            throw system::system_error(system::error_code(errno, system::system_category()));
+        }
+
+        /* Next submission entry, flushing the queue to the kernel when it is full. */
+        io_uring_sqe *sqe()
+        {
+            io_uring_sqe *entry;
+            while((entry = m_ring->sqe()) == nullptr)
+                m_ring->submit();
+
+            return entry;
+        }
+
+        void armAccept()
+        {
+            io_uring_sqe *entry = sqe();
+            entry->opcode = IORING_OP_ACCEPT;
+            entry->fd = m_listener;
+            entry->ioprio = IORING_ACCEPT_MULTISHOT;
+            entry->accept_flags = SOCK_CLOEXEC;
+            entry->user_data = tag(nullptr, OpAccept);
+
+            m_accepting = true;
+        }
+
+        void cancelAccept()
+        {
+            io_uring_sqe *entry = sqe();
+            entry->opcode = IORING_OP_ASYNC_CANCEL;
+            entry->addr = tag(nullptr, OpAccept);
+            entry->user_data = tag(nullptr, OpCancel);
+        }
+
+        void armTick()
+        {
+            io_uring_sqe *entry = sqe();
+            entry->opcode = IORING_OP_TIMEOUT;
+            entry->addr = reinterpret_cast<std::uint64_t>(&m_tick);
+            entry->len = 1;
+            entry->user_data = tag(nullptr, OpTick);
+        }
+
+        void armRecv(Connection &conn)
+        {
+            io_uring_sqe *entry = sqe();
+            entry->opcode = IORING_OP_RECV;
+            entry->fd = conn.m_fd;
+            entry->flags = IOSQE_BUFFER_SELECT;
+            entry->buf_group = m_buffers->group();
+            entry->ioprio = m_multishot_recv ? IORING_RECV_MULTISHOT : 0;
+            entry->user_data = tag(&conn, OpRecv);
+
+            conn.m_receiving = true;
+        }
+
+        void sendRest(Connection &conn)
+        {
+            io_uring_sqe *entry = sqe();
+            entry->opcode = IORING_OP_SEND;
+            entry->fd = conn.m_fd;
+            entry->addr = reinterpret_cast<std::uint64_t>(conn.m_response.data() + conn.m_sent);
+            entry->len = static_cast<std::uint32_t>(conn.m_response.size() - conn.m_sent);
+            entry->msg_flags = MSG_NOSIGNAL;
+            entry->user_data = tag(&conn, OpSend);
+
+            conn.m_sending = true;
+        }
+
+        /* Replaces connection's deadline, zero timeout leaves it without one. */
+        void armDeadline(Connection &conn, std::chrono::milliseconds timeout)
+        {
+            conn.m_deadline_at = timeout.count() > 0 ? std::chrono::steady_clock::now() + timeout
+                : std::chrono::steady_clock::time_point::max();
+        }
+
+        /* Deadline while waiting for a request, idle timeout between keep-alive requests. */
+        void armReadDeadline(Connection &conn)
+        {
+            bool between_requests = m_options.keep_alive && conn.m_request.size() == 0;
+            armDeadline(conn, between_requests ? m_options.idle_timeout : m_options.read_timeout);
+        }
+
+        void onCompletion(const io_uring_cqe &cqe)
+        {
+            Connection *conn = reinterpret_cast<Connection *>(cqe.user_data & ~OP_MASK);
+
+            switch(static_cast<Op>(cqe.user_data & OP_MASK))
+            {
+                case OpAccept: onAccept(cqe); break;
+                case OpRecv: onRecv(*conn, cqe); break;
+                case OpSend: onSend(*conn, cqe); break;
+                case OpTick: onTick(); break;
+                case OpCancel: break;
+            }
+        }
+
+        void onAccept(const io_uring_cqe &cqe)
+        {
+            if(!(cqe.flags & IORING_CQE_F_MORE))
+            {
+                m_accepting = false;
+
+                // re-armed once the held clients are admitted
+                if(!m_isStopped.load() && m_held.empty())
+                    armAccept();
+            }
+
+            if(cqe.res < 0)
+            {
+                if(cqe.res != -ECANCELED)
+                {
+                    Logger::error("Error occured! Error code = ", -cqe.res,
+                            ". Message: ", std::strerror(-cqe.res));
+                }
+
+                return;
+            }
+
+            if(m_admission.acquire())
+            {
+                admit(cqe.res);
+            }
+            else if(m_options.reject_when_full)
+            {
+                rejectClient(cqe.res);
+            }
+            else
+            {
+                m_held.push_back(cqe.res);
+
+                if(m_accepting && m_held.size() == 1)
+                    cancelAccept();
+            }
+        }
+
+        /* Starts serving an accepted client that holds a session slot. */
+        void admit(int fd)
+        {
+            Metrics::TimePoint accepted_at = Metrics::now();
+
+            tuneConnection(fd, m_options.tuning, false);
+            m_connections.push_back(std::make_unique<Connection>(fd, m_connections.size(), m_options));
+            Connection &conn = *m_connections.back();
+
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::ActiveSessions, 1);
+
+            armReadDeadline(conn);
+            armRecv(conn);
+
+            conn.m_read_started_at = Metrics::now();
+            Metrics::record(MetricScope::AsyncServer, MetricStage::Accept, conn.m_read_started_at - accepted_at);
+        }
+
+        /* Best effort reject response, never waits on the client. */
+        void rejectClient(int fd)
+        {
+            ::send(fd, m_reject.data(), m_reject.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            ::shutdown(fd, SHUT_RDWR);
+            ::close(fd);
+
+            m_admission.reject();
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::Rejected, 1);
+        }
+
+        void onRecv(Connection &conn, const io_uring_cqe &cqe)
+        {
+            if(!(cqe.flags & IORING_CQE_F_MORE))
+                conn.m_receiving = false;
+
+            if(cqe.res > 0)
+            {
+                std::uint16_t id = ProvidedBuffers::bufferId(cqe);
+                consume(conn, m_buffers->data(id), static_cast<std::size_t>(cqe.res));
+                m_buffers->recycle(id);
+            }
+            else if(cqe.res == 0)
+            {
+                // client closed, or shutdown by close()
+                close(conn);
+            }
+            else if(cqe.res == -EINVAL && m_multishot_recv)
+            {
+                // multishot receive needs 6.0, fall back to arming a receive per read
+                m_multishot_recv = false;
+            }
+            else if(cqe.res != -ENOBUFS)
+            {
+                if(!conn.m_closing && cqe.res != -ECONNRESET)
+                {
+                    Logger::error("Error code in UringAcceptor ! Error code = ", -cqe.res,
+                            ". Message: ", std::strerror(-cqe.res));
+                }
+
+                close(conn);
+            }
+
+            // out of buffers ends a multishot receive, the next one picks up the recycled ones
+            if(!conn.m_receiving && !conn.m_closing && !conn.m_answered)
+                armRecv(conn);
+
+            finishIfDone(conn);
+        }
+
+        /* Splits received bytes into requests and queues their responses. */
+        void consume(Connection &conn, const char *data, std::size_t size)
+        {
+            if(conn.m_closing || conn.m_answered)
+                return;
+
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::BytesIn, size);
+
+            if(conn.m_first_byte_at == Metrics::TimePoint())
+            {
+                conn.m_first_byte_at = Metrics::now();
+                Metrics::record(MetricScope::AsyncServer, MetricStage::FirstByte, conn.m_first_byte_at - conn.m_read_started_at);
+            }
+
+            while(size > 0)
+            {
+                asio::mutable_buffer space = conn.m_request.prepare();
+                std::size_t n = std::min(space.size(), size);
+
+                std::memcpy(space.data(), data, n);
+                conn.m_request.commit(n);
+                data += n;
+                size -= n;
+
+                if(!processRequests(conn))
+                {
+                    close(conn);
+                    return;
+                }
+
+                if(!m_options.keep_alive && !conn.m_pending.empty())
+                {
+                    conn.m_answered = true;
+                    break;
+                }
+            }
+
+            if(!conn.m_pending.empty() && !conn.m_sending)
+            {
+                armDeadline(conn, m_options.write_timeout);
+                startSend(conn);
+            }
+            else if(!conn.m_sending)
+            {
+                armReadDeadline(conn);
+            }
+        }
+
+        /*
+         * Runs the handler over every complete request in the buffer.
+         *
+         * @return: false on a malformed or oversized frame.
+         */
+        bool processRequests(Connection &conn)
+        {
+            system::error_code ec;
+            std::string_view request;
+
+            while(conn.m_request.nextFrame(request, ec))
+            {
+                if(conn.m_first_byte_at != Metrics::TimePoint())
+                {
+                    Metrics::recordSince(MetricScope::AsyncServer, MetricStage::ReadComplete, conn.m_first_byte_at);
+                    conn.m_first_byte_at = Metrics::TimePoint();
+                }
+
+                Metrics::TimePoint started = Metrics::now();
+
+                std::size_t frame = beginFrame(m_options.framing, conn.m_pending);
+                m_handler(request, conn.m_pending);
+                endFrame(m_options.framing, conn.m_pending, frame);
+
+                Metrics::recordSince(MetricScope::AsyncServer, MetricStage::Process, started);
+
+                if(!m_options.keep_alive)
+                    break;
+            }
+
+            if(ec)
+            {
+                Logger::error("Error code in UringAcceptor ! Error code = ", ec.value(),
+                        ". Message: ", ec.message());
+                return false;
+            }
+
+            return true;
+        }
+
+        /* Sends every queued response in one go. */
+        void startSend(Connection &conn)
+        {
+            conn.m_response.swap(conn.m_pending);
+            conn.m_pending.clear();
+            conn.m_sent = 0;
+            conn.m_write_started_at = Metrics::now();
+
+            sendRest(conn);
+        }
+
+        void onSend(Connection &conn, const io_uring_cqe &cqe)
+        {
+            conn.m_sending = false;
+
+            if(cqe.res < 0)
+            {
+                if(!conn.m_closing && cqe.res != -EPIPE && cqe.res != -ECONNRESET)
+                {
+                    Logger::error("Error code! Error code = ", -cqe.res,
+                            ". Message: ", std::strerror(-cqe.res));
+                }
+
+                close(conn);
+                finishIfDone(conn);
+                return;
+            }
+
+            conn.m_sent += static_cast<std::size_t>(cqe.res);
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::BytesOut, cqe.res);
+
+            if(conn.m_closing)
+            {
+                finishIfDone(conn);
+                return;
+            }
+
+            if(conn.m_sent < conn.m_response.size())
+            {
+                sendRest(conn);
+                return;
+            }
+
+            Metrics::recordSince(MetricScope::AsyncServer, MetricStage::WriteComplete, conn.m_write_started_at);
+
+            if(!conn.m_pending.empty())
+            {
+                armDeadline(conn, m_options.write_timeout);
+                startSend(conn);
+                return;
+            }
+
+            if(!m_options.keep_alive)
+            {
+                close(conn);
+                finishIfDone(conn);
+                return;
+            }
+
+            conn.m_read_started_at = Metrics::now();
+            armReadDeadline(conn);
+        }
+
+        /* Closes connections past their deadline and admits held clients into freed slots. */
+        void onTick()
+        {
+            if(m_isStopped.load())
+                return;
+
+            armTick();
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+            // walk backwards, finishing a connection moves the last one into its place
+            for(std::size_t i = m_connections.size(); i-- > 0;)
+            {
+                Connection &conn = *m_connections[i];
+
+                if(!conn.m_closing && conn.m_deadline_at <= now)
+                {
+                    close(conn);
+                    finishIfDone(conn);
+                }
+            }
 
-        void onRequestRecieved(const boost::system::error_code &ec, std::size_t bytes_transferred)
-        {
-            if(ec.value() != 0)
+            while(!m_held.empty() && m_admission.acquire())
             {
-                std::cout << "Error code in Service class ! Error code = " << ec.value()
-                    << ". Message: " << ec.message() << std::endl;
+                admit(m_held.back());
+                m_held.pop_back();
+            }
 
-                onFinish();
+            if(m_held.empty() && !m_accepting)
+                armAccept();
+        }
+
+        /* Shuts the socket down; pending operations complete and finishIfDone frees the connection. */
+        void close(Connection &conn)
+        {
+            if(conn.m_closing)
                 return;
-            }
 
-            // process request
-            m_response = processRequest(m_request);
+            conn.m_closing = true;
+            ::shutdown(conn.m_fd, SHUT_RDWR);
+        }
 
-            //write operation
-            asio::async_write(*m_sock.get(), asio::buffer(m_response),
-                    [this](const system::error_code &ec, std::size_t bytes_transferred)
-                    {
-                        if(ec.value() != 0)
-                        {
-                            std::cout << "Error code! Error code = " << ec.value()
-                                << ". Message: " << ec.message() << std::endl;
-                        }
-                    });
+        /* Frees a closing connection once no operation refers to it any more. */
+        void finishIfDone(Connection &conn)
+        {
+            if(!conn.m_closing || conn.m_receiving || conn.m_sending)
+                return;
+
+            ::close(conn.m_fd);
+
+            std::size_t index = conn.m_index;
+            if(index + 1 != m_connections.size())
+            {
+                std::swap(m_connections[index], m_connections.back());
+                m_connections[index]->m_index = index;
+            }
+            m_connections.pop_back();
+
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::ActiveSessions, -1);
+            m_admission.release();
         }
 
-        void onResponseSent(const boost::system::error_code &ec, std::size_t bytes_transferred)
+        /* Drops every connection and held client, the ring's close cancels their operations. */
+        void shutdownAll()
         {
-            if(ec.value() != 0)
+            for(std::unique_ptr<Connection> &conn: m_connections)
+            {
+                ::close(conn->m_fd);
+
+                Metrics::add(MetricScope::AsyncServer, MetricGauge::ActiveSessions, -1);
+                m_admission.release();
+            }
+            m_connections.clear();
+
+            for(int fd: m_held)
             {
-                std::cout << "Error code! Error code = " << ec.value()
-                    << ". Message: " << ec.message() << std::endl;
+                ::close(fd);
+                m_admission.release();
             }
+            m_held.clear();
 
-            onFinish();
+            m_buffers.reset();
+            m_ring.reset();
         }
 
-        std::string processRequest(asio::streambuf &request)
+    public:
+
+        /*
+         * Constructor, binds and listens so that address errors reach the caller.
+         *
+         * @throws: system::system_error if the listening socket cannot be set up.
+         */
+        UringAcceptor(unsigned short port_num, Handler &handler, AdmissionControl &admission, const ServerOptions &options)
+            :m_listener(-1),
+            m_handler(handler),
+            m_admission(admission),
+            m_options(options),
+            m_isStopped(false),
+            m_multishot_recv(true),
+            m_accepting(false)
         {
-            // parse request and process it
-            // emulate operations that block the thread
-            std::istream is(&request);
-            std::string msg;
+            std::chrono::nanoseconds tick = options.timer_tick;
+            m_tick.tv_sec = tick.count() / 1000000000;
+            m_tick.tv_nsec = tick.count() % 1000000000;
+
+            encodeFrame(m_options.framing, m_options.reject_response, m_reject);
+
+            m_listener = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if(m_listener < 0)
+                throwErrno();
 
-            std::getline(is, msg);
-            std::cout << msg << std::endl;
+            int on = 1;
+            sockaddr_in addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_ANY);
+            addr.sin_port = htons(port_num);
 
-            std::string response{"Hello Client\n"};
-            return response;
+            tuneListener(m_listener, m_options.tuning);
+
+            if(::setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+                    || ::setsockopt(m_listener, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0
+                    || ::bind(m_listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+                    || ::listen(m_listener, m_options.tuning.backlog) != 0)
+            {
+                int err = errno;
+                ::close(m_listener);
+                throw system::system_error(system::error_code(err, system::system_category()));
+            }
         }
 
-        void onFinish()
+        ~UringAcceptor()
         {
-            delete this;
+            if(m_listener >= 0)
+                ::close(m_listener);
         }
 
-    public:
+        /* Event loop, returns within a timer_tick of stop(). */
+        void run()
+        {
+            try
+            {
+                m_ring.reset(new IoUring(RING_ENTRIES));
+                m_buffers.reset(new ProvidedBuffers(*m_ring, BUFFER_GROUP, BUFFER_COUNT, BUFFER_SIZE));
+            }
+            catch(system::system_error &ec)
+            {
+                Logger::error("Error occured! Error code = ", ec.code().value(),
+                        ". Message: ", ec.what());
 
-        Service(std::shared_ptr<asio::ip::tcp::socket> sock)
-            :m_sock(sock)
-        {}
+                m_ring.reset();
+                return;
+            }
 
-        void startHandling()
+            armAccept();
+            armTick();
+
+            while(!m_isStopped.load())
+            {
+                int ret = m_ring->submit(1);
+                if(ret < 0 && ret != -EINTR && ret != -EBUSY)
+                {
+                    Logger::error("Error occured! Error code = ", -ret,
+                            ". Message: ", std::strerror(-ret));
+                    break;
+                }
+
+                m_ring->completions([this](const io_uring_cqe &cqe) { onCompletion(cqe); });
+            }
+
+            shutdownAll();
+        }
+
+        void stop()
         {
-            // read from Client
-            asio::async_read_until(*m_sock.get(), m_request, '\n',
-                    [this](const system::error_code &ec, std::size_t bytes_transferred)
-                    {
-                        onRequestRecieved(ec, bytes_transferred);
-                    });
+            m_isStopped.store(true);
         }
 };
 
-class Acceptor
+#endif // NET_HAS_IO_URING
+
+#ifdef NET_HAS_SHM
+
+/*
+ * Serves one shared memory client (see shmring.hpp). Once the handshake arrived on the control
+ * socket, requests are taken straight from the request ring, the handler gets each as a view
+ * into it, and its response is pushed onto the response ring; the client's doorbell is only rung
+ * when it sleeps. When the response ring is full the request stays in place until the client
+ * makes room, so a slow client throttles itself.
+ *
+ * The control socket carries nothing after the handshake, it is read only to learn that the
+ * client left. The handshake must arrive within read_timeout, a client that connects and sends
+ * nothing would otherwise hold its admission slot for good. An attached session has no
+ * deadlines: an idle one holds no thread and no buffer.
+ *
+ * Stage latencies, active sessions and bytes in and out are recorded under MetricScope::AsyncServer.
+ */
+template <typename Handler>
+class ShmService : public std::enable_shared_from_this<ShmService<Handler>>
 {
     private:
-        asio::io_service &m_ios;
-        asio::ip::tcp::acceptor m_acceptor;
-        std::atomic<bool> m_isStopped;
+        using std::enable_shared_from_this<ShmService<Handler>>::shared_from_this;
+        using std::enable_shared_from_this<ShmService<Handler>>::weak_from_this;
 
-        void InitAccept()
+        static constexpr std::size_t BATCH{64};          // records served before other work gets a turn
+
+        asio::strand<asio::io_service::executor_type> m_strand;
+        TimerWheel &m_wheel;
+        TimerId m_deadline;                              // handshake deadline, cancelled once attached
+        StreamSocket m_control;
+        asio::posix::stream_descriptor m_doorbell;       // rung by the client
+        int m_client_bell;
+        ShmSegment m_segment;
+        Handler &m_handler;
+        AdmissionControl &m_admission;
+        std::uint64_t m_rung;                            // doorbell counter, read to re-arm it
+        char m_probe;
+        std::string m_response;
+        bool m_blocked;                                  // m_response waits for room in the response ring
+        bool m_attached;
+
+        void awaitHandshake()
+        {
+            m_control.async_wait(StreamSocket::wait_read, asio::bind_executor(m_strand, makeRecyclingHandler(
+                    [self = shared_from_this()](const system::error_code &ec)
+                    {
+                        if(ec)
+                        {
+                            self->close(ec);
+                            return;
+                        }
+
+                        self->onHandshake();
+                    })));
+        }
+
+        void onHandshake()
+        {
+            int fds[SHM_HANDSHAKE_FDS];
+            system::error_code ec;
+
+            receiveShmHandshake(m_control.native_handle(), fds, ec);
+            if(ec == asio::error::would_block)
+            {
+                awaitHandshake();
+                return;
+            }
+
+            if(ec)
+            {
+                close(ec);
+                return;
+            }
+
+            m_segment.attach(fds[0], ec);
+            ::close(fds[0]);
+            m_client_bell = fds[1];
+
+            if(!ec)
+                m_doorbell.assign(fds[2], ec);
+
+            if(ec)
+            {
+                ::close(fds[2]);
+                close(ec);
+                return;
+            }
+
+            m_attached = true;
+            m_wheel.cancel(m_deadline);
+            Metrics::add(MetricScope::AsyncServer, MetricGauge::ActiveSessions, 1);
+
+            watchControl();
+            serve();
+        }
+
+        /* Wheel callback, runs on the wheel's thread; hops onto the strand. */
+        static void onDeadline(const std::shared_ptr<void> &owner)
+        {
+            std::shared_ptr<ShmService> self = std::static_pointer_cast<ShmService>(owner);
+
+            asio::post(self->m_strand, makeRecyclingHandler([self]()
+                    {
+                        if(self->m_attached)
+                            return;
+
+                        Logger::warn("Shared memory client sent no handshake in time, closing");
+                        self->close(asio::error::operation_aborted);
+                    }));
+        }
+
+        /* Any byte or the end of the control socket ends the session. */
+        void watchControl()
         {
-            std::shared_ptr<asio::ip::tcp::socket> sock = std::make_shared<asio::ip::tcp::socket>(asio::ip::tcp::socket(m_ios));
+            m_control.async_read_some(asio::buffer(&m_probe, 1), asio::bind_executor(m_strand, makeRecyclingHandler(
+                    [self = shared_from_this()](const system::error_code &ec, std::size_t)
+                    {
+                        self->close(ec ? ec : asio::error::invalid_argument);
+                    })));
+        }
 
-            m_acceptor.async_accept(*sock.get(),
-                    [this, sock](const system::error_code &ec)
+        void awaitDoorbell()
+        {
+            m_doorbell.async_read_some(asio::buffer(&m_rung, sizeof(m_rung)), asio::bind_executor(m_strand,
+                    makeRecyclingHandler(
+                    [self = shared_from_this()](const system::error_code &ec, std::size_t)
                     {
-                        onAccept(ec, sock);
-                    });
+                        if(ec)
+                        {
+                            self->close(ec);
+                            return;
+                        }
+
+                        self->serve();
+                    })));
         }
 
-        void onAccept(const system::error_code &ec, std::shared_ptr<asio::ip::tcp::socket> sock)
+        /* Answers up to BATCH queued requests, then waits for the client or yields to other work. */
+        void serve()
         {
-            if(ec.value() == 0)
+            if(!m_control.is_open())
+                return;
+
+            ShmRing &requests = m_segment.requests();
+            ShmRing &responses = m_segment.responses();
+
+            std::size_t served = 0;
+            std::uint32_t id;
+            std::string_view request;
+
+            while(served < BATCH && requests.front(id, request))
             {
-                (new Service(sock)) -> startHandling();
+                if(!m_blocked)
+                {
+                    Metrics::TimePoint started = Metrics::now();
+
+                    m_response.clear();
+                    m_handler(request, m_response);
+
+                    Metrics::recordSince(MetricScope::AsyncServer, MetricStage::Process, started);
+                    Metrics::add(MetricScope::AsyncServer, MetricGauge::BytesIn, request.size());
+                }
+
+                if(!responses.push(id, m_response))
+                {
+                    if(m_response.size() > responses.maxPayload())
+                    {
+                        Logger::error("Error in ShmService class ! Response of ", m_response.size(),
+                                " bytes does not fit the ring");
+                        close(asio::error::message_size);
+                        return;
+                    }
+
+                    // handled already, only the push is retried
+                    m_blocked = true;
+                    if(responses.prepareWaitForSpace(m_response.size()))
+                        break;
+
+                    continue;
+                }
+
+                m_blocked = false;
+                requests.pop();
+                ++served;
+
+                Metrics::add(MetricScope::AsyncServer, MetricGauge::BytesOut, m_response.size());
             }
-            else
+
+            if(served != 0)
             {
-                std::cout << "Error occured! Error code = " << ec.value()
-                    << ". Message: " << ec.message() << std::endl;
+                // one ring for either reason, the client drains responses and refills requests alike
+                bool wake = responses.wakeConsumer();
+                wake = requests.wakeProducer() || wake;
+
+                if(wake)
+                    ringDoorbell(m_client_bell);
             }
 
-            // Init next socket to accept, unless stopped
-            if(!m_isStopped.load())
+            if(!m_blocked && (served == BATCH || !requests.prepareWait()))
             {
-                InitAccept();
+                asio::post(m_strand, makeRecyclingHandler([self = shared_from_this()]()
+                        {
+                            self->serve();
+                        }));
+                return;
             }
-            else
+
+            awaitDoorbell();
+        }
+
+        void close(const system::error_code &ec)
+        {
+            if(ec && ec != asio::error::eof && ec != asio::error::operation_aborted)
             {
-                m_acceptor.close();
+                Logger::error("Error code in ShmService class ! Error code = ", ec.value(),
+                        ". Message: ", ec.message());
             }
+
+            m_wheel.cancel(m_deadline);
+
+            system::error_code ignored_ec;
+            m_control.close(ignored_ec);
+            m_doorbell.close(ignored_ec);
         }
 
     public:
 
-        Acceptor(asio::io_service &ios, unsigned short port_num):
-            m_ios(ios),
-            m_acceptor(m_ios, asio::ip::tcp::endpoint(asio::ip::address_v4::any(), port_num)),
+        ShmService(asio::io_service &ios, TimerWheel &wheel, StreamSocket control, Handler &handler,
+                   AdmissionControl &admission)
+            :m_strand(ios.get_executor()),
+            m_wheel(wheel),
+            m_control(std::move(control)),
+            m_doorbell(m_control.get_executor()),
+            m_client_bell(-1),
+            m_handler(handler),
+            m_admission(admission),
+            m_rung(0),
+            m_probe(0),
+            m_blocked(false),
+            m_attached(false)
+        {}
+
+        ~ShmService()
+        {
+            if(m_client_bell >= 0)
+                ::close(m_client_bell);
+
+            if(m_attached)
+                Metrics::add(MetricScope::AsyncServer, MetricGauge::ActiveSessions, -1);
+
+            m_admission.release();
+        }
+
+        void start(std::chrono::milliseconds handshake_timeout)
+        {
+            asio::dispatch(m_strand, makeRecyclingHandler([self = shared_from_this(), handshake_timeout]()
+                    {
+                        if(handshake_timeout.count() > 0)
+                            self->m_deadline = self->m_wheel.schedule(handshake_timeout, self->weak_from_this(),
+                                    &ShmService::onDeadline);
+
+                        self->awaitHandshake();
+                    }));
+        }
+};
+
+/*
+ * Accepts shared memory clients on a Unix domain socket, ServerOptions::shm_path, beside the
+ * server's TCP or local stream listener. Each accepted control socket is handed to a ShmService
+ * on the next io_service in turn, so sharded servers spread shared memory clients over shards.
+ * Each io_service comes with the TimerWheel its sessions' handshake deadlines go on.
+ */
+template <typename Handler>
+class ShmAcceptor
+{
+    private:
+        StreamAcceptor m_acceptor;
+        std::vector<asio::io_service *> m_services;      // sessions are spread over these
+        std::vector<TimerWheel *> m_wheels;              // one per io_service
+        std::chrono::milliseconds m_handshake_timeout;
+        std::size_t m_next;
+        Handler &m_handler;
+        AdmissionControl &m_admission;
+        std::atomic<bool> m_isStopped;
+
+        void acceptNext()
+        {
+            if(m_isStopped.load())
+                return;
+
+            std::size_t next = m_next++ % m_services.size();
+            asio::io_service &ios = *m_services[next];
+            TimerWheel &wheel = *m_wheels[next];
+
+            m_acceptor.async_accept(ios, makeRecyclingHandler(
+                    [this, &ios, &wheel](const system::error_code &ec, auto sock)
+                    {
+                        if(ec)
+                        {
+                            if(ec != asio::error::operation_aborted)
+                            {
+                                Logger::error("Error occured! Error code = ", ec.value(),
+                                        ". Message: ", ec.message());
+                            }
+                        }
+                        else if(m_admission.acquire())
+                        {
+                            std::allocate_shared<ShmService<Handler>>(RecyclingAllocator<ShmService<Handler>>(),
+                                    ios, wheel, StreamSocket(std::move(sock)), m_handler, m_admission)
+                                -> start(m_handshake_timeout);
+                        }
+                        else
+                        {
+                            system::error_code ignored_ec;
+                            sock.close(ignored_ec);
+
+                            m_admission.reject();
+                            Metrics::add(MetricScope::AsyncServer, MetricGauge::Rejected, 1);
+                        }
+
+                        acceptNext();
+                    }));
+        }
+
+    public:
+
+        /*
+         * Constructor, binds and listens so that address errors reach the caller.
+         *
+         * @param: {std::vector<asio::io_service *>} services: io_services sessions run on, the first also accepts.
+         *         {std::vector<TimerWheel *>} wheels: wheel of each io_service, same order.
+         *         {std::chrono::milliseconds} handshake_timeout: a client must hand over its rings
+         *                                                        within this, zero disables.
+         *
+         * @throws: system::system_error if the socket cannot be set up.
+         */
+        ShmAcceptor(const std::vector<asio::io_service *> &services, const std::vector<TimerWheel *> &wheels,
+                    const std::string &path, Handler &handler, AdmissionControl &admission,
+                    const SocketTuning &tuning, std::chrono::milliseconds handshake_timeout)
+            :m_acceptor(*services.front()),
+            m_services(services),
+            m_wheels(wheels),
+            m_handshake_timeout(handshake_timeout),
+            m_next(0),
+            m_handler(handler),
+            m_admission(admission),
             m_isStopped(false)
-    {}
+        {
+            openListener(m_acceptor, localEndpoint(path), tuning);
+            m_acceptor.listen(tuning.backlog);
+        }
 
         void start()
         {
-            m_acceptor.listen(30);
-            InitAccept();
+            acceptNext();
         }
 
         void stop()
         {
             m_isStopped.store(true);
+            removeListenerFile(m_acceptor);
         }
 };
 
-class AsyncTCPServer
+#endif // NET_HAS_SHM
+
+/* Pins calling thread to given core, best effort. */
+inline void pinToCore(unsigned int core)
+{
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core % std::thread::hardware_concurrency(), &cpuset);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+#else
+    (void)core;
+#endif
+}
+
+/*
+ * Asynchronous TCP server, runs either a shared thread pool over one io_service or one
+ * io_service per thread (see ThreadingMode), or, with IoBackend::IoUring, one io_uring per
+ * thread (see UringAcceptor). All stay available so they can be benchmarked against each other.
+ *
+ * Every request is answered by Handler (see requesthandler.hpp), bound at compile time;
+ * AsyncTCPServer answers with HelloHandler. With ServerOptions::shm_path the same handler also
+ * answers clients on the host over shared memory rings (see ShmService).
+ */
+template <typename Handler>
+class BasicAsyncTCPServer
 {
     private:
+        static_assert(IsRequestHandler<Handler>::value,
+                      "Handler must be callable as void(std::string_view request, std::string &response)");
+
+        /* Independent event loop, owned by a single thread in sharded mode. */
+        struct Shard
+        {
+            asio::io_service m_ios;
+            std::unique_ptr<asio::io_service::work> m_work;
+            TimerWheel m_wheel;
+            std::unique_ptr<Acceptor<Handler>> m_acc;
+
+            Shard(std::chrono::milliseconds tick)
+                :m_work(new asio::io_service::work(m_ios)),
+                m_wheel(m_ios, tick)
+            {}
+        };
+
+        Handler m_handler;                               // shared by every thread, outlives the sessions
+        std::unique_ptr<AdmissionControl> m_admission;   // outlives the io_services, their sessions release into it
+        std::unique_ptr<Broadcaster> m_broadcaster;      // likewise, sessions unsubscribe from it
         asio::io_service m_ios;
         std::unique_ptr<asio::io_service::work> m_work;
-        std::unique_ptr<Acceptor> acc;
+        std::unique_ptr<TimerWheel> m_wheel;
+        std::unique_ptr<Acceptor<Handler>> acc;
+        std::vector<std::unique_ptr<Shard>> m_shards;
+#ifdef NET_HAS_IO_URING
+        std::vector<std::unique_ptr<UringAcceptor<Handler>>> m_urings;
+#endif
+#ifdef NET_HAS_SHM
+        std::unique_ptr<ShmAcceptor<Handler>> m_shm;     // after the io_services, its socket is closed before they go
+#endif
         std::vector<std::unique_ptr<std::thread>> m_thread_pool;
+        std::unique_ptr<asio::thread_pool> m_compute;   // declared last, pending work is dropped before the io_services go
+
+        void startSharded(unsigned short port_num, unsigned int shards, const ServerOptions &options)
+        {
+            ServerOptions shard_options = options;
+            shard_options.reuse_port = true;
+
+            for(unsigned int i{0}; i < shards; ++i)
+            {
+                std::unique_ptr<Shard> shard(new Shard(options.timer_tick));
+                shard->m_acc.reset(new Acceptor<Handler>(shard->m_ios, port_num, shard->m_wheel, m_handler,
+                            *m_admission, m_compute.get(), m_broadcaster.get(), shard_options));
+                shard->m_acc->start();
+                shard->m_wheel.start();
+
+                m_shards.push_back(std::move(shard));
+            }
+
+            for(unsigned int i{0}; i < shards; ++i)
+            {
+                Shard *shard = m_shards[i].get();
+                bool pin = options.pin_threads;
+
+                std::unique_ptr<std::thread> process(new std::thread([shard, pin, i]()
+                            {
+                                if(pin)
+                                    pinToCore(i);
+
+                                shard->m_ios.run();
+                            }));
+
+                m_thread_pool.push_back(std::move(process));
+            }
+        }
+
+        /*
+         * One UringAcceptor and thread per shard.
+         *
+         * @return: false, leaving the reactor to serve, if io_uring is not available or the
+         *          options ask for something only the reactor implements.
+         */
+        bool startUring(unsigned short port_num, unsigned int shards, const ServerOptions &options)
+        {
+#ifdef NET_HAS_IO_URING
+            if(options.compute_threads > 0 || options.multiplexed || options.broadcast)
+            {
+                Logger::warn("io_uring backend has no compute pool, multiplexing or broadcast, using the reactor");
+                return false;
+            }
+
+            if(!IoUring::supported())
+            {
+                Logger::warn("io_uring not supported by this kernel, using the reactor");
+                return false;
+            }
+
+            for(unsigned int i{0}; i < shards; ++i)
+                m_urings.push_back(std::make_unique<UringAcceptor<Handler>>(port_num, m_handler, *m_admission, options));
+
+            for(unsigned int i{0}; i < shards; ++i)
+            {
+                UringAcceptor<Handler> *uring = m_urings[i].get();
+                bool pin = options.pin_threads;
+
+                std::unique_ptr<std::thread> process(new std::thread([uring, pin, i]()
+                            {
+                                if(pin)
+                                    pinToCore(i);
+
+                                uring->run();
+                            }));
+
+                m_thread_pool.push_back(std::move(process));
+            }
+
+            return true;
+#else
+            (void)port_num;
+            (void)shards;
+            (void)options;
+
+            Logger::warn("built without io_uring, using the reactor");
+            return false;
+#endif
+        }
+
+        /*
+         * Shared memory listener, if options ask for one, with its sessions spread over services,
+         * each handshake under read_timeout on the wheel of its service.
+         */
+        void startShm(const ServerOptions &options, const std::vector<asio::io_service *> &services,
+                      const std::vector<TimerWheel *> &wheels)
+        {
+            if(options.shm_path.empty())
+                return;
+
+#ifdef NET_HAS_SHM
+            m_shm.reset(new ShmAcceptor<Handler>(services, wheels, options.shm_path, m_handler, *m_admission,
+                        options.tuning, options.read_timeout));
+            m_shm->start();
+#else
+            (void)services;
+            (void)wheels;
+
+            Logger::warn("built without shared memory support, shm_path ignored");
+#endif
+        }
 
     public:
 
-        AsyncTCPServer()
+        /* Constructor, handler answers every request of every connection. */
+        explicit BasicAsyncTCPServer(Handler handler = Handler())
+            :m_handler(std::move(handler))
         {
             m_work.reset(new asio::io_service::work(m_ios));
         }
 
-        void start(unsigned short port_num, unsigned int thread_pool_size)
+        void start(unsigned short port_num, unsigned int thread_pool_size,
+                   ServerOptions options = ServerOptions())
         {
             // make sure thread pool size is greater then 0
             if(thread_pool_size == 0 || thread_pool_size > 2 * std::thread::hardware_concurrency())
                 thread_pool_size = 2;
 
-            acc.reset(new Acceptor(m_ios, port_num));
+            m_admission.reset(new AdmissionControl(options.max_sessions));
+
+            if(options.multiplexed)
+            {
+                options.keep_alive = true;
+                options.framing = Framing::LengthPrefixed;
+            }
+
+            if(options.broadcast && options.multiplexed)
+            {
+                Logger::warn("published messages carry no request id, broadcast is off for multiplexed servers");
+                options.broadcast = false;
+            }
+
+            if(options.broadcast)
+            {
+                options.keep_alive = true;
+                m_broadcaster.reset(new Broadcaster(options.framing));
+            }
+
+            // a socket path takes a single listener, neither SO_REUSEPORT shards nor the io_uring acceptor
+            if(!options.local_path.empty()
+                    && (options.threading == ThreadingMode::Sharded || options.backend == IoBackend::IoUring))
+            {
+                Logger::warn("Unix domain socket listens on a single acceptor, using the shared pool on the reactor");
+                options.threading = ThreadingMode::SharedPool;
+                options.backend = IoBackend::Reactor;
+            }
+
+            if(options.backend == IoBackend::IoUring && startUring(port_num, thread_pool_size, options))
+            {
+                if(!options.shm_path.empty())
+                    Logger::warn("shared memory clients are served by the reactor only, shm_path ignored");
+
+                return;
+            }
+
+            if(options.compute_threads > 0)
+                m_compute.reset(new asio::thread_pool(options.compute_threads));
+
+            if(options.threading == ThreadingMode::Sharded)
+            {
+                startSharded(port_num, thread_pool_size, options);
+
+                std::vector<asio::io_service *> services;
+                std::vector<TimerWheel *> wheels;
+                for(auto &shard: m_shards)
+                {
+                    services.push_back(&shard->m_ios);
+                    wheels.push_back(&shard->m_wheel);
+                }
+
+                startShm(options, services, wheels);
+                return;
+            }
+
+            m_wheel.reset(new TimerWheel(m_ios, options.timer_tick, thread_pool_size));
+            acc.reset(new Acceptor<Handler>(m_ios, port_num, *m_wheel, m_handler, *m_admission, m_compute.get(),
+                        m_broadcaster.get(), options));
             acc->start();
+            m_wheel->start();
+            startShm(options, {&m_ios}, {m_wheel.get()});
 
             for(unsigned int i{0}; i < thread_pool_size; ++i)
             {
@@ -190,14 +2316,65 @@ class AsyncTCPServer
 
         void stop()
         {
-            acc->stop();
+#ifdef NET_HAS_SHM
+            if(m_shm)
+                m_shm->stop();
+#endif
+            if(acc)
+                acc->stop();
+            if(m_wheel)
+                m_wheel->stop();
             m_ios.stop();
 
+            for(auto &shard: m_shards)
+            {
+                shard->m_acc->stop();
+                shard->m_wheel.stop();
+                shard->m_ios.stop();
+            }
+
+#ifdef NET_HAS_IO_URING
+            for(auto &uring: m_urings)
+                uring->stop();
+#endif
+
             for(auto &process: m_thread_pool)
             {
                 process->join();
             }
+
+            if(m_compute)
+            {
+                m_compute->stop();
+                m_compute->join();
+            }
+        }
+
+        /*
+         * Sends message to every subscribed connection, ServerOptions::broadcast. It is framed
+         * once and each subscriber queues the same buffer, any thread may publish.
+         *
+         * @return: number of subscribers it was queued to, zero without broadcast.
+         */
+        std::size_t publish(std::string_view message)
+        {
+            return m_broadcaster ? m_broadcaster->publish(message) : 0;
+        }
+
+        /* Connections currently subscribed. */
+        std::size_t subscribers() const
+        {
+            return m_broadcaster ? m_broadcaster->subscribers() : 0;
+        }
+
+        /* Connections turned away because max_sessions was reached. */
+        std::size_t rejected() const
+        {
+            return m_admission ? m_admission->rejected() : 0;
         }
 };
 
+/* The server answering every request with "Hello Client". */
+typedef BasicAsyncTCPServer<HelloHandler> AsyncTCPServer;
+
 #endif // !ASYNC_TCPSERVER
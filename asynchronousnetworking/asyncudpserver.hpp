@@ -0,0 +1,286 @@
+#ifndef ASYNC_UDPSERVER
+#define ASYNC_UDPSERVER
+
+#include <boost/asio.hpp>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "asynctcpserver.hpp"
+#include "../common/datagram.hpp"
+
+using namespace boost;
+
+/*
+ * UDP server settings. A datagram is a whole request, there is no framing, connection or
+ * deadline; replies go back to the sender as one datagram each.
+ */
+struct UdpServerOptions
+{
+    ThreadingMode threading{ThreadingMode::SharedPool};
+    bool reuse_port{false};                              // set SO_REUSEPORT on the socket, forced on when sharded
+    bool pin_threads{true};                              // sharded only, pin each shard thread to its own core
+    std::size_t batch{64};                               // datagrams taken per receive system call and replies per send
+    std::size_t max_datagram{2048};                      // longer datagrams are truncated and dropped
+    bool reply{true};                                    // answer every datagram, off for fire and forget traffic (the handler's response is discarded)
+    SocketTuning tuning;                                 // buffers and busy polling of every socket
+};
+
+/*
+ * Serves one UDP socket. Whenever the socket turns readable it takes every queued datagram, a
+ * batch per recvmmsg, runs the handler over each and sends all replies of the batch with one
+ * sendmmsg. Only one batch of a socket is in flight at a time, so no strand or lock is needed
+ * even when several threads run its io_service.
+ *
+ * Replies the socket buffer cannot take are dropped, as the network would; clients retry.
+ *
+ * Stage latencies and bytes in and out are recorded under MetricScope::UdpServer.
+ */
+template <typename Handler>
+class DatagramService : public asio::noncopyable
+{
+    private:
+        asio::ip::udp::socket m_sock;
+        UdpServerOptions m_options;
+        Handler &m_handler;
+        DatagramBatch m_batch;
+        DatagramQueue m_replies;
+        std::string m_discarded;                         // response of a request that gets no reply, reused
+
+        /* Waits for the socket to turn readable, without reading. */
+        void waitReadable()
+        {
+            m_sock.async_wait(asio::ip::udp::socket::wait_read, makeRecyclingHandler(
+                    [this](const system::error_code &ec)
+                    {
+                        if(ec)
+                        {
+                            if(ec != asio::error::operation_aborted)
+                            {
+                                Logger::error("Error code in DatagramService class ! Error code = ", ec.value(),
+                                        ". Message: ", ec.message());
+                            }
+
+                            return;
+                        }
+
+                        drain();
+                    }));
+        }
+
+        /*
+         * Serves one batch. A full batch likely left more queued, the next one is posted so other
+         * work on the io_service gets a turn; otherwise the socket is drained and the next readiness
+         * is awaited.
+         */
+        void drain()
+        {
+            system::error_code ec;
+            Metrics::TimePoint started = Metrics::now();
+
+            std::size_t received = m_batch.receive(m_sock.native_handle(), false, ec);
+            if(ec)
+            {
+                if(ec != asio::error::would_block)
+                {
+                    Logger::error("Error code in DatagramService class ! Error code = ", ec.value(),
+                            ". Message: ", ec.message());
+                }
+
+                waitReadable();
+                return;
+            }
+
+            Metrics::recordSince(MetricScope::UdpServer, MetricStage::ReadComplete, started);
+
+            for(std::size_t i = 0; i < received; ++i)
+            {
+                std::string_view request = m_batch.data(i);
+                Metrics::add(MetricScope::UdpServer, MetricGauge::BytesIn, request.size());
+
+                if(m_batch.truncated(i))
+                {
+                    Logger::error("Error in DatagramService class ! Datagram over ", m_options.max_datagram,
+                            " bytes dropped");
+                    continue;
+                }
+
+                started = Metrics::now();
+
+                if(m_options.reply)
+                {
+                    m_handler(request, m_replies.push(m_batch.peer(i), m_batch.peerSize(i)));
+                }
+                else
+                {
+                    m_discarded.clear();
+                    m_handler(request, m_discarded);
+                }
+
+                Metrics::recordSince(MetricScope::UdpServer, MetricStage::Process, started);
+            }
+
+            if(m_replies.size() != 0)
+                sendReplies();
+
+            if(received == m_batch.capacity())
+                asio::post(m_sock.get_executor(), makeRecyclingHandler([this]() { drain(); }));
+            else
+                waitReadable();
+        }
+
+        /* Sends the batch's replies, whatever does not fit the socket buffer is dropped. */
+        void sendReplies()
+        {
+            Metrics::TimePoint started = Metrics::now();
+            system::error_code ec;
+
+            std::size_t queued = m_replies.bytes();
+            m_replies.send(m_sock.native_handle(), false, ec);
+
+            if(ec && ec != asio::error::would_block)
+            {
+                Logger::error("Error code in DatagramService class ! Error code = ", ec.value(),
+                        ". Message: ", ec.message());
+            }
+
+            Metrics::add(MetricScope::UdpServer, MetricGauge::BytesOut, queued - m_replies.bytes());
+            Metrics::recordSince(MetricScope::UdpServer, MetricStage::WriteComplete, started);
+
+            m_replies.clear();
+        }
+
+    public:
+
+        /* Constructor, opens and binds socket to port on any ip4 address of the host. */
+        DatagramService(asio::io_service &ios, unsigned short port_num, Handler &handler,
+                        const UdpServerOptions &options)
+            :m_sock(ios),
+            m_options(options),
+            m_handler(handler),
+            m_batch(options.batch ? options.batch : 1, options.max_datagram)
+        {
+            asio::ip::udp::endpoint ep(asio::ip::address_v4::any(), port_num);
+
+            m_sock.open(ep.protocol());
+            m_sock.set_option(asio::ip::udp::socket::reuse_address(true));
+
+            if(m_options.reuse_port)
+                m_sock.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+
+            tuneDatagram(m_sock, m_options.tuning);
+            m_sock.bind(ep);
+            m_sock.non_blocking(true);
+        }
+
+        void start()
+        {
+            waitReadable();
+        }
+
+        /* Cancels the pending wait, call from a thread running the socket's io_service or once it stopped. */
+        void stop()
+        {
+            system::error_code ignored_ec;
+            m_sock.close(ignored_ec);
+        }
+};
+
+/*
+ * Asynchronous UDP server, the datagram counterpart of AsyncTCPServer for small fire and forget
+ * messages where connection setup and stream framing are pure overhead. Runs a shared thread
+ * pool over one socket, or one socket, io_service and thread per shard with SO_REUSEPORT so the
+ * kernel spreads senders over the shards (see ThreadingMode).
+ *
+ * A single socket serves one batch at a time, more threads on a shared pool only help when the
+ * handler blocks; shard to scale over cores.
+ *
+ * Every datagram is answered by Handler (see requesthandler.hpp), bound at compile time, the
+ * same handlers the TCP servers take; AsyncUDPServer answers with HelloHandler.
+ */
+template <typename Handler>
+class BasicAsyncUDPServer
+{
+    private:
+        static_assert(IsRequestHandler<Handler>::value,
+                      "Handler must be callable as void(std::string_view request, std::string &response)");
+
+        /* Independent event loop, owned by a single thread in sharded mode. */
+        struct Shard
+        {
+            asio::io_service m_ios;
+            std::unique_ptr<DatagramService<Handler>> m_service;
+        };
+
+        Handler m_handler;                               // shared by every shard and thread
+        std::vector<std::unique_ptr<Shard>> m_shards;
+        std::vector<std::unique_ptr<std::thread>> m_thread_pool;
+
+    public:
+
+        /* Constructor, handler answers every datagram of every shard. */
+        explicit BasicAsyncUDPServer(Handler handler = Handler())
+            :m_handler(std::move(handler))
+        {}
+
+        void start(unsigned short port_num, unsigned int thread_pool_size,
+                   UdpServerOptions options = UdpServerOptions())
+        {
+            // make sure thread pool size is greater then 0
+            if(thread_pool_size == 0 || thread_pool_size > 2 * std::thread::hardware_concurrency())
+                thread_pool_size = 2;
+
+            bool sharded = options.threading == ThreadingMode::Sharded;
+            unsigned int shards = sharded ? thread_pool_size : 1;
+
+            if(sharded)
+                options.reuse_port = true;
+
+            for(unsigned int i{0}; i < shards; ++i)
+            {
+                std::unique_ptr<Shard> shard(new Shard());
+                shard->m_service.reset(new DatagramService<Handler>(shard->m_ios, port_num, m_handler, options));
+                shard->m_service->start();
+
+                m_shards.push_back(std::move(shard));
+            }
+
+            for(unsigned int i{0}; i < thread_pool_size; ++i)
+            {
+                Shard *shard = m_shards[sharded ? i : 0].get();
+                bool pin = sharded && options.pin_threads;
+
+                std::unique_ptr<std::thread> process(new std::thread([shard, pin, i]()
+                            {
+                                if(pin)
+                                    pinToCore(i);
+
+                                shard->m_ios.run();
+                            }));
+
+                m_thread_pool.push_back(std::move(process));
+            }
+        }
+
+        void stop()
+        {
+            for(auto &shard: m_shards)
+                shard->m_ios.stop();
+
+            for(auto &process: m_thread_pool)
+            {
+                process->join();
+            }
+
+            for(auto &shard: m_shards)
+                shard->m_service->stop();
+        }
+};
+
+/* The server answering every datagram with "Hello Client". */
+typedef BasicAsyncUDPServer<HelloHandler> AsyncUDPServer;
+
+#endif // !ASYNC_UDPSERVER
@@ -0,0 +1,388 @@
+#ifndef COROUTINE_TCPCLIENT
+#define COROUTINE_TCPCLIENT
+
+#include <utility>                                       // asio/awaitable.hpp uses std::exchange without including it
+
+#include <boost/asio.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "asynctcpclient.hpp"
+
+#if !defined(BOOST_ASIO_HAS_CO_AWAIT)
+#error "coroutinetcpclient.hpp needs C++20 coroutines, build with -std=c++20"
+#endif
+
+using namespace boost;
+
+/*
+ * Coroutine TCP client, the awaitable counterpart of AsyncTCPClient: a request is
+ *
+ *     std::string response = co_await client.request(ep, "Hello Server");
+ *
+ * run from any coroutine spawned on client.get_executor(). Connections are pooled and stale
+ * pooled connections retried exactly as in AsyncTCPClient (ClientOptions::pool).
+ *
+ * request() is an asio composed operation: connect, write and read are steps of a RequestOp on
+ * one RequestState from the Recycler, and the awaiting coroutine suspends once for the whole
+ * request. asio's per-thread frame cache holds a single frame, so a coroutine per request nesting
+ * a frame per operation would miss it on every request; the one frame of the composed operation
+ * is served from it every time. Any other completion token works as well.
+ *
+ * Stage latencies, in-flight requests and bytes in and out are recorded under MetricScope::CoroutineClient.
+ */
+class CoroutineTCPClient : public asio::noncopyable {
+    private:
+        /*
+         * One request, on the heap so its socket stays put while the operation moves from step
+         * to step. With a timeout it is also the timer wheel owner, the deadline then cancels the
+         * socket from the wheel's thread under m_gaurd.
+         */
+        struct RequestState
+        {
+            StreamSocket m_sock;
+            StreamEndpoint m_ep;
+            std::string m_frame;
+            FrameBuffer m_buf;
+            std::string m_response;
+            bool m_reused;                      // socket came from the pool
+            bool m_first_byte;
+            Metrics::TimePoint m_started;       // start of the step in progress
+
+            std::mutex m_gaurd;                 // m_done, m_fired and socket operations
+            bool m_done{false};
+            bool m_fired{false};
+            TimerId m_deadline;
+
+            RequestState(const asio::io_service::executor_type &executor, const StreamEndpoint &ep,
+                         const ClientOptions &options):
+                m_sock(executor),
+                m_ep(ep),
+                m_buf(options.framing, options.max_frame_size, 512),
+                m_reused(false),
+                m_first_byte(false)
+            {}
+        };
+
+        /* Steps of request(), driven by asio::async_compose. */
+        struct RequestOp
+        {
+            enum class Step { Start, Connect, Write, Read };
+
+            CoroutineTCPClient &m_client;
+            std::shared_ptr<RequestState> m_state;
+            Step m_step;
+
+            template <typename Self>
+            void operator()(Self &self, system::error_code ec = system::error_code(), std::size_t n = 0)
+            {
+                RequestState &state = *m_state;
+
+                switch(m_step)
+                {
+                    case Step::Start:
+                        if(state.m_reused)
+                            write(self);
+                        else
+                            connect(self);
+                        return;
+
+                    case Step::Connect:
+                        if(ec)
+                        {
+                            finish(self, ec);
+                            return;
+                        }
+
+                        Metrics::recordSince(MetricScope::CoroutineClient, MetricStage::Accept, state.m_started);
+                        write(self);
+                        return;
+
+                    case Step::Write:
+                        if(ec)
+                        {
+                            retryOrFinish(self, ec);
+                            return;
+                        }
+
+                        Metrics::recordSince(MetricScope::CoroutineClient, MetricStage::WriteComplete, state.m_started);
+                        Metrics::add(MetricScope::CoroutineClient, MetricGauge::BytesOut, n);
+                        state.m_started = Metrics::now();
+                        state.m_first_byte = true;
+                        read(self);
+                        return;
+
+                    case Step::Read:
+                        onRead(self, ec, n);
+                        return;
+                }
+            }
+
+            template <typename Self>
+            void connect(Self &self)
+            {
+                RequestState &state = *m_state;
+                std::lock_guard<std::mutex> lock(state.m_gaurd);
+
+                m_step = Step::Connect;
+                if(state.m_fired)
+                {
+                    asio::post(state.m_sock.get_executor(), asio::detail::bind_handler(std::move(self),
+                                asio::error::operation_aborted, 0));
+                    return;
+                }
+
+                state.m_started = Metrics::now();
+
+                system::error_code ec;
+                state.m_sock.open(state.m_ep.protocol(), ec);
+                if(!ec)
+                    tuneConnection(state.m_sock, m_client.m_options.tuning, true);
+
+                state.m_sock.async_connect(state.m_ep, std::move(self));
+            }
+
+            template <typename Self>
+            void write(Self &self)
+            {
+                RequestState &state = *m_state;
+                std::lock_guard<std::mutex> lock(state.m_gaurd);
+
+                m_step = Step::Write;
+                if(state.m_fired)
+                {
+                    asio::post(state.m_sock.get_executor(), asio::detail::bind_handler(std::move(self),
+                                asio::error::operation_aborted, 0));
+                    return;
+                }
+
+                state.m_started = Metrics::now();
+                asio::async_write(state.m_sock, asio::buffer(state.m_frame), std::move(self));
+            }
+
+            template <typename Self>
+            void read(Self &self)
+            {
+                RequestState &state = *m_state;
+                std::lock_guard<std::mutex> lock(state.m_gaurd);
+
+                m_step = Step::Read;
+                if(state.m_fired)
+                {
+                    asio::post(state.m_sock.get_executor(), asio::detail::bind_handler(std::move(self),
+                                asio::error::operation_aborted, 0));
+                    return;
+                }
+
+                state.m_sock.async_read_some(state.m_buf.prepare(), std::move(self));
+            }
+
+            template <typename Self>
+            void onRead(Self &self, system::error_code ec, std::size_t n)
+            {
+                RequestState &state = *m_state;
+
+                if(ec)
+                {
+                    retryOrFinish(self, ec);
+                    return;
+                }
+
+                state.m_buf.commit(n);
+                Metrics::add(MetricScope::CoroutineClient, MetricGauge::BytesIn, n);
+
+                if(state.m_first_byte)
+                {
+                    state.m_first_byte = false;
+                    Metrics::recordSince(MetricScope::CoroutineClient, MetricStage::FirstByte, state.m_started);
+                    state.m_started = Metrics::now();
+                }
+
+                std::string_view view;
+                if(!state.m_buf.nextFrame(view, ec))
+                {
+                    // partial response, keep reading unless frame was too large
+                    if(ec)
+                        finish(self, ec);
+                    else
+                        read(self);
+
+                    return;
+                }
+
+                state.m_response.assign(view.data(), view.size());
+                Metrics::recordSince(MetricScope::CoroutineClient, MetricStage::ReadComplete, state.m_started);
+                finish(self, ec);
+            }
+
+            /*
+             * A pooled connection the server closed meanwhile is retried once on a fresh one: a
+             * failed write, or the connection ending before any byte of the response. Once the
+             * request may have been handled it is not sent again.
+             */
+            template <typename Self>
+            void retryOrFinish(Self &self, const system::error_code &ec)
+            {
+                RequestState &state = *m_state;
+
+                bool nothing_back = m_step == Step::Write || (ec == asio::error::eof && state.m_buf.size() == 0);
+                if(!state.m_reused || ec == asio::error::operation_aborted || !nothing_back)
+                {
+                    finish(self, ec);
+                    return;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(state.m_gaurd);
+
+                    system::error_code ignored_ec;
+                    state.m_sock.close(ignored_ec);
+                }
+
+                state.m_buf.clear();
+                state.m_reused = false;
+
+                connect(self);
+            }
+
+            template <typename Self>
+            void finish(Self &self, system::error_code ec)
+            {
+                RequestState &state = *m_state;
+                CoroutineTCPClient &client = m_client;
+
+                client.m_wheel.cancel(state.m_deadline);
+
+                std::unique_lock<std::mutex> lock(state.m_gaurd);
+                state.m_done = true;
+                if(state.m_fired)
+                    ec = asio::error::operation_aborted;
+                lock.unlock();
+
+                Metrics::add(MetricScope::CoroutineClient, MetricGauge::ActiveSessions, -1);
+
+                if(ec)
+                {
+                    system::error_code ignored_ec;
+                    state.m_sock.shutdown(StreamSocket::shutdown_both, ignored_ec);
+                    state.m_sock.close(ignored_ec);
+                }
+                else
+                {
+                    client.m_pool.checkin(state.m_ep, state.m_sock);
+                }
+
+                std::string response = std::move(state.m_response);
+                self.complete(ec, std::move(response));
+            }
+        };
+
+        asio::io_service m_ios;
+        TimerWheel m_wheel;
+        ClientOptions m_options;
+        ConnectionPool m_pool;
+        std::unique_ptr<asio::io_service::work> m_work;
+        std::list<std::unique_ptr<std::thread>> m_threads;
+
+        /* Wheel callback for a request past its deadline, its pending operation fails with operation_aborted. */
+        static void onDeadline(const std::shared_ptr<void> &owner)
+        {
+            RequestState &state = *std::static_pointer_cast<RequestState>(owner);
+            std::lock_guard<std::mutex> lock(state.m_gaurd);
+
+            if(state.m_done)
+                return;
+
+            system::error_code ignored_ec;
+            state.m_fired = true;
+            state.m_sock.cancel(ignored_ec);
+        }
+
+    public:
+
+        /* Contructor */
+        CoroutineTCPClient(std::size_t threads, const ClientOptions &options = ClientOptions())
+            :m_wheel(m_ios, options.timer_tick, threads + 1),
+            m_options(options),
+            m_pool(options.pool)
+        {
+            m_wheel.start();
+
+            // keeps threads running event loop from exiting when no async operation is pending.
+            m_work.reset(new asio::io_service::work(m_ios));
+
+            for(std::size_t i = 0; i < threads; ++i)
+                m_threads.push_back(std::make_unique<std::thread>([this] () { m_ios.run(); }));
+        }
+
+        /* Executor to co_spawn request coroutines on. */
+        asio::io_service::executor_type get_executor()
+        {
+            return m_ios.get_executor();
+        }
+
+        /*
+         * Sends payload as one request and completes with its response.
+         *
+         * @param: {StreamEndpoint} ep: server to send to, TCP or Unix domain.
+         *         {std::string_view} payload: request, framed per ClientOptions::framing.
+         *         {std::chrono::milliseconds} timeout: deadline for whole request, zero uses
+         *                                             ClientOptions::request_timeout.
+         *         {CompletionToken} token: completion of signature void(system::error_code, std::string).
+         *
+         * @behavior: completes with operation_aborted past the deadline.
+         */
+        template <typename CompletionToken>
+        auto request(const StreamEndpoint &ep, std::string_view payload, std::chrono::milliseconds timeout,
+                     CompletionToken &&token)
+        {
+            std::shared_ptr<RequestState> state = std::allocate_shared<RequestState>(
+                    RecyclingAllocator<RequestState>(), m_ios.get_executor(), ep, m_options);
+
+            encodeFrame(m_options.framing, payload, state->m_frame);
+            state->m_reused = m_pool.checkout(ep, state->m_sock);
+
+            Metrics::add(MetricScope::CoroutineClient, MetricGauge::ActiveSessions, 1);
+
+            if(timeout.count() <= 0)
+                timeout = m_options.request_timeout;
+            if(timeout.count() > 0)
+                state->m_deadline = m_wheel.schedule(timeout, state, &CoroutineTCPClient::onDeadline);
+
+            StreamSocket &sock = state->m_sock;
+            return asio::async_compose<CompletionToken, void(system::error_code, std::string)>(
+                    RequestOp{*this, std::move(state), RequestOp::Step::Start}, token, sock);
+        }
+
+        /*
+         * As above, awaited: the response is returned and errors are thrown as
+         * system::system_error, operation_aborted past the deadline.
+         */
+        asio::awaitable<std::string> request(const StreamEndpoint &ep, std::string_view payload,
+                std::chrono::milliseconds timeout = std::chrono::milliseconds::zero())
+        {
+            return request(ep, payload, timeout, asio::use_awaitable);
+        }
+
+        /* Closes io_service work, causing all threads to stop looping event loop and joins threads.*/
+        void close()
+        {
+            m_wheel.stop();
+            m_work.reset(NULL);
+            for(auto& thread: m_threads)
+                thread->join();
+
+            m_pool.clear();
+        }
+};
+
+#endif // !COROUTINE_TCPCLIENT
@@ -0,0 +1,307 @@
+#ifndef COROUTINE_TCPSERVER
+#define COROUTINE_TCPSERVER
+
+#include <utility>                                       // asio/awaitable.hpp uses std::exchange without including it
+
+#include <boost/asio.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "asynctcpserver.hpp"
+
+#if !defined(BOOST_ASIO_HAS_CO_AWAIT)
+#error "coroutinetcpserver.hpp needs C++20 coroutines, build with -std=c++20"
+#endif
+
+using namespace boost;
+
+/*
+ * Connection coroutines run on a strand named by its concrete type, not any_io_executor: a
+ * type erased strand does not fit the small object buffer and every executor copy asio makes
+ * per operation would allocate.
+ */
+typedef asio::strand<asio::io_context::executor_type> ConnectionStrand;
+typedef asio::basic_stream_socket<StreamProtocol, ConnectionStrand> ConnectionSocket;
+
+template <typename T>
+using ConnectionTask = asio::awaitable<T, ConnectionStrand>;
+
+static constexpr asio::use_awaitable_t<ConnectionStrand> use_connection_task;
+
+/*
+ * State of one connection that outlives a single coroutine step: the socket, and the deadline
+ * the timer wheel fires into. One per connection, requests on it allocate nothing.
+ */
+struct CoroutineConnection
+{
+    ConnectionSocket m_sock;
+    TimerWheel &m_wheel;
+    TimerId m_deadline;
+    std::chrono::steady_clock::time_point m_deadline_at;
+    bool m_timed_out;
+
+    CoroutineConnection(ConnectionSocket sock, TimerWheel &wheel)
+        :m_sock(std::move(sock)),
+        m_wheel(wheel),
+        m_deadline_at(std::chrono::steady_clock::time_point::max()),
+        m_timed_out(false)
+    {}
+};
+
+/*
+ * Coroutine per connection TCP server speaking the same protocol as AsyncTCPServer, written as
+ * straight line co_await loops instead of a chain of completion handlers. Of ServerOptions it
+ * honours keep-alive, the deadlines, framing, socket tuning and local_path; clients over
+ * max_sessions are closed on accept. It always runs a shared pool over one io_service.
+ *
+ * Each connection runs on its own strand. The only shared pointer is the one per connection
+ * the deadline needs, no reference is taken per operation. Coroutine frames come from asio's
+ * per-thread frame cache, and a connection only has a frame for its own loop, so steady state
+ * requests allocate no frames at all.
+ *
+ * Requests are answered by Handler as in BasicAsyncTCPServer; CoroutineTCPServer answers with HelloHandler.
+ *
+ * Stage latencies, active sessions and bytes in and out are recorded under MetricScope::CoroutineServer.
+ */
+template <typename Handler>
+class BasicCoroutineTCPServer
+{
+    private:
+        static_assert(IsRequestHandler<Handler>::value,
+                      "Handler must be callable as void(std::string_view request, std::string &response)");
+
+        Handler m_handler;
+        asio::io_service m_ios;
+        std::unique_ptr<asio::io_service::work> m_work;
+        std::unique_ptr<TimerWheel> m_wheel;
+        std::unique_ptr<StreamAcceptor> m_acceptor;
+        ServerOptions m_options;
+        std::atomic<bool> m_isStopped;
+        std::atomic<std::size_t> m_active;
+        std::vector<std::unique_ptr<std::thread>> m_thread_pool;
+
+        /* Replaces connection's deadline, zero timeout leaves the operation without one. */
+        static void armDeadline(const std::shared_ptr<CoroutineConnection> &conn, std::chrono::milliseconds timeout)
+        {
+            conn->m_wheel.cancel(conn->m_deadline);
+            conn->m_deadline_at = std::chrono::steady_clock::time_point::max();
+
+            if(timeout.count() <= 0)
+                return;
+
+            conn->m_deadline_at = std::chrono::steady_clock::now() + timeout;
+            conn->m_deadline = conn->m_wheel.schedule(timeout, conn, &BasicCoroutineTCPServer::onDeadline);
+        }
+
+        /* Wheel callback, hops onto the connection's strand and cancels its socket. */
+        static void onDeadline(const std::shared_ptr<void> &owner)
+        {
+            std::shared_ptr<CoroutineConnection> conn = std::static_pointer_cast<CoroutineConnection>(owner);
+
+            asio::post(conn->m_sock.get_executor(), makeRecyclingHandler([conn]()
+                    {
+                        if(std::chrono::steady_clock::now() < conn->m_deadline_at)
+                            return;
+
+                        conn->m_timed_out = true;
+
+                        system::error_code ignored_ec;
+                        conn->m_sock.cancel(ignored_ec);
+                    }));
+        }
+
+        /* Read, process, write loop of one connection. */
+        ConnectionTask<void> serve(std::shared_ptr<CoroutineConnection> conn)
+        {
+            FrameBuffer buf(m_options.framing, m_options.max_frame_size);
+            std::string response;
+            system::error_code ec;
+
+            Metrics::add(MetricScope::CoroutineServer, MetricGauge::ActiveSessions, 1);
+
+            while(true)
+            {
+                bool between_requests = m_options.keep_alive && buf.size() == 0;
+                armDeadline(conn, between_requests ? m_options.idle_timeout : m_options.read_timeout);
+
+                // read until at least one complete request is buffered
+                Metrics::TimePoint started = Metrics::now();
+                std::string_view request;
+
+                while(!buf.nextFrame(request, ec) && !ec)
+                {
+                    std::size_t n = co_await conn->m_sock.async_read_some(buf.prepare(),
+                            asio::redirect_error(use_connection_task, ec));
+                    if(ec)
+                        break;
+
+                    buf.commit(n);
+                    Metrics::add(MetricScope::CoroutineServer, MetricGauge::BytesIn, n);
+                }
+
+                if(ec)
+                {
+                    if(ec != asio::error::eof && !conn->m_timed_out)
+                    {
+                        Logger::error("Error code in CoroutineTCPServer ! Error code = ", ec.value(),
+                                ". Message: ", ec.message());
+                    }
+
+                    break;
+                }
+
+                Metrics::recordSince(MetricScope::CoroutineServer, MetricStage::ReadComplete, started);
+
+                // answer every pipelined request in one write
+                response.clear();
+                do
+                {
+                    started = Metrics::now();
+
+                    std::size_t frame = beginFrame(m_options.framing, response);
+                    m_handler(request, response);
+                    endFrame(m_options.framing, response, frame);
+
+                    Metrics::recordSince(MetricScope::CoroutineServer, MetricStage::Process, started);
+                } while(buf.nextFrame(request, ec));
+
+                armDeadline(conn, m_options.write_timeout);
+                started = Metrics::now();
+
+                std::size_t n = co_await asio::async_write(conn->m_sock, asio::buffer(response),
+                        asio::redirect_error(use_connection_task, ec));
+                if(ec)
+                    break;
+
+                Metrics::recordSince(MetricScope::CoroutineServer, MetricStage::WriteComplete, started);
+                Metrics::add(MetricScope::CoroutineServer, MetricGauge::BytesOut, n);
+
+                if(!m_options.keep_alive)
+                    break;
+            }
+
+            m_wheel->cancel(conn->m_deadline);
+            conn->m_deadline_at = std::chrono::steady_clock::time_point::max();
+
+            system::error_code ignored_ec;
+            conn->m_sock.shutdown(ConnectionSocket::shutdown_both, ignored_ec);
+            conn->m_sock.close(ignored_ec);
+
+            Metrics::add(MetricScope::CoroutineServer, MetricGauge::ActiveSessions, -1);
+            m_active.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        /* Accept loop, spawns a connection coroutine on a fresh strand per client. */
+        asio::awaitable<void> listen()
+        {
+            system::error_code ec;
+
+            while(!m_isStopped.load())
+            {
+                ConnectionSocket sock = co_await m_acceptor->async_accept(asio::make_strand(m_ios),
+                        asio::redirect_error(asio::use_awaitable, ec));
+
+                if(ec)
+                {
+                    if(ec != asio::error::operation_aborted)
+                    {
+                        Logger::error("Error occured! Error code = ", ec.value(),
+                                ". Message: ", ec.message());
+                    }
+
+                    continue;
+                }
+
+                Metrics::TimePoint accepted_at = Metrics::now();
+
+                // over the cap the client is closed right away, the listen backlog absorbs bursts
+                if(m_options.max_sessions != 0
+                        && m_active.load(std::memory_order_relaxed) >= m_options.max_sessions)
+                {
+                    system::error_code ignored_ec;
+                    sock.close(ignored_ec);
+
+                    Metrics::add(MetricScope::CoroutineServer, MetricGauge::Rejected, 1);
+                    continue;
+                }
+
+                m_active.fetch_add(1, std::memory_order_relaxed);
+                tuneConnection(sock, m_options.tuning, false);
+
+                std::shared_ptr<CoroutineConnection> conn = std::allocate_shared<CoroutineConnection>(
+                        RecyclingAllocator<CoroutineConnection>(), std::move(sock), *m_wheel);
+
+                ConnectionStrand strand = conn->m_sock.get_executor();
+                asio::co_spawn(strand, serve(std::move(conn)), asio::detached);
+
+                Metrics::recordSince(MetricScope::CoroutineServer, MetricStage::Accept, accepted_at);
+            }
+        }
+
+    public:
+
+        /* Constructor, handler answers every request of every connection. */
+        explicit BasicCoroutineTCPServer(Handler handler = Handler())
+            :m_handler(std::move(handler)),
+            m_isStopped(false),
+            m_active(0)
+        {
+            m_work.reset(new asio::io_service::work(m_ios));
+        }
+
+        void start(unsigned short port_num, unsigned int thread_pool_size,
+                   const ServerOptions &options = ServerOptions())
+        {
+            // make sure thread pool size is greater then 0
+            if(thread_pool_size == 0 || thread_pool_size > 2 * std::thread::hardware_concurrency())
+                thread_pool_size = 2;
+
+            m_options = options;
+
+            m_acceptor.reset(new StreamAcceptor(m_ios));
+            openListener(*m_acceptor, listenEndpoint(port_num, m_options.local_path), m_options.tuning);
+            m_acceptor->listen(m_options.tuning.backlog);
+
+            m_wheel.reset(new TimerWheel(m_ios, m_options.timer_tick, thread_pool_size));
+            m_wheel->start();
+
+            asio::co_spawn(m_ios, listen(), asio::detached);
+
+            for(unsigned int i{0}; i < thread_pool_size; ++i)
+            {
+                std::unique_ptr<std::thread> process(new std::thread([this](){m_ios.run();}));
+
+                m_thread_pool.push_back(std::move(process));
+            }
+        }
+
+        void stop()
+        {
+            m_isStopped.store(true);
+            if(m_acceptor)
+                removeListenerFile(*m_acceptor);
+
+            if(m_wheel)
+                m_wheel->stop();
+            m_ios.stop();
+
+            for(auto &process: m_thread_pool)
+            {
+                process->join();
+            }
+        }
+};
+
+typedef BasicCoroutineTCPServer<HelloHandler> CoroutineTCPServer;
+
+#endif // !COROUTINE_TCPSERVER
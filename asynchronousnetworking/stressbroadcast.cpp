@@ -0,0 +1,201 @@
+#include "asynctcpserver.hpp"
+
+#include <boost/asio/error.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+/*
+ * Stress test of broadcast servers (ServerOptions::broadcast) dropping slow subscribers.
+ *
+ * usage: stressbroadcast [messages]
+ *
+ * backlog: a subscriber that never reads must be dropped once broadcast_backlog messages queue
+ *          up behind it.
+ * write timeout: with a backlog too large to overflow, a subscriber that never reads must be
+ *          dropped by write_timeout instead. Meanwhile two threads publish, subscribers come
+ *          and go, and every subscriber that keeps reading must receive each publisher's
+ *          messages, all of them and in order.
+ *
+ * Exits nonzero if a slow subscriber is kept or a healthy one misses a message.
+ */
+
+const unsigned int PUBLISHERS{2};
+const unsigned int READERS{4};
+const std::size_t MESSAGE_SIZE{1000};
+
+typedef asio::ip::tcp::socket Socket;
+
+std::unique_ptr<Socket> subscribe(asio::io_service &ios, unsigned short port)
+{
+    std::unique_ptr<Socket> sock(new Socket(ios));
+    sock->connect(asio::ip::tcp::endpoint(asio::ip::address::from_string("127.0.0.1"), port));
+    return sock;
+}
+
+/* Waits up to timeout for the server to count subscribers, true if it did. */
+bool awaitSubscribers(AsyncTCPServer &server, std::size_t subscribers, std::chrono::milliseconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while(server.subscribers() != subscribers && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    return server.subscribers() == subscribers;
+}
+
+/* Message seq of publisher, "<publisher> <seq> " padded to MESSAGE_SIZE. */
+std::string message(unsigned int publisher, unsigned int seq)
+{
+    std::string text = std::to_string(publisher) + ' ' + std::to_string(seq) + ' ';
+    text.resize(MESSAGE_SIZE, 'x');
+    return text;
+}
+
+void publish(AsyncTCPServer &server, unsigned int messages)
+{
+    std::vector<std::thread> publishers;
+    for(unsigned int p = 0; p < PUBLISHERS; ++p)
+    {
+        publishers.emplace_back([&server, p, messages]()
+                {
+                    for(unsigned int seq = 0; seq < messages; ++seq)
+                        server.publish(message(p, seq));
+                });
+    }
+
+    for(auto &publisher: publishers)
+        publisher.join();
+}
+
+bool backlogDrop(unsigned int messages)
+{
+    ServerOptions options;
+    options.broadcast = true;
+    options.broadcast_backlog = 64;
+
+    AsyncTCPServer server;
+    server.start(9124, 2, options);
+
+    asio::io_service ios;
+    std::unique_ptr<Socket> stuck = subscribe(ios, 9124);
+    bool passed = awaitSubscribers(server, 1, std::chrono::seconds(2));
+
+    publish(server, messages);
+
+    passed = passed && awaitSubscribers(server, 0, std::chrono::seconds(5));
+    std::cout << "backlog: " << server.subscribers() << " subscribers left" << std::endl;
+
+    server.stop();
+    return passed;
+}
+
+bool writeTimeoutDrop(unsigned int messages)
+{
+    ServerOptions options;
+    options.broadcast = true;
+    options.broadcast_backlog = 1000000;
+    options.write_timeout = std::chrono::milliseconds(300);
+
+    AsyncTCPServer server;
+    server.start(9125, 2, options);
+
+    asio::io_service ios;
+    std::unique_ptr<Socket> stuck = subscribe(ios, 9125);
+
+    std::vector<std::unique_ptr<Socket>> readers;
+    for(unsigned int i = 0; i < READERS; ++i)
+        readers.push_back(subscribe(ios, 9125));
+
+    bool passed = awaitSubscribers(server, READERS + 1, std::chrono::seconds(2));
+
+    std::atomic<unsigned int> complete{0};
+    std::vector<std::thread> reading;
+    for(auto &reader: readers)
+    {
+        reading.emplace_back([&complete, sock = reader.get(), messages]()
+                {
+                    asio::streambuf buf;
+                    std::vector<unsigned int> next(PUBLISHERS, 0);
+                    unsigned int received{0};
+                    system::error_code ec;
+
+                    while(received < PUBLISHERS * messages)
+                    {
+                        asio::read_until(*sock, buf, '\n', ec);
+                        if(ec)
+                            break;
+
+                        std::istream is(&buf);
+                        std::string line;
+                        std::getline(is, line);
+
+                        unsigned int publisher{0}, seq{0};
+                        std::istringstream fields(line);
+                        fields >> publisher >> seq;
+                        if(publisher >= PUBLISHERS || seq != next[publisher]++)
+                        {
+                            std::cout << "reader: message " << seq << " of publisher " << publisher
+                                << " out of order" << std::endl;
+                            break;
+                        }
+
+                        ++received;
+                    }
+
+                    if(received == PUBLISHERS * messages)
+                        ++complete;
+                    else
+                        std::cout << "reader: " << received << " messages, " << ec.message() << std::endl;
+                });
+    }
+
+    // subscribers coming and going while publishing
+    std::atomic<bool> publishing{true};
+    std::thread churn([&ios, &publishing]()
+            {
+                while(publishing)
+                {
+                    std::unique_ptr<Socket> passing = subscribe(ios, 9125);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+                    system::error_code ignored_ec;
+                    passing->close(ignored_ec);
+                }
+            });
+
+    publish(server, messages);
+    publishing = false;
+    churn.join();
+
+    for(auto &thread: reading)
+        thread.join();
+
+    passed = passed && complete == READERS && awaitSubscribers(server, READERS, std::chrono::seconds(5));
+    std::cout << "write timeout: " << complete << " of " << READERS << " readers got every message, "
+        << server.subscribers() << " subscribers left" << std::endl;
+
+    server.stop();
+    return passed;
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned int messages = argc > 1 ? std::atoi(argv[1]) : 10000;
+
+    Logger::instance().setLevel(LogLevel::Error);
+
+    try
+    {
+        bool passed = backlogDrop(messages) && writeTimeoutDrop(messages);
+
+        std::cout << (passed ? "passed" : "FAILED") << std::endl;
+        return passed ? 0 : 1;
+    }
+    catch (system::system_error &e) {
+        std::cout << "Error occured! Error code = " << e.code()
+            << ". Message: " << e.what() << std::endl;
+    }
+    return 1;
+}
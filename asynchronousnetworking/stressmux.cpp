@@ -0,0 +1,177 @@
+#include "asynctcpserver.hpp"
+#include "asynctcpclient.hpp"
+
+#include <boost/asio/error.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+/*
+ * Stress test of write_high_water on multiplexed connections (ServerOptions::multiplexed,
+ * ClientOptions::multiplexed).
+ *
+ * usage: stressmux [requests]
+ *
+ * client: requests issued all at once complete, and with a write_high_water far below what they
+ *         take to send, the ones past it fail fast with no_buffer_space and the rest complete.
+ * server: a client floods requests for large responses without reading any. The server must
+ *         stop reading at its write_high_water instead of buffering every response, then
+ *         resume as the client reads and answer each request exactly once.
+ *
+ * Exits nonzero if a request fails for any other reason, or a response is lost or repeated.
+ */
+
+/* Answers requests longer than 100 bytes with a 2000 byte response, anything else with "ok". */
+struct SizedHandler
+{
+    void operator()(std::string_view request, std::string &response) const
+    {
+        if(request.size() > 100)
+            response.append(2000, 'r');
+        else
+            response.append("ok");
+    }
+};
+
+std::atomic<unsigned int> ok{0};
+std::atomic<unsigned int> no_buffer{0};
+std::atomic<unsigned int> other{0};
+
+void handler(unsigned int request_id, const std::string &response, const system::error_code &ec)
+{
+    if(!ec && response == "ok")
+        ++ok;
+    else if(ec == asio::error::no_buffer_space)
+        ++no_buffer;
+    else if(other++ < 10)
+        std::cout << "Request #" << request_id << " failed: " << ec.message() << std::endl;
+}
+
+/* Issues requests at once, true if none failed but with no_buffer_space, and that only if expected. */
+bool clientHighWater(const char *label, unsigned int requests, std::size_t write_high_water, bool expect_no_buffer)
+{
+    ok = 0;
+    no_buffer = 0;
+    other = 0;
+
+    ClientOptions options;
+    options.multiplexed = true;
+    options.write_high_water = write_high_water;
+
+    AsyncTCPClient client(2, options);
+    for(unsigned int id = 1; id <= requests; ++id)
+        client.emulateLongComputationOp("127.0.0.1", 9131, handler, id);
+
+    for(int i = 0; i < 1000 && ok + no_buffer + other < requests; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    client.close();
+
+    std::cout << label << ": " << ok << " ok, " << no_buffer << " no_buffer_space, "
+        << other << " other" << std::endl;
+
+    return ok + no_buffer == requests && other == 0 && ok > 0 && (no_buffer > 0) == expect_no_buffer;
+}
+
+/* Floods requests, reads nothing for a while, then every response must arrive once. */
+bool serverHighWater(unsigned int requests)
+{
+    asio::io_service ios;
+    asio::ip::tcp::socket sock(ios);
+    sock.connect(asio::ip::tcp::endpoint(asio::ip::address::from_string("127.0.0.1"), 9131));
+
+    std::string flood;
+    std::string payload(200, 'q');
+    for(unsigned int id = 1; id <= requests; ++id)
+        encodeTaggedFrame(id, payload, flood);
+
+    std::thread writer([&sock, &flood]()
+            {
+                system::error_code ec;
+                asio::write(sock, asio::buffer(flood), ec);
+            });
+
+    // responses pile up unread, the server has to pause reading requests
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    FrameBuffer buf(Framing::LengthPrefixed, 1 << 20);
+    std::vector<bool> seen(requests + 1, false);
+    unsigned int received{0};
+    bool passed{true};
+
+    while(passed && received < requests)
+    {
+        system::error_code ec;
+        std::string_view frame;
+        while(buf.nextFrame(frame, ec))
+        {
+            std::uint32_t id{0};
+            std::string_view response;
+            if(!splitTaggedFrame(frame, id, response) || id == 0 || id > requests || seen[id] ||
+               response.size() != 2000)
+            {
+                std::cout << "flood: unexpected response to request #" << id << std::endl;
+                passed = false;
+                break;
+            }
+
+            seen[id] = true;
+            ++received;
+        }
+
+        if(ec)
+        {
+            std::cout << "flood: " << ec.message() << std::endl;
+            passed = false;
+        }
+
+        if(!passed || received == requests)
+            break;
+
+        std::size_t n = sock.read_some(buf.prepare(), ec);
+        if(ec)
+        {
+            std::cout << "flood: " << ec.message() << " after " << received << " responses" << std::endl;
+            passed = false;
+        }
+        buf.commit(n);
+    }
+
+    writer.join();
+
+    std::cout << "flood: " << received << " of " << requests << " responses" << std::endl;
+    return passed && received == requests;
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+    Logger::instance().setLevel(LogLevel::Error);
+
+    try
+    {
+        ServerOptions options;
+        options.multiplexed = true;
+        options.compute_threads = 2;
+        options.write_high_water = 16 * 1024;
+
+        BasicAsyncTCPServer<SizedHandler> server;
+        server.start(9131, 2, options);
+
+        bool passed = clientHighWater("default high water", requests, ClientOptions().write_high_water, false) &&
+                      clientHighWater("small high water", requests, 512, true) &&
+                      serverHighWater(requests / 4);
+
+        server.stop();
+
+        std::cout << (passed ? "passed" : "FAILED") << std::endl;
+        return passed ? 0 : 1;
+    }
+    catch (system::system_error &e) {
+        std::cout << "Error occured! Error code = " << e.code()
+            << ". Message: " << e.what() << std::endl;
+    }
+    return 1;
+}
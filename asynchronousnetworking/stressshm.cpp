@@ -0,0 +1,155 @@
+#include "asynctcpserver.hpp"
+#include "asynctcpclient.hpp"
+
+#include <boost/asio/error.hpp>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+ * Stress test of the shared memory transport (ClientOptions::shared_memory, ServerOptions::shm_path).
+ *
+ * usage: stressshm [requests] [rounds]
+ *
+ * A client that connects to the handshake socket and never sends must be closed within the
+ * server's read_timeout. Then every round a fresh client pushes requests from several threads
+ * at once through rings of the smallest capacity, answered with responses close to the largest
+ * record such a ring takes, so both rings are full most of the time: producers park on a full
+ * ring and consumers on an empty one, and every wake up races the other side's next push. Each
+ * request must complete exactly once, with the whole response.
+ *
+ * Exits nonzero on the first round with a missing, repeated, failed or damaged response.
+ */
+
+const char *SHM_PATH{"/tmp/stressshm.sock"};
+const unsigned int PRODUCERS{4};
+const std::size_t RESPONSE_SIZE{1800};
+
+/* Answers every request with RESPONSE_SIZE bytes, two of them fill a 4 KiB ring. */
+struct LargeResponseHandler
+{
+    void operator()(std::string_view, std::string &response) const
+    {
+        std::size_t start = response.size();
+        response.resize(start + RESPONSE_SIZE);
+        for(std::size_t i = 0; i < RESPONSE_SIZE; ++i)
+            response[start + i] = static_cast<char>('a' + i % 26);
+    }
+};
+
+std::string expected;
+std::unique_ptr<std::atomic<bool>[]> seen;
+std::atomic<unsigned int> completed{0};
+std::atomic<unsigned int> failed{0};
+
+void handler(unsigned int request_id, const std::string &response, const system::error_code &ec)
+{
+    if(ec)
+    {
+        if(failed++ < 10)
+            std::cout << "Request #" << request_id << " failed: " << ec.message() << std::endl;
+    }
+    else if(response != expected)
+    {
+        if(failed++ < 10)
+            std::cout << "Request #" << request_id << " got a damaged response of "
+                << response.size() << " bytes" << std::endl;
+    }
+    else if(seen[request_id].exchange(true))
+    {
+        if(failed++ < 10)
+            std::cout << "Request #" << request_id << " completed twice" << std::endl;
+    }
+
+    ++completed;
+}
+
+/* Silent client must be closed by the server's handshake deadline, true if it was. */
+bool silentClientClosed(std::chrono::milliseconds read_timeout)
+{
+    asio::io_service ios;
+    asio::local::stream_protocol::socket silent(ios);
+    silent.connect(asio::local::stream_protocol::endpoint(SHM_PATH));
+
+    std::this_thread::sleep_for(read_timeout * 2);
+
+    char c;
+    system::error_code ec;
+    silent.non_blocking(true);
+    silent.read_some(asio::buffer(&c, 1), ec);
+
+    std::cout << "silent handshake: " << ec.message() << std::endl;
+    return ec == asio::error::eof || ec == asio::error::connection_reset;
+}
+
+bool runRound(unsigned int round, unsigned int requests)
+{
+    completed = 0;
+    failed = 0;
+    seen.reset(new std::atomic<bool>[requests + 1]());
+
+    ClientOptions options;
+    options.shared_memory = true;
+    options.shm_ring_size = ShmSegment::MIN_CAPACITY;
+
+    AsyncTCPClient client(2, options);
+    StreamEndpoint ep = localEndpoint(SHM_PATH);
+
+    std::vector<std::thread> producers;
+    for(unsigned int p = 0; p < PRODUCERS; ++p)
+    {
+        producers.emplace_back([&client, &ep, p, requests]()
+                {
+                    for(unsigned int id = 1 + p; id <= requests; id += PRODUCERS)
+                        client.emulateLongComputationOp(ep, handler, id);
+                });
+    }
+
+    for(auto &producer: producers)
+        producer.join();
+
+    for(int i = 0; i < 1000 && completed < requests; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    client.close();
+
+    std::cout << "round " << round << ": " << completed << " of " << requests
+        << " completed, " << failed << " failed" << std::endl;
+
+    return completed == requests && failed == 0;
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+    unsigned int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    Logger::instance().setLevel(LogLevel::Warn);
+    LargeResponseHandler()(std::string_view(), expected);
+
+    try
+    {
+        ServerOptions options;
+        options.shm_path = SHM_PATH;
+        options.read_timeout = std::chrono::milliseconds(300);
+
+        BasicAsyncTCPServer<LargeResponseHandler> server;
+        server.start(9141, 2, options);
+
+        bool passed = silentClientClosed(options.read_timeout);
+        for(unsigned int round = 1; passed && round <= rounds; ++round)
+            passed = runRound(round, requests);
+
+        server.stop();
+
+        std::cout << (passed ? "passed" : "FAILED") << std::endl;
+        return passed ? 0 : 1;
+    }
+    catch (system::system_error &e) {
+        std::cout << "Error occured! Error code = " << e.code()
+            << ". Message: " << e.what() << std::endl;
+    }
+    return 1;
+}
@@ -0,0 +1,135 @@
+#include "loadgenerator.hpp"
+#include "../asynchronousnetworking/asynctcpserver.hpp"
+
+/* Recycler hits and misses since previous call, shows how much of the steady state avoids malloc. */
+void reportRecycler(Recycler::Stats &previous)
+{
+    Recycler::Stats now = Recycler::stats();
+
+    std::cout << "  recycler hits " << now.hits - previous.hits
+        << " misses " << now.misses - previous.misses << std::endl;
+
+    previous = now;
+}
+
+/*
+ * Benchmarks AsyncTCPServer over loopback.
+ *
+ * usage: benchasync [--mode shared|sharded|io_uring|all] [--threads N] [--close] [--compute N] [--max-sessions N] [--reject]
+ *                   [--metrics] [LoadOptions flags]
+ *
+ * io_uring runs the sharded layout on IoBackend::IoUring, against the epoll reactor of the other two.
+ * Connections are kept alive unless --close is given, which answers one request per connection.
+ * --compute N runs request handlers on a separate pool of N threads.
+ * --max-sessions N caps concurrent sessions, --reject answers clients over the cap with a reject response.
+ * --tuning default|low_latency|high_throughput applies that SocketTuning preset to server and load sockets.
+ * --transport tcp|unix|both runs shared mode over loopback TCP, a Unix domain socket (--socket-path) or
+ * both, then reports the gain; sharded and io_uring have no Unix domain socket variant and stay on TCP.
+ * --metrics prints the server stage metrics, cumulative over runs, after each run.
+ */
+int main (int argc, char *argv[])
+{
+    LoadOptions options;
+    std::vector<std::string> rest = options.parse(argc, argv);
+
+    // per request log lines would swamp the measurement
+    Logger::instance().setLevel(LogLevel::Warn);
+
+    std::string mode{"all"};
+    unsigned int threads{std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 2};
+    bool metrics{false};
+    ServerOptions server_options;
+    server_options.keep_alive = true;
+    server_options.framing = options.framing;
+    server_options.tuning = options.tuning;
+
+    for(std::size_t i = 0; i < rest.size(); ++i)
+    {
+        if(rest[i] == "--mode" && i + 1 < rest.size())
+            mode = rest[++i];
+        else if(rest[i] == "--threads" && i + 1 < rest.size())
+            threads = std::atoi(rest[++i].c_str());
+        else if(rest[i] == "--close")
+            server_options.keep_alive = false;
+        else if(rest[i] == "--compute" && i + 1 < rest.size())
+            server_options.compute_threads = std::atoi(rest[++i].c_str());
+        else if(rest[i] == "--max-sessions" && i + 1 < rest.size())
+            server_options.max_sessions = std::atoi(rest[++i].c_str());
+        else if(rest[i] == "--reject")
+            server_options.reject_when_full = true;
+        else if(rest[i] == "--metrics")
+            metrics = true;
+    }
+
+    if(!server_options.keep_alive)
+    {
+        options.depth = 1;
+        options.requests_per_connection = 1;
+    }
+
+    Recycler::Stats recycler = Recycler::stats();
+
+    try
+    {
+        if(mode == "shared" || mode == "all")
+        {
+            std::unique_ptr<AsyncTCPServer> server;
+            server_options.threading = ThreadingMode::SharedPool;
+
+            runTransports(options, "AsyncTCPServer/shared",
+                    [&](const LoadOptions &run)
+                    {
+                        server.reset(new AsyncTCPServer());
+                        server_options.local_path = run.local_path;
+                        server->start(run.port, threads, server_options);
+                    },
+                    [&]()
+                    {
+                        server->stop();
+                        reportRecycler(recycler);
+
+                        if(metrics)
+                            Metrics::snapshot().print(std::cout);
+                    });
+
+            server_options.local_path.clear();
+        }
+
+        if(mode == "sharded" || mode == "all")
+        {
+            AsyncTCPServer server;
+            server_options.threading = ThreadingMode::Sharded;
+            server.start(options.port, threads, server_options);
+
+            LoadGenerator(options).run("AsyncTCPServer/sharded").report();
+            server.stop();
+            reportRecycler(recycler);
+
+            if(metrics)
+                Metrics::snapshot().print(std::cout);
+        }
+
+        if(mode == "io_uring" || mode == "all")
+        {
+            AsyncTCPServer server;
+            server_options.threading = ThreadingMode::Sharded;
+            server_options.backend = IoBackend::IoUring;
+            server.start(options.port, threads, server_options);
+
+            LoadGenerator(options).run("AsyncTCPServer/io_uring").report();
+            server.stop();
+            server_options.backend = IoBackend::Reactor;
+
+            if(metrics)
+                Metrics::snapshot().print(std::cout);
+        }
+    }
+    catch(system::system_error &ec)
+    {
+        std::cerr << "Error occured! Error code = " << ec.code()
+            << ". Message: " << ec.what() << std::endl;
+        return ec.code().value();
+    }
+
+    return 0;
+}
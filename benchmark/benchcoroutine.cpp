@@ -0,0 +1,344 @@
+#include "../asynchronousnetworking/coroutinetcpserver.hpp"
+#include "../asynchronousnetworking/coroutinetcpclient.hpp"
+#include "loadgenerator.hpp"
+
+#include <cstdlib>
+#include <new>
+
+/* Every heap allocation in the process, to compare allocations per request between the paths. */
+static std::atomic<std::uint64_t> g_allocations{0};
+
+// kept out of line, gcc pairs an inlined malloc with its delete and warns of a mismatch
+__attribute__((noinline)) void *operator new(std::size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if(void *p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+/*
+ * One request in flight per slot, each slot loops request after request; a slot's requests
+ * never overlap so its histogram needs no lock.
+ */
+struct ClientSlot
+{
+    std::chrono::steady_clock::time_point m_sent_at;
+    unsigned int m_round{0};
+    std::uint64_t m_requests{0};
+    std::uint64_t m_errors{0};
+    LatencyHistogram m_latency;
+};
+
+/* State of the callback client run, Callback carries no user pointer. */
+struct CallbackRun
+{
+    AsyncTCPClient *m_client{nullptr};
+    LoadOptions m_options;
+    StreamEndpoint m_ep;
+    std::vector<ClientSlot> m_slots;
+    unsigned int m_cancel_every{0};                      // cancel every nth request right after issuing it
+    std::atomic<bool> m_stop{false};
+    std::atomic<unsigned int> m_running{0};
+};
+
+static CallbackRun g_run;
+
+void onResponse(unsigned int request_id, const std::string &response, const system::error_code &ec);
+
+void issue(unsigned int slot)
+{
+    ClientSlot &s = g_run.m_slots[slot];
+    unsigned int id = s.m_round++ * g_run.m_options.connections + slot;
+
+    s.m_sent_at = std::chrono::steady_clock::now();
+    g_run.m_client->emulateLongComputationOp(g_run.m_ep, &onResponse, id);
+
+    if(g_run.m_cancel_every != 0 && id % g_run.m_cancel_every == 0)
+        g_run.m_client->cancelrequest(id);
+}
+
+void onResponse(unsigned int request_id, const std::string &, const system::error_code &ec)
+{
+    unsigned int slot = request_id % g_run.m_options.connections;
+    ClientSlot &s = g_run.m_slots[slot];
+
+    if(ec.value() == 0)
+    {
+        ++s.m_requests;
+        s.m_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - s.m_sent_at).count());
+    }
+    else
+    {
+        ++s.m_errors;
+    }
+
+    if(g_run.m_stop.load(std::memory_order_relaxed))
+        g_run.m_running.fetch_sub(1);
+    else
+        issue(slot);
+}
+
+/* Totals slots into a result, with allocations per request on its own line. */
+void reportClient(const std::string &label, const LoadOptions &options, std::vector<ClientSlot> &slots,
+                  std::chrono::steady_clock::time_point start, std::uint64_t allocations)
+{
+    LoadResult total;
+    total.label = options.label(label);
+    total.options = options;
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for(ClientSlot &slot: slots)
+    {
+        total.requests += slot.m_requests;
+        total.errors += slot.m_errors;
+        total.latency.merge(slot.m_latency);
+    }
+
+    total.report();
+    std::cout << "  allocations per request "
+        << (total.requests ? static_cast<double>(allocations) / total.requests : 0) << std::endl;
+}
+
+/*
+ * Drives AsyncTCPClient with options.connections requests in flight for options.duration.
+ *
+ * @param: {const StreamEndpoint &} ep: server to send to, over shared memory if client_options ask for it.
+ *         {const std::string &} name: run is reported under this, suffixed for unix runs.
+ */
+void runCallbackClient(const LoadOptions &options, unsigned int threads, const ClientOptions &client_options,
+                       unsigned int cancel_every, const StreamEndpoint &ep, const std::string &name)
+{
+    AsyncTCPClient client(threads, client_options);
+
+    g_run.m_client = &client;
+    g_run.m_cancel_every = cancel_every;
+    g_run.m_options = options;
+    g_run.m_ep = ep;
+    g_run.m_slots.assign(options.connections, ClientSlot());
+    g_run.m_stop.store(false);
+    g_run.m_running.store(options.connections);
+
+    std::uint64_t allocations = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+
+    for(unsigned int slot = 0; slot < options.connections; ++slot)
+        issue(slot);
+
+    std::this_thread::sleep_for(options.duration);
+    g_run.m_stop.store(true);
+
+    while(g_run.m_running.load() != 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    reportClient(name, options, g_run.m_slots, start, g_allocations.load() - allocations);
+    client.close();
+}
+
+void runCoroutineClient(const LoadOptions &options, unsigned int threads, const ClientOptions &client_options)
+{
+    CoroutineTCPClient client(threads, client_options);
+    StreamEndpoint ep = options.endpoint();
+
+    std::vector<ClientSlot> slots(options.connections);
+    std::atomic<bool> stop{false};
+    std::atomic<unsigned int> running{options.connections};
+
+    std::uint64_t allocations = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+
+    for(unsigned int i = 0; i < options.connections; ++i)
+    {
+        asio::co_spawn(client.get_executor(),
+                [&client, &ep, &stop, &running, &slot = slots[i]]() -> asio::awaitable<void>
+                {
+                    while(!stop.load(std::memory_order_relaxed))
+                    {
+                        auto sent_at = std::chrono::steady_clock::now();
+
+                        try
+                        {
+                            co_await client.request(ep, "Hello Server");
+
+                            ++slot.m_requests;
+                            slot.m_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now() - sent_at).count());
+                        }
+                        catch(system::system_error &)
+                        {
+                            ++slot.m_errors;
+                        }
+                    }
+
+                    running.fetch_sub(1);
+                }, asio::detached);
+    }
+
+    std::this_thread::sleep_for(options.duration);
+    stop.store(true);
+
+    while(running.load() != 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    reportClient("CoroutineTCPClient", options, slots, start, g_allocations.load() - allocations);
+    client.close();
+}
+
+/*
+ * Benchmarks the coroutine client and server against their callback counterparts over loopback.
+ *
+ * usage: benchcoroutine [--side server|client|all] [--threads N] [--client-threads N] [--cancel-every N]
+ *                       [--shm] [--io-uring] [LoadOptions flags]
+ *
+ * server: LoadGenerator drives AsyncTCPServer, then CoroutineTCPServer, both keep-alive.
+ * client: AsyncTCPClient, then CoroutineTCPClient, both pooling connections, each keep
+ *         --connections requests in flight against a keep-alive AsyncTCPServer.
+ *         --client-threads sets the clients' I/O threads, half of --threads by default; 8 and
+ *         more show the cost of per-request synchronization between them.
+ *         --cancel-every N cancels every Nth AsyncTCPClient request just after issuing it, cancelled
+ *         requests count as errors.
+ *         --shm adds an AsyncTCPClient run over shared memory rings, the server taking them on
+ *         --socket-path with .shm appended; once, whatever --transport says. Linux only.
+ *         --io-uring adds an AsyncTCPClient run on IoBackend::IoUring, against the epoll reactor
+ *         of the callback run; it falls back to the reactor where io_uring is missing.
+ * Every run also prints its heap allocations per request.
+ * --transport tcp|unix|both repeats the runs over loopback TCP, a Unix domain socket or both.
+ *
+ * Needs C++20: g++ -std=c++20 -O2 benchcoroutine.cpp -pthread
+ */
+int main (int argc, char *argv[])
+{
+    LoadOptions options;
+    std::vector<std::string> rest = options.parse(argc, argv);
+
+    // per request log lines would swamp the measurement
+    Logger::instance().setLevel(LogLevel::Warn);
+
+    std::string side{"all"};
+    unsigned int threads{std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 2};
+    unsigned int client_threads{0};
+    unsigned int cancel_every{0};
+    bool shm{false};
+    bool io_uring{false};
+
+    for(std::size_t i = 0; i < rest.size(); ++i)
+    {
+        if(rest[i] == "--side" && i + 1 < rest.size())
+            side = rest[++i];
+        else if(rest[i] == "--threads" && i + 1 < rest.size())
+            threads = std::atoi(rest[++i].c_str());
+        else if(rest[i] == "--client-threads" && i + 1 < rest.size())
+            client_threads = std::atoi(rest[++i].c_str());
+        else if(rest[i] == "--cancel-every" && i + 1 < rest.size())
+            cancel_every = std::atoi(rest[++i].c_str());
+        else if(rest[i] == "--shm")
+            shm = true;
+        else if(rest[i] == "--io-uring")
+            io_uring = true;
+    }
+
+    if(client_threads == 0)
+        client_threads = std::max(1u, threads / 2);
+
+    ServerOptions server_options;
+    server_options.keep_alive = true;
+    server_options.framing = options.framing;
+    server_options.tuning = options.tuning;
+    if(shm)
+        server_options.shm_path = options.socket_path + ".shm";
+
+    try
+    {
+        for(const LoadOptions &run: options.transports())
+        {
+            server_options.local_path = run.local_path;
+
+            if(side == "server" || side == "all")
+            {
+                std::uint64_t allocations;
+
+                {
+                    AsyncTCPServer server;
+                    server.start(run.port, threads, server_options);
+
+                    allocations = g_allocations.load();
+                    LoadResult result = LoadGenerator(run).run(run.label("AsyncTCPServer/callback"));
+                    allocations = g_allocations.load() - allocations;
+
+                    result.report();
+                    std::cout << "  allocations per request (server and load generator) "
+                        << (result.requests ? static_cast<double>(allocations) / result.requests : 0) << std::endl;
+                    server.stop();
+                }
+
+                {
+                    CoroutineTCPServer server;
+                    server.start(run.port, threads, server_options);
+
+                    allocations = g_allocations.load();
+                    LoadResult result = LoadGenerator(run).run(run.label("CoroutineTCPServer"));
+                    allocations = g_allocations.load() - allocations;
+
+                    result.report();
+                    std::cout << "  allocations per request (server and load generator) "
+                        << (result.requests ? static_cast<double>(allocations) / result.requests : 0) << std::endl;
+                    server.stop();
+                }
+            }
+
+            if(side == "client" || side == "all")
+            {
+                AsyncTCPServer server;
+                server.start(run.port, threads, server_options);
+
+                ClientOptions client_options;
+                client_options.framing = options.framing;
+                client_options.tuning = options.tuning;
+                client_options.pool.enabled = true;
+                client_options.pool.max_idle_per_endpoint = run.connections;
+
+                runCallbackClient(run, client_threads, client_options, cancel_every, run.endpoint(),
+                                  "AsyncTCPClient/callback");
+                runCoroutineClient(run, client_threads, client_options);
+
+                if(io_uring)
+                {
+                    ClientOptions uring_options = client_options;
+                    uring_options.backend = IoBackend::IoUring;
+
+                    runCallbackClient(run, client_threads, uring_options, cancel_every, run.endpoint(),
+                                      "AsyncTCPClient/io_uring");
+                }
+
+                if(shm)
+                {
+                    // shared memory does not depend on the transport, one run is enough
+                    shm = false;
+
+                    LoadOptions shm_run = run;
+                    shm_run.local_path.clear();
+                    client_options.shared_memory = true;
+
+                    runCallbackClient(shm_run, client_threads, client_options, cancel_every,
+                                      localEndpoint(server_options.shm_path), "AsyncTCPClient/shm");
+                }
+
+                server.stop();
+            }
+        }
+    }
+    catch(system::system_error &ec)
+    {
+        std::cerr << "Error occured! Error code = " << ec.code()
+            << ". Message: " << ec.what() << std::endl;
+        return ec.code().value();
+    }
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "loadgenerator.hpp"
+#include "../synchronousnetworking/synctcpserver.hpp"
+#include "../synchronousnetworking/synctcpserverM.hpp"
+
+/*
+ * Synchronous servers block in accept, stop only returns once another connection comes in.
+ * It sends a byte, with TCP_DEFER_ACCEPT an idle connection would not wake the accept.
+ */
+template <typename Server>
+void stopServer(Server &server, const LoadOptions &options)
+{
+    std::thread stopper([&server]() { server.stop(); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    try
+    {
+        asio::io_service ios;
+        StreamSocket sock(ios);
+        sock.connect(options.endpoint());
+        sock.write_some(asio::buffer("\n", 1));
+    }
+    catch(system::system_error &) {}
+
+    stopper.join();
+}
+
+/*
+ * Benchmarks TCPServer and TCPServer_M over loopback.
+ *
+ * usage: benchsync [--server sync|syncm|all] [--workers N] [LoadOptions flags]
+ *
+ * Both servers answer one request per connection, so every request reconnects.
+ * --transport tcp|unix|both runs each server over loopback TCP, a Unix domain socket or both.
+ */
+int main (int argc, char *argv[])
+{
+    LoadOptions options;
+    std::vector<std::string> rest = options.parse(argc, argv);
+
+    // per request log lines would swamp the measurement
+    Logger::instance().setLevel(LogLevel::Warn);
+
+    std::string which{"all"};
+    WorkerPoolOptions pool;
+
+    for(std::size_t i = 0; i < rest.size(); ++i)
+    {
+        if(rest[i] == "--server" && i + 1 < rest.size())
+            which = rest[++i];
+        else if(rest[i] == "--workers" && i + 1 < rest.size())
+            pool.workers = std::atoi(rest[++i].c_str());
+    }
+
+    pool.framing = options.framing;
+    pool.tuning = options.tuning;
+    options.depth = 1;
+    options.requests_per_connection = 1;
+
+    try
+    {
+        if(which == "sync" || which == "all")
+        {
+            std::unique_ptr<TCPServer> server;
+            LoadOptions current;
+
+            runTransports(options, "TCPServer",
+                    [&](const LoadOptions &run)
+                    {
+                        current = run;
+                        server.reset(new TCPServer(listenEndpoint(run.port, run.local_path), run.framing, run.tuning));
+                        server->start();
+                    },
+                    [&]() { stopServer(*server, current); });
+        }
+
+        if(which == "syncm" || which == "all")
+        {
+            std::unique_ptr<TCPServer_M> server;
+            LoadOptions current;
+
+            runTransports(options, "TCPServer_M",
+                    [&](const LoadOptions &run)
+                    {
+                        current = run;
+                        pool.local_path = run.local_path;
+                        server.reset(new TCPServer_M(run.port, pool));
+                        server->start();
+                    },
+                    [&]() { stopServer(*server, current); });
+        }
+    }
+    catch(system::system_error &ec)
+    {
+        std::cerr << "Error occured! Error code = " << ec.code()
+            << ". Message: " << ec.what() << std::endl;
+        return ec.code().value();
+    }
+
+    return 0;
+}
@@ -0,0 +1,405 @@
+#ifndef BENCH_LOADGENERATOR
+#define BENCH_LOADGENERATOR
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/framing.hpp"
+#include "../common/histogram.hpp"
+#include "../common/sockettuning.hpp"
+#include "../common/streamendpoint.hpp"
+
+using namespace boost;
+
+/*
+ * Load generator settings, all can be set from the command line (see parse).
+ */
+struct LoadOptions
+{
+    std::string host{"127.0.0.1"};
+    unsigned short port{8080};
+    unsigned int connections{16};                        // sockets open at once
+    unsigned int concurrency{4};                         // load threads, connections are split among them
+    std::size_t request_size{64};                        // payload bytes per request
+    Framing framing{Framing::Newline};
+    unsigned int depth{1};                               // requests pipelined per connection before reading
+    unsigned int requests_per_connection{0};             // reconnect after this many requests, 0 keeps connection open
+    std::chrono::seconds duration{5};
+    SocketTuning tuning;                                 // preset for server and load sockets, --tuning default|low_latency|high_throughput
+    std::string json_path;                               // write results as JSON here, stdout if empty
+    std::string transport{"tcp"};                        // --transport tcp|unix|both, see transports
+    std::string socket_path{"/tmp/net-bench.sock"};      // Unix domain socket of unix runs
+    std::string local_path;                              // set on a unix run, servers listen and load connects here
+
+    /*
+     * Parses --name value pairs into options, unknown flags are left for the caller.
+     *
+     * @return: remaining arguments.
+     */
+    std::vector<std::string> parse(int argc, char *argv[])
+    {
+        std::vector<std::string> rest;
+
+        for(int i = 1; i < argc; ++i)
+        {
+            std::string flag{argv[i]};
+            bool has_value = i + 1 < argc;
+
+            if(flag == "--host" && has_value)                 host = argv[++i];
+            else if(flag == "--port" && has_value)            port = static_cast<unsigned short>(std::atoi(argv[++i]));
+            else if(flag == "--connections" && has_value)     connections = std::atoi(argv[++i]);
+            else if(flag == "--concurrency" && has_value)     concurrency = std::atoi(argv[++i]);
+            else if(flag == "--size" && has_value)            request_size = std::atoi(argv[++i]);
+            else if(flag == "--depth" && has_value)           depth = std::atoi(argv[++i]);
+            else if(flag == "--per-connection" && has_value)  requests_per_connection = std::atoi(argv[++i]);
+            else if(flag == "--duration" && has_value)        duration = std::chrono::seconds(std::atoi(argv[++i]));
+            else if(flag == "--json" && has_value)            json_path = argv[++i];
+            else if(flag == "--tuning" && has_value)          tuning = SocketTuning::byName(argv[++i]);
+            else if(flag == "--transport" && has_value)       transport = argv[++i];
+            else if(flag == "--socket-path" && has_value)     socket_path = argv[++i];
+            else if(flag == "--framing" && has_value)
+                framing = std::string(argv[++i]) == "length" ? Framing::LengthPrefixed : Framing::Newline;
+            else rest.push_back(flag);
+        }
+
+        concurrency = std::max(1u, std::min(concurrency, connections));
+        depth = std::max(1u, depth);
+        request_size = std::max<std::size_t>(1, request_size);
+
+        return rest;
+    }
+
+    /* Options of one run per transport asked for, TCP first, unix runs with local_path set. */
+    std::vector<LoadOptions> transports() const
+    {
+        std::vector<LoadOptions> runs;
+
+        if(transport != "unix")
+        {
+            runs.push_back(*this);
+            runs.back().local_path.clear();
+        }
+
+        if(transport == "unix" || transport == "both")
+        {
+            runs.push_back(*this);
+            runs.back().local_path = socket_path;
+        }
+
+        return runs;
+    }
+
+    /* Endpoint load connects to. */
+    StreamEndpoint endpoint() const
+    {
+        return local_path.empty() ? tcpEndpoint(host, port) : localEndpoint(local_path);
+    }
+
+    /* Run label, unix runs are suffixed so both transports can be told apart. */
+    std::string label(const std::string &name) const
+    {
+        return local_path.empty() ? name : name + "/unix";
+    }
+};
+
+/*
+ * Totals from a load run.
+ */
+struct LoadResult
+{
+    std::string label;
+    LoadOptions options;
+    double seconds{0};
+    std::uint64_t requests{0};
+    std::uint64_t bytes{0};                              // sent plus received
+    std::uint64_t errors{0};
+    LatencyHistogram latency;                            // nanoseconds, send to response
+
+    double requestsPerSecond() const { return seconds > 0 ? requests / seconds : 0; }
+    double bytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+
+    /* Human readable summary. */
+    void print(std::ostream &os) const
+    {
+        os << std::fixed << std::setprecision(1)
+            << label << ": " << requests << " requests in " << seconds << "s, "
+            << requestsPerSecond() << " req/s, " << bytesPerSecond() / (1024 * 1024) << " MiB/s, "
+            << errors << " errors\n"
+            << "  latency us p50 " << latency.percentile(50) / 1000.0
+            << " p99 " << latency.percentile(99) / 1000.0
+            << " p999 " << latency.percentile(99.9) / 1000.0
+            << " max " << latency.max() / 1000.0 << std::endl;
+    }
+
+    /* Single line JSON object, one per run, for tracking regressions between versions. */
+    void printJson(std::ostream &os) const
+    {
+        os << "{\"label\":\"" << label << "\""
+            << ",\"connections\":" << options.connections
+            << ",\"concurrency\":" << options.concurrency
+            << ",\"request_size\":" << options.request_size
+            << ",\"framing\":\"" << (options.framing == Framing::Newline ? "newline" : "length") << "\""
+            << ",\"depth\":" << options.depth
+            << ",\"requests_per_connection\":" << options.requests_per_connection
+            << ",\"tuning\":\"" << options.tuning.name << "\""
+            << ",\"transport\":\"" << (options.local_path.empty() ? "tcp" : "unix") << "\""
+            << std::fixed << std::setprecision(3)
+            << ",\"seconds\":" << seconds
+            << ",\"requests\":" << requests
+            << ",\"errors\":" << errors
+            << ",\"requests_per_second\":" << requestsPerSecond()
+            << ",\"bytes_per_second\":" << bytesPerSecond()
+            << ",\"latency_ns\":{\"p50\":" << latency.percentile(50)
+            << ",\"p99\":" << latency.percentile(99)
+            << ",\"p999\":" << latency.percentile(99.9)
+            << ",\"max\":" << latency.max() << "}}" << std::endl;
+    }
+
+    /* Prints summary to stdout and appends JSON line to options.json_path, or stdout. */
+    void report() const
+    {
+        print(std::cout);
+
+        if(options.json_path.empty())
+        {
+            printJson(std::cout);
+            return;
+        }
+
+        std::ofstream out(options.json_path, std::ios::app);
+        printJson(out);
+    }
+};
+
+/*
+ * Closed loop load generator over blocking sockets. Each load thread owns a share of the
+ * connections; per round it writes depth framed requests to every connection,
+ * then reads the depth responses back, timing each request from its write to its response.
+ *
+ * @behavior: runs for options.duration, reconnecting after errors or after
+ *            requests_per_connection requests.
+ */
+class LoadGenerator {
+    private:
+        struct Connection
+        {
+            StreamSocket m_sock;
+            FrameBuffer m_buf;
+            unsigned int m_sent{0};
+
+            Connection(asio::io_service &ios, Framing framing): m_sock(ios), m_buf(framing) {}
+        };
+
+        struct ThreadResult
+        {
+            std::uint64_t m_requests{0};
+            std::uint64_t m_bytes{0};
+            std::uint64_t m_errors{0};
+            LatencyHistogram m_latency;
+        };
+
+        LoadOptions m_options;
+        std::string m_request;
+        StreamEndpoint m_ep;
+        std::atomic<bool> m_stop;
+
+        void reconnect(Connection &conn)
+        {
+            system::error_code ignored_ec;
+            conn.m_sock.close(ignored_ec);
+            conn.m_buf.clear();
+            conn.m_sent = 0;
+
+            // the generator itself never waits on Nagle, whatever the profile under test says;
+            // a Unix domain socket has no Nagle and refuses the option
+            conn.m_sock.open(m_ep.protocol());
+            tuneConnection(conn.m_sock, m_options.tuning, true);
+            conn.m_sock.connect(m_ep);
+            conn.m_sock.set_option(asio::ip::tcp::no_delay(true), ignored_ec);
+        }
+
+        void run(unsigned int connections, ThreadResult &result)
+        {
+            asio::io_service ios;
+            std::vector<std::unique_ptr<Connection>> conns;
+
+            std::string batch;
+            for(unsigned int i = 0; i < m_options.depth; ++i)
+                batch += m_request;
+
+            for(unsigned int i = 0; i < connections; ++i)
+                conns.emplace_back(new Connection(ios, m_options.framing));
+
+            std::vector<std::chrono::steady_clock::time_point> sent_at(connections);
+
+            while(!m_stop.load(std::memory_order_relaxed))
+            {
+                for(unsigned int i = 0; i < connections; ++i)
+                {
+                    Connection &conn = *conns[i];
+
+                    try
+                    {
+                        bool limit_hit = m_options.requests_per_connection != 0
+                            && conn.m_sent >= m_options.requests_per_connection;
+
+                        if(!conn.m_sock.is_open() || limit_hit)
+                            reconnect(conn);
+
+                        sent_at[i] = std::chrono::steady_clock::now();
+                        asio::write(conn.m_sock, asio::buffer(batch));
+                        conn.m_sent += m_options.depth;
+                        result.m_bytes += batch.size();
+                    }
+                    catch(system::system_error &)
+                    {
+                        ++result.m_errors;
+                        system::error_code ignored_ec;
+                        conn.m_sock.close(ignored_ec);
+                    }
+                }
+
+                for(unsigned int i = 0; i < connections; ++i)
+                {
+                    Connection &conn = *conns[i];
+                    if(!conn.m_sock.is_open())
+                        continue;
+
+                    try
+                    {
+                        for(unsigned int r = 0; r < m_options.depth; ++r)
+                        {
+                            std::size_t n = readFrame(conn.m_sock, conn.m_buf).size();
+
+                            auto elapsed = std::chrono::steady_clock::now() - sent_at[i];
+                            result.m_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+                            result.m_bytes += n;
+                            ++result.m_requests;
+                        }
+                    }
+                    catch(system::system_error &)
+                    {
+                        ++result.m_errors;
+                        system::error_code ignored_ec;
+                        conn.m_sock.close(ignored_ec);
+                    }
+                }
+            }
+        }
+
+    public:
+
+        /* Constructor */
+        LoadGenerator(const LoadOptions &options)
+            :m_options(options),
+            m_ep(options.endpoint()),
+            m_stop(false)
+        {
+            encodeFrame(options.framing, std::string(options.request_size, 'x'), m_request);
+        }
+
+        /*
+         * Drives server for options.duration and collects results.
+         *
+         * @param: {const std::string &} label: name the run is reported under.
+         */
+        LoadResult run(const std::string &label)
+        {
+            std::vector<ThreadResult> results(m_options.concurrency);
+            std::vector<std::unique_ptr<std::thread>> threads;
+
+            m_stop.store(false);
+            auto start = std::chrono::steady_clock::now();
+
+            for(unsigned int t = 0; t < m_options.concurrency; ++t)
+            {
+                // spread remainder over first threads
+                unsigned int share = m_options.connections / m_options.concurrency
+                    + (t < m_options.connections % m_options.concurrency ? 1 : 0);
+
+                threads.emplace_back(new std::thread([this, share, &results, t]()
+                            {
+                                run(share, results[t]);
+                            }));
+            }
+
+            std::this_thread::sleep_for(m_options.duration);
+            m_stop.store(true);
+
+            for(auto &thread: threads)
+                thread->join();
+
+            LoadResult total;
+            total.label = label;
+            total.options = m_options;
+            total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            for(auto &result: results)
+            {
+                total.requests += result.m_requests;
+                total.bytes += result.m_bytes;
+                total.errors += result.m_errors;
+                total.latency.merge(result.m_latency);
+            }
+
+            return total;
+        }
+};
+
+/*
+ * Prints how much faster the Unix domain socket run was than the loopback TCP run of the same server.
+ */
+inline void reportTransportGain(const LoadResult &tcp, const LoadResult &local)
+{
+    auto change = [](double from, double to) { return from > 0 ? (to - from) * 100.0 / from : 0.0; };
+
+    std::cout << std::fixed << std::setprecision(1)
+        << "  unix vs tcp: req/s " << std::showpos << change(tcp.requestsPerSecond(), local.requestsPerSecond())
+        << "%, latency p50 " << change(tcp.latency.percentile(50), local.latency.percentile(50))
+        << "% p99 " << change(tcp.latency.percentile(99), local.latency.percentile(99))
+        << "%" << std::noshowpos << std::endl;
+}
+
+/*
+ * Runs the load once per transport of options, starting a fresh server for each run.
+ * With --transport both the Unix domain socket's gain over loopback TCP is reported after.
+ *
+ * @param: {LoadOptions} options: load, and which transports to run.
+ *         {std::string} name: server under test, run labels are derived from it.
+ *         {Start} start: void(const LoadOptions &), starts the server on that run's endpoint.
+ *         {Stop} stop: void(), stops it once the run is over.
+ */
+template <typename Start, typename Stop>
+void runTransports(const LoadOptions &options, const std::string &name, Start start, Stop stop)
+{
+    std::vector<LoadResult> results;
+
+    for(const LoadOptions &run: options.transports())
+    {
+        start(run);
+
+        results.push_back(LoadGenerator(run).run(run.label(name)));
+        results.back().report();
+
+        stop();
+    }
+
+    if(results.size() == 2)
+        reportTransportGain(results[0], results[1]);
+}
+
+#endif // !BENCH_LOADGENERATOR
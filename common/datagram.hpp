@@ -0,0 +1,351 @@
+#ifndef NET_DATAGRAM
+#define NET_DATAGRAM
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+using namespace boost;
+
+/* Largest UDP payload over IPv4. */
+static constexpr std::size_t MAX_DATAGRAM_SIZE{65507};
+
+/*
+ * Receive side of batched datagram I/O: room for up to capacity datagrams, filled by a single
+ * recvmmsg on Linux, elsewhere by one recvfrom per datagram. Storage is allocated once and
+ * reused by every receive; datagrams are handed out as views into it.
+ *
+ * @behavior: not thread safe, a batch belongs to the socket that reads into it.
+ */
+class DatagramBatch : public asio::noncopyable {
+    private:
+        std::size_t m_max_datagram;
+        std::vector<char> m_storage;
+        std::vector<iovec> m_iov;
+        std::vector<sockaddr_storage> m_peers;
+#ifdef __linux__
+        std::vector<mmsghdr> m_msgs;
+#else
+        std::vector<std::size_t> m_sizes;
+        std::vector<socklen_t> m_peer_sizes;
+#endif
+        std::size_t m_count;
+
+    public:
+
+        /* Constructor, datagrams over max_datagram are truncated. */
+        DatagramBatch(std::size_t capacity, std::size_t max_datagram = MAX_DATAGRAM_SIZE)
+            :m_max_datagram(max_datagram),
+            m_storage(capacity * max_datagram),
+            m_iov(capacity),
+            m_peers(capacity),
+#ifdef __linux__
+            m_msgs(capacity),
+#else
+            m_sizes(capacity),
+            m_peer_sizes(capacity),
+#endif
+            m_count(0)
+        {
+            for(std::size_t i = 0; i < capacity; ++i)
+            {
+                m_iov[i].iov_base = m_storage.data() + i * max_datagram;
+                m_iov[i].iov_len = max_datagram;
+            }
+        }
+
+        std::size_t capacity() const { return m_iov.size(); }
+
+        /* Datagrams filled by the last receive. */
+        std::size_t size() const { return m_count; }
+
+        /*
+         * Reads as many datagrams as are queued, up to capacity.
+         *
+         * @param: {int} fd: datagram socket.
+         *         {bool} wait: block until at least one datagram arrives, else return at once.
+         *         {system::error_code &} ec: would_block if nothing was queued (or SO_RCVTIMEO passed),
+         *                                    or the socket error.
+         *         {std::size_t} limit: read at most this many, if less than capacity.
+         *
+         * @return: datagrams received, also size().
+         */
+        std::size_t receive(int fd, bool wait, system::error_code &ec, std::size_t limit = SIZE_MAX)
+        {
+            ec = system::error_code();
+            m_count = 0;
+            limit = std::min(limit, m_iov.size());
+
+#ifdef __linux__
+            for(std::size_t i = 0; i < limit; ++i)
+            {
+                std::memset(&m_msgs[i].msg_hdr, 0, sizeof(msghdr));
+                m_msgs[i].msg_hdr.msg_iov = &m_iov[i];
+                m_msgs[i].msg_hdr.msg_iovlen = 1;
+                m_msgs[i].msg_hdr.msg_name = &m_peers[i];
+                m_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            }
+
+            int n = ::recvmmsg(fd, m_msgs.data(), limit, wait ? MSG_WAITFORONE : MSG_DONTWAIT, nullptr);
+            if(n < 0)
+            {
+                ec = system::error_code(errno, system::system_category());
+                return 0;
+            }
+
+            m_count = static_cast<std::size_t>(n);
+#else
+            int flags = wait ? 0 : MSG_DONTWAIT;
+
+            while(m_count < limit)
+            {
+                m_peer_sizes[m_count] = sizeof(sockaddr_storage);
+                ssize_t n = ::recvfrom(fd, m_iov[m_count].iov_base, m_max_datagram, flags,
+                        reinterpret_cast<sockaddr *>(&m_peers[m_count]), &m_peer_sizes[m_count]);
+                if(n < 0)
+                {
+                    if(m_count == 0)
+                        ec = system::error_code(errno, system::system_category());
+                    break;
+                }
+
+                m_sizes[m_count++] = static_cast<std::size_t>(n);
+                flags = MSG_DONTWAIT;
+            }
+#endif
+
+            return m_count;
+        }
+
+        /* Payload of datagram i, valid until the next receive. */
+        std::string_view data(std::size_t i) const
+        {
+#ifdef __linux__
+            std::size_t size = m_msgs[i].msg_len;
+#else
+            std::size_t size = m_sizes[i];
+#endif
+            return std::string_view(static_cast<const char *>(m_iov[i].iov_base), std::min(size, m_max_datagram));
+        }
+
+        /* Datagram i was longer than max_datagram and lost its tail. */
+        bool truncated(std::size_t i) const
+        {
+#ifdef __linux__
+            return (m_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+#else
+            return m_sizes[i] > m_max_datagram;
+#endif
+        }
+
+        /* Sender of datagram i. */
+        const sockaddr *peer(std::size_t i) const { return reinterpret_cast<const sockaddr *>(&m_peers[i]); }
+
+        socklen_t peerSize(std::size_t i) const
+        {
+#ifdef __linux__
+            return m_msgs[i].msg_hdr.msg_namelen;
+#else
+            return m_peer_sizes[i];
+#endif
+        }
+};
+
+/*
+ * Send side of batched datagram I/O: payloads are appended into one buffer, each with its
+ * destination, and go out in a single sendmmsg on Linux, elsewhere one sendto per datagram.
+ * Storage grows to the biggest batch seen and is reused.
+ *
+ * @behavior: not thread safe.
+ */
+class DatagramQueue : public asio::noncopyable {
+    private:
+        struct Entry
+        {
+            std::size_t m_offset;
+            std::size_t m_size;
+            sockaddr_storage m_peer;
+            socklen_t m_peer_size;                       // zero on a connected socket
+        };
+
+        std::string m_data;
+        std::vector<Entry> m_entries;
+        std::vector<iovec> m_iov;
+#ifdef __linux__
+        std::vector<mmsghdr> m_msgs;
+#endif
+        std::size_t m_sent;                              // entries already sent by earlier calls
+
+    public:
+
+        DatagramQueue()
+            :m_sent(0)
+        {}
+
+        /* Datagrams queued and not sent yet. */
+        std::size_t size() const { return m_entries.size() - m_sent; }
+
+        /* Payload bytes queued and not sent yet. */
+        std::size_t bytes() const
+        {
+            return m_sent < m_entries.size() ? m_data.size() - m_entries[m_sent].m_offset : 0;
+        }
+
+        void clear()
+        {
+            m_data.clear();
+            m_entries.clear();
+            m_sent = 0;
+        }
+
+        /*
+         * Starts a new datagram, its payload is whatever the caller appends to the returned buffer
+         * before the next push or send. Lets a handler write its reply in place, without a copy.
+         *
+         * @param: {const sockaddr *} peer: destination, null on a connected socket.
+         *         {socklen_t} peer_size: size of peer.
+         *
+         * @return: buffer to append the payload to, valid until the next push or send.
+         */
+        std::string &push(const sockaddr *peer = nullptr, socklen_t peer_size = 0)
+        {
+            Entry entry;
+            entry.m_offset = m_data.size();
+            entry.m_size = 0;
+            entry.m_peer_size = peer == nullptr ? 0 : peer_size;
+            if(peer != nullptr)
+                std::memcpy(&entry.m_peer, peer, peer_size);
+
+            m_entries.push_back(entry);
+            return m_data;
+        }
+
+        /* Appends payload as one datagram. */
+        void push(std::string_view payload, const sockaddr *peer = nullptr, socklen_t peer_size = 0)
+        {
+            push(peer, peer_size).append(payload.data(), payload.size());
+        }
+
+        /*
+         * Sends queued datagrams, the ones the socket buffer does not take stay queued. A datagram
+         * the socket refuses for any other reason, such as an unreachable peer, is skipped so the
+         * rest of the batch still goes out.
+         *
+         * @param: {int} fd: datagram socket.
+         *         {bool} wait: block until every datagram is sent, else return once the socket is full.
+         *         {system::error_code &} ec: would_block if the socket buffer is full, else the
+         *                                   error of the first datagram skipped.
+         *
+         * @return: datagrams sent by this call, skipped ones not counted.
+         */
+        std::size_t send(int fd, bool wait, system::error_code &ec)
+        {
+            ec = system::error_code();
+
+            // sizes are only known once the last payload is appended
+            for(std::size_t i = 0; i + 1 < m_entries.size(); ++i)
+                m_entries[i].m_size = m_entries[i + 1].m_offset - m_entries[i].m_offset;
+            if(!m_entries.empty())
+                m_entries.back().m_size = m_data.size() - m_entries.back().m_offset;
+
+            m_iov.resize(m_entries.size());
+            for(std::size_t i = m_sent; i < m_entries.size(); ++i)
+            {
+                m_iov[i].iov_base = &m_data[m_entries[i].m_offset];
+                m_iov[i].iov_len = m_entries[i].m_size;
+            }
+
+            std::size_t started = m_sent;
+            std::size_t skipped = 0;
+            int flags = wait ? 0 : MSG_DONTWAIT;
+
+#ifdef __linux__
+            m_msgs.resize(m_entries.size());
+            for(std::size_t i = m_sent; i < m_entries.size(); ++i)
+            {
+                std::memset(&m_msgs[i].msg_hdr, 0, sizeof(msghdr));
+                m_msgs[i].msg_hdr.msg_iov = &m_iov[i];
+                m_msgs[i].msg_hdr.msg_iovlen = 1;
+                if(m_entries[i].m_peer_size != 0)
+                {
+                    m_msgs[i].msg_hdr.msg_name = &m_entries[i].m_peer;
+                    m_msgs[i].msg_hdr.msg_namelen = m_entries[i].m_peer_size;
+                }
+            }
+
+            // sendmmsg stops early when the socket buffer fills, a blocking send then goes again
+            while(m_sent < m_entries.size())
+            {
+                int n = ::sendmmsg(fd, m_msgs.data() + m_sent, m_entries.size() - m_sent, flags);
+                if(n < 0)
+                {
+                    if(errno == EINTR)
+                        continue;
+
+                    if(errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        ec = asio::error::would_block;
+                        break;
+                    }
+
+                    // the datagram at m_sent failed, the ones after it may still go
+                    if(!ec)
+                        ec = system::error_code(errno, system::system_category());
+
+                    ++m_sent;
+                    ++skipped;
+                    continue;
+                }
+
+                m_sent += static_cast<std::size_t>(n);
+            }
+#else
+            while(m_sent < m_entries.size())
+            {
+                const Entry &entry = m_entries[m_sent];
+                ssize_t n = ::sendto(fd, m_iov[m_sent].iov_base, m_iov[m_sent].iov_len, flags,
+                        entry.m_peer_size != 0 ? reinterpret_cast<const sockaddr *>(&entry.m_peer) : nullptr,
+                        entry.m_peer_size);
+                if(n < 0)
+                {
+                    if(errno == EINTR)
+                        continue;
+
+                    if(errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        ec = asio::error::would_block;
+                        break;
+                    }
+
+                    // the datagram at m_sent failed, the ones after it may still go
+                    if(!ec)
+                        ec = system::error_code(errno, system::system_category());
+
+                    ++m_sent;
+                    ++skipped;
+                    continue;
+                }
+
+                ++m_sent;
+            }
+#endif
+
+            std::size_t sent = m_sent - started - skipped;
+            if(m_sent == m_entries.size())
+                clear();
+
+            return sent;
+        }
+};
+
+#endif // !NET_DATAGRAM
@@ -0,0 +1,303 @@
+#ifndef NET_FRAMING
+#define NET_FRAMING
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "recyclingallocator.hpp"
+
+using namespace boost;
+
+/*
+ * How messages are delimited on the wire.
+ *
+ * Newline: message ends with '\n', every byte is scanned. Kept for compatibility.
+ * LengthPrefixed: 4 byte big endian payload length followed by the payload, may carry binary data.
+ */
+enum class Framing
+{
+    Newline,
+    LengthPrefixed
+};
+
+static constexpr std::size_t FRAME_HEADER_SIZE{4};
+static constexpr std::size_t DEFAULT_MAX_FRAME_SIZE{64 * 1024};
+
+/* Writes the big endian length prefix of a size byte payload to header, FRAME_HEADER_SIZE bytes. */
+inline void writeFrameHeader(std::size_t size, char *header)
+{
+    std::uint32_t length = static_cast<std::uint32_t>(size);
+    header[0] = static_cast<char>(length >> 24);
+    header[1] = static_cast<char>(length >> 16);
+    header[2] = static_cast<char>(length >> 8);
+    header[3] = static_cast<char>(length);
+}
+
+/*
+ * Appends payload to out as a single frame.
+ *
+ * @param: {Framing} framing: wire format.
+ *         {std::string_view} payload: message, without delimiter.
+ *         {std::string &} out: frame is appended here.
+ */
+inline void encodeFrame(Framing framing, std::string_view payload, std::string &out)
+{
+    if(framing == Framing::Newline)
+    {
+        out.append(payload.data(), payload.size());
+        out.push_back('\n');
+        return;
+    }
+
+    char header[FRAME_HEADER_SIZE];
+    writeFrameHeader(payload.size(), header);
+
+    out.append(header, FRAME_HEADER_SIZE);
+    out.append(payload.data(), payload.size());
+}
+
+/*
+ * Starts a frame at the end of out for a payload appended in place, saving the copy encodeFrame
+ * makes; the payload is whatever is appended to out until endFrame.
+ *
+ * @return: where the frame starts, to hand to endFrame.
+ */
+inline std::size_t beginFrame(Framing framing, std::string &out)
+{
+    std::size_t start = out.size();
+
+    if(framing == Framing::LengthPrefixed)
+        out.append(FRAME_HEADER_SIZE, '\0');
+
+    return start;
+}
+
+/* Completes the frame beginFrame started at start: fills in its header or appends the delimiter. */
+inline void endFrame(Framing framing, std::string &out, std::size_t start)
+{
+    if(framing == Framing::Newline)
+    {
+        out.push_back('\n');
+        return;
+    }
+
+    writeFrameHeader(out.size() - start - FRAME_HEADER_SIZE, &out[start]);
+}
+
+/*
+ * Multiplexed connections carry many requests at once; every frame payload then starts with the
+ * 4 byte big endian request id it belongs to, so responses may come back in any order. The id is
+ * binary, so tagged frames are always length prefixed.
+ */
+static constexpr std::size_t REQUEST_ID_SIZE{4};
+
+/*
+ * Appends payload to out as a length prefixed frame tagged with request id.
+ *
+ * @param: {std::uint32_t} id: request id.
+ *         {std::string_view} payload: message.
+ *         {std::string &} out: frame is appended here.
+ */
+inline void encodeTaggedFrame(std::uint32_t id, std::string_view payload, std::string &out)
+{
+    std::uint32_t size = static_cast<std::uint32_t>(REQUEST_ID_SIZE + payload.size());
+    char header[FRAME_HEADER_SIZE + REQUEST_ID_SIZE] = {
+        static_cast<char>(size >> 24), static_cast<char>(size >> 16),
+        static_cast<char>(size >> 8), static_cast<char>(size),
+        static_cast<char>(id >> 24), static_cast<char>(id >> 16),
+        static_cast<char>(id >> 8), static_cast<char>(id)
+    };
+
+    out.append(header, sizeof(header));
+    out.append(payload.data(), payload.size());
+}
+
+/* beginFrame for a tagged frame, the id is written now and the length by endTaggedFrame. */
+inline std::size_t beginTaggedFrame(std::uint32_t id, std::string &out)
+{
+    std::size_t start = beginFrame(Framing::LengthPrefixed, out);
+
+    char tag[REQUEST_ID_SIZE] = {
+        static_cast<char>(id >> 24), static_cast<char>(id >> 16),
+        static_cast<char>(id >> 8), static_cast<char>(id)
+    };
+    out.append(tag, REQUEST_ID_SIZE);
+
+    return start;
+}
+
+inline void endTaggedFrame(std::string &out, std::size_t start)
+{
+    endFrame(Framing::LengthPrefixed, out, start);
+}
+
+/*
+ * Splits a tagged frame payload into request id and message.
+ *
+ * @return: false if frame is too short to carry an id.
+ */
+inline bool splitTaggedFrame(std::string_view frame, std::uint32_t &id, std::string_view &payload)
+{
+    if(frame.size() < REQUEST_ID_SIZE)
+        return false;
+
+    const unsigned char *h = reinterpret_cast<const unsigned char *>(frame.data());
+    id = (std::uint32_t(h[0]) << 24) | (std::uint32_t(h[1]) << 16) | (std::uint32_t(h[2]) << 8) | std::uint32_t(h[3]);
+    payload = frame.substr(REQUEST_ID_SIZE);
+
+    return true;
+}
+
+/*
+ * Reusable, per connection, receive buffer that splits incoming bytes into frames in place.
+ * Storage starts small and grows, up to the biggest allowed frame, only when a frame does not
+ * fit; once sized it is reused for every message. Reads go straight into it and frames are
+ * handed out as views into it, so a message is never copied on the read path.
+ * Several frames received by one read (pipelining) are returned one after another.
+ *
+ * @behavior: prepare/commit around each read, then call nextFrame until it returns false.
+ */
+class FrameBuffer {
+    private:
+        Framing m_framing;
+        std::size_t m_max_frame;
+        std::vector<char, RecyclingAllocator<char>> m_data;
+        std::size_t m_begin;                             // first unconsumed byte
+        std::size_t m_end;                               // one past last received byte
+
+    public:
+
+        /* Constructor */
+        FrameBuffer(Framing framing = Framing::Newline, std::size_t max_frame = DEFAULT_MAX_FRAME_SIZE,
+                    std::size_t initial_size = 4096)
+            :m_framing(framing),
+            m_max_frame(max_frame),
+            m_data(std::min(initial_size, max_frame + FRAME_HEADER_SIZE)),
+            m_begin(0),
+            m_end(0)
+        {}
+
+        Framing framing() const { return m_framing; }
+
+        /* Bytes received but not yet returned as frames. */
+        std::size_t size() const { return m_end - m_begin; }
+
+        /*
+         * Free space to read into; moves a partial frame to the front first and grows the
+         * storage if the partial frame fills it.
+         */
+        asio::mutable_buffer prepare()
+        {
+            if(m_begin == m_end)
+            {
+                m_begin = m_end = 0;
+            }
+            else if(m_end == m_data.size())
+            {
+                std::memmove(m_data.data(), m_data.data() + m_begin, m_end - m_begin);
+                m_end -= m_begin;
+                m_begin = 0;
+            }
+
+            if(m_end == m_data.size())
+                m_data.resize(std::min(m_data.size() * 2, m_max_frame + FRAME_HEADER_SIZE));
+
+            return asio::buffer(m_data.data() + m_end, m_data.size() - m_end);
+        }
+
+        /* Marks n bytes, read into the buffer returned by prepare, as received. */
+        void commit(std::size_t n)
+        {
+            m_end += n;
+        }
+
+        /*
+         * Extracts next complete frame. The view stays valid until the next prepare.
+         *
+         * @param: {std::string_view &} frame: payload without header or delimiter.
+         *         {system::error_code &} ec: set to message_size if frame exceeds max frame size.
+         *
+         * @return: true if a complete frame was extracted.
+         */
+        bool nextFrame(std::string_view &frame, system::error_code &ec)
+        {
+            const char *data = m_data.data() + m_begin;
+            std::size_t available = m_end - m_begin;
+
+            if(m_framing == Framing::Newline)
+            {
+                const char *nl = static_cast<const char *>(std::memchr(data, '\n', available));
+                if(nl == nullptr)
+                {
+                    if(available > m_max_frame)
+                        ec = asio::error::message_size;
+
+                    return false;
+                }
+
+                frame = std::string_view(data, nl - data);
+                m_begin += frame.size() + 1;
+                return true;
+            }
+
+            if(available < FRAME_HEADER_SIZE)
+                return false;
+
+            const unsigned char *h = reinterpret_cast<const unsigned char *>(data);
+            std::size_t size = (std::size_t(h[0]) << 24) | (std::size_t(h[1]) << 16)
+                | (std::size_t(h[2]) << 8) | std::size_t(h[3]);
+
+            if(size > m_max_frame)
+            {
+                ec = asio::error::message_size;
+                return false;
+            }
+
+            if(available < FRAME_HEADER_SIZE + size)
+                return false;
+
+            frame = std::string_view(data + FRAME_HEADER_SIZE, size);
+            m_begin += FRAME_HEADER_SIZE + size;
+            return true;
+        }
+
+        /* Drops all buffered bytes. */
+        void clear()
+        {
+            m_begin = m_end = 0;
+        }
+};
+
+/*
+ * Blocking read of one frame, reads from stream only if no complete frame is buffered.
+ *
+ * @param: {SyncReadStream &} stream: socket to read from.
+ *         {FrameBuffer &} buf: connection's receive buffer.
+ *
+ * @return: frame payload, valid until the next read on buf.
+ * @throws: system::system_error on read error, EOF or oversized frame.
+ */
+template <typename SyncReadStream>
+std::string_view readFrame(SyncReadStream &stream, FrameBuffer &buf)
+{
+    std::string_view frame;
+    system::error_code ec;
+
+    while(!buf.nextFrame(frame, ec))
+    {
+        if(ec)
+            throw system::system_error(ec);
+
+        buf.commit(stream.read_some(buf.prepare()));
+    }
+
+    return frame;
+}
+
+#endif // !NET_FRAMING
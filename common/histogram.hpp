@@ -0,0 +1,109 @@
+#ifndef NET_HISTOGRAM
+#define NET_HISTOGRAM
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * HDR style latency histogram: values are bucketed by power of two, each power of two split
+ * into SUB_BUCKETS linear sub buckets, giving 2^-SubBucketBits relative error (~1.5% for the
+ * default) over the whole 64 bit range with fixed memory. Not thread safe, each thread records
+ * into its own and they are merged.
+ */
+template <unsigned int SubBucketBits>
+class BasicLatencyHistogram {
+    private:
+        static constexpr unsigned int SUB_BUCKET_BITS{SubBucketBits};
+        static constexpr std::uint64_t SUB_BUCKETS{1u << SUB_BUCKET_BITS};
+
+        std::array<std::uint64_t, 64 * SUB_BUCKETS> m_counts{};
+        std::uint64_t m_total{0};
+        std::uint64_t m_max{0};
+
+    public:
+        static constexpr std::size_t BUCKETS{64 * SUB_BUCKETS};
+
+        /* Bucket a value is counted in. */
+        static std::size_t indexOf(std::uint64_t value)
+        {
+            if(value < SUB_BUCKETS)
+                return value;
+
+            unsigned int msb = 63 - __builtin_clzll(value);
+            unsigned int shift = msb - SUB_BUCKET_BITS;
+            std::uint64_t sub = (value >> shift) & (SUB_BUCKETS - 1);
+
+            return (shift + 1) * SUB_BUCKETS + sub;
+        }
+
+        /* Upper bound of values that land in bucket index. */
+        static std::uint64_t valueOf(std::size_t index)
+        {
+            if(index < SUB_BUCKETS)
+                return index;
+
+            std::size_t shift = index / SUB_BUCKETS - 1;
+            std::uint64_t sub = index % SUB_BUCKETS;
+
+            return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+        }
+
+        void record(std::uint64_t value)
+        {
+            ++m_counts[indexOf(value)];
+            ++m_total;
+            m_max = std::max(m_max, value);
+        }
+
+        /* Adds count values already bucketed elsewhere, e.g. by a per thread recorder. */
+        void add(std::size_t index, std::uint64_t count)
+        {
+            m_counts[index] += count;
+            m_total += count;
+
+            if(count != 0)
+                m_max = std::max(m_max, valueOf(index));
+        }
+
+        void merge(const BasicLatencyHistogram &other)
+        {
+            for(std::size_t i = 0; i < m_counts.size(); ++i)
+                m_counts[i] += other.m_counts[i];
+
+            m_total += other.m_total;
+            m_max = std::max(m_max, other.m_max);
+        }
+
+        /*
+         * @param: {double} percentile: in range [0, 100].
+         *
+         * @return: value at or above given percentile of recorded values, 0 if empty.
+         */
+        std::uint64_t percentile(double percentile) const
+        {
+            if(m_total == 0)
+                return 0;
+
+            std::uint64_t target = static_cast<std::uint64_t>(percentile / 100.0 * m_total + 0.5);
+            target = std::max<std::uint64_t>(1, std::min(target, m_total));
+
+            std::uint64_t seen{0};
+            for(std::size_t i = 0; i < m_counts.size(); ++i)
+            {
+                seen += m_counts[i];
+                if(seen >= target)
+                    return std::min(valueOf(i), m_max);
+            }
+
+            return m_max;
+        }
+
+        std::uint64_t count() const { return m_total; }
+        std::uint64_t max() const { return m_max; }
+};
+
+typedef BasicLatencyHistogram<6> LatencyHistogram;
+
+#endif // !NET_HISTOGRAM
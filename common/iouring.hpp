@@ -0,0 +1,406 @@
+#ifndef NET_IOURING
+#define NET_IOURING
+
+/*
+ * io_uring is driven through its raw system calls, no liburing needed; only the kernel uapi
+ * header is, and one from 6.0 or later. Everything below is compiled only where that header
+ * exists, check NET_HAS_IO_URING; older headers build the reactor alone. The buffer ring
+ * register opcode is an enumerator, not a macro, the flags checked came with or after it.
+ */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_SETUP_SINGLE_ISSUER) && defined(IORING_SETUP_COOP_TASKRUN) && \
+    defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define NET_HAS_IO_URING 1
+#endif
+#endif
+#endif
+
+/*
+ * What waits for socket readiness and runs the reads and writes, ServerOptions::backend and
+ * ClientOptions::backend.
+ *
+ * Reactor: asio's epoll reactor, one system call per readiness event plus one per read or write.
+ * IoUring: Linux io_uring, one ring and thread per server shard or client thread (see
+ *          UringAcceptor and UringConnector); submissions and completions are batched and
+ *          receives draw from a provided buffer ring, the server's accept and receive are
+ *          multishot. Falls back to Reactor where the kernel or build lacks io_uring, and with
+ *          options it does not implement: compute_threads, multiplexed or local_path on the
+ *          server, multiplexed or shared_memory on the client.
+ */
+enum class IoBackend
+{
+    Reactor,
+    IoUring
+};
+
+#ifdef NET_HAS_IO_URING
+
+#include <boost/asio.hpp>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace boost;
+
+/*
+ * One io_uring instance: a submission and a completion queue shared with the kernel.
+ * Submissions are queued with sqe() and handed over in one go by submit(), which also waits
+ * for completions; every completion the kernel has posted is then drained by completions().
+ * So a batch of reads, writes and accepts costs a single system call, not one per operation.
+ *
+ * @behavior: not thread safe, a ring belongs to the thread that runs it.
+ */
+class IoUring : public asio::noncopyable {
+    private:
+        int m_fd;
+        io_uring_params m_params;
+
+        void *m_sq_map;
+        std::size_t m_sq_map_size;
+        void *m_cq_map;
+        std::size_t m_cq_map_size;
+        io_uring_sqe *m_sqes;
+        std::size_t m_sqes_size;
+
+        unsigned *m_sq_head;
+        unsigned *m_sq_tail;
+        unsigned m_sq_mask;
+        unsigned m_sq_entries;
+        unsigned *m_sq_array;
+        unsigned m_sq_local_tail;                        // queued by sqe(), published by submit()
+
+        unsigned *m_cq_head;
+        unsigned *m_cq_tail;
+        unsigned m_cq_mask;
+        io_uring_cqe *m_cqes;
+
+        static int setup(unsigned entries, io_uring_params &params)
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        }
+
+        static void throwErrno(int err)
+        {
+            throw system::system_error(system::error_code(err, system::system_category()));
+        }
+
+        void unmap()
+        {
+            if(m_sqes != nullptr)
+                ::munmap(m_sqes, m_sqes_size);
+            if(m_cq_map != nullptr && m_cq_map != m_sq_map)
+                ::munmap(m_cq_map, m_cq_map_size);
+            if(m_sq_map != nullptr)
+                ::munmap(m_sq_map, m_sq_map_size);
+            if(m_fd >= 0)
+                ::close(m_fd);
+        }
+
+    public:
+
+        /*
+         * Constructor
+         *
+         * @param: {unsigned} entries: submission queue size, the completion queue is twice that.
+         * @throws: system::system_error if the kernel refuses the ring.
+         */
+        IoUring(unsigned entries)
+            :m_fd(-1),
+            m_sq_map(nullptr),
+            m_cq_map(nullptr),
+            m_sqes(nullptr),
+            m_sq_local_tail(0)
+        {
+            // a ring is only ever touched by its own thread, let the kernel skip the locking
+            std::memset(&m_params, 0, sizeof(m_params));
+            m_params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+            m_fd = setup(entries, m_params);
+
+            if(m_fd < 0 && errno == EINVAL)
+            {
+                std::memset(&m_params, 0, sizeof(m_params));
+                m_fd = setup(entries, m_params);
+            }
+
+            if(m_fd < 0)
+                throwErrno(errno);
+
+            m_sq_map_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+            m_cq_map_size = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+
+            if(m_params.features & IORING_FEAT_SINGLE_MMAP)
+                m_sq_map_size = m_cq_map_size = std::max(m_sq_map_size, m_cq_map_size);
+
+            m_sq_map = ::mmap(nullptr, m_sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_fd, IORING_OFF_SQ_RING);
+            if(m_sq_map == MAP_FAILED)
+            {
+                int err = errno;
+                m_sq_map = nullptr;
+                unmap();
+                throwErrno(err);
+            }
+
+            m_cq_map = m_sq_map;
+            if(!(m_params.features & IORING_FEAT_SINGLE_MMAP))
+            {
+                m_cq_map = ::mmap(nullptr, m_cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_fd, IORING_OFF_CQ_RING);
+                if(m_cq_map == MAP_FAILED)
+                {
+                    int err = errno;
+                    m_cq_map = nullptr;
+                    unmap();
+                    throwErrno(err);
+                }
+            }
+
+            m_sqes_size = m_params.sq_entries * sizeof(io_uring_sqe);
+            void *sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_fd, IORING_OFF_SQES);
+            if(sqes == MAP_FAILED)
+            {
+                int err = errno;
+                unmap();
+                throwErrno(err);
+            }
+            m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+            char *sq = static_cast<char *>(m_sq_map);
+            m_sq_head = reinterpret_cast<unsigned *>(sq + m_params.sq_off.head);
+            m_sq_tail = reinterpret_cast<unsigned *>(sq + m_params.sq_off.tail);
+            m_sq_mask = *reinterpret_cast<unsigned *>(sq + m_params.sq_off.ring_mask);
+            m_sq_entries = *reinterpret_cast<unsigned *>(sq + m_params.sq_off.ring_entries);
+            m_sq_array = reinterpret_cast<unsigned *>(sq + m_params.sq_off.array);
+            m_sq_local_tail = *m_sq_tail;
+
+            char *cq = static_cast<char *>(m_cq_map);
+            m_cq_head = reinterpret_cast<unsigned *>(cq + m_params.cq_off.head);
+            m_cq_tail = reinterpret_cast<unsigned *>(cq + m_params.cq_off.tail);
+            m_cq_mask = *reinterpret_cast<unsigned *>(cq + m_params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<io_uring_cqe *>(cq + m_params.cq_off.cqes);
+        }
+
+        /* Closing the ring cancels whatever is still in flight. */
+        ~IoUring()
+        {
+            unmap();
+        }
+
+        int fd() const { return m_fd; }
+
+        /*
+         * Next free submission entry, zeroed; queued until the next submit().
+         *
+         * @return: nullptr if the submission queue is full, submit() and retry.
+         */
+        io_uring_sqe *sqe()
+        {
+            unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+            if(m_sq_local_tail - head >= m_sq_entries)
+                return nullptr;
+
+            unsigned index = m_sq_local_tail & m_sq_mask;
+            io_uring_sqe *entry = &m_sqes[index];
+            std::memset(entry, 0, sizeof(*entry));
+
+            m_sq_array[index] = index;
+            ++m_sq_local_tail;
+
+            return entry;
+        }
+
+        /*
+         * Hands every queued entry to the kernel and waits for at least wait_for completions.
+         *
+         * @return: entries submitted, or -errno; EINTR and EBUSY are worth retrying.
+         */
+        int submit(unsigned wait_for = 0)
+        {
+            unsigned pending = m_sq_local_tail - *m_sq_tail;
+            __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+
+            if(pending == 0 && wait_for == 0)
+                return 0;
+
+            int n = static_cast<int>(::syscall(__NR_io_uring_enter, m_fd, pending, wait_for,
+                        wait_for ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+
+            return n < 0 ? -errno : n;
+        }
+
+        /*
+         * Calls handler on every posted completion, then releases them all to the kernel.
+         *
+         * @param: {Handler} handler: void(const io_uring_cqe &), may queue new submissions.
+         * @return: completions handled.
+         */
+        template <typename Handler>
+        unsigned completions(Handler &&handler)
+        {
+            unsigned head = *m_cq_head;
+            unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+
+            for(unsigned i = head; i != tail; ++i)
+                handler(m_cqes[i & m_cq_mask]);
+
+            __atomic_store_n(m_cq_head, tail, __ATOMIC_RELEASE);
+            return tail - head;
+        }
+
+        /*
+         * Whether this kernel has everything the io_uring backend relies on: ring setup, provided
+         * buffer rings, and the accept, connect, receive, send, read, timeout and cancel operations.
+         */
+        static bool supported();
+};
+
+/*
+ * Provided buffer ring: a pool of equal sized receive buffers the kernel picks from itself when
+ * a receive completes, so a connection holds no buffer while it waits for data. The completion
+ * names the buffer it filled (bufferId); once its bytes are consumed the buffer goes back to
+ * the kernel with recycle().
+ *
+ * @behavior: count must be a power of two; unregistered on destruction, before the ring goes.
+ */
+class ProvidedBuffers : public asio::noncopyable {
+    private:
+        IoUring &m_ring;
+        std::uint16_t m_group;
+        unsigned m_count;
+        std::size_t m_size;
+        std::size_t m_ring_size;
+        io_uring_buf *m_bufs;                            // the ring, see ProvidedBuffers()
+        std::vector<char> m_storage;
+        std::uint16_t m_tail;                            // local copy, published by recycle()
+
+        void add(std::uint16_t id)
+        {
+            io_uring_buf &buf = m_bufs[m_tail & (m_count - 1)];
+            buf.addr = reinterpret_cast<std::uint64_t>(m_storage.data() + id * m_size);
+            buf.len = static_cast<std::uint32_t>(m_size);
+            buf.bid = id;
+            ++m_tail;
+        }
+
+        void publish()
+        {
+            // the ring tail overlays the first entry's resv field
+            __atomic_store_n(&m_bufs[0].resv, m_tail, __ATOMIC_RELEASE);
+        }
+
+    public:
+
+        /*
+         * Constructor
+         *
+         * @param: {IoUring &} ring: ring the buffers are registered with.
+         *         {std::uint16_t} group: buffer group id receives select from.
+         *         {unsigned} count: buffers, power of two up to 32768.
+         *         {std::size_t} size: bytes per buffer.
+         * @throws: system::system_error if registration fails.
+         */
+        ProvidedBuffers(IoUring &ring, std::uint16_t group, unsigned count, std::size_t size)
+            :m_ring(ring),
+            m_group(group),
+            m_count(count),
+            m_size(size),
+            m_ring_size(count * sizeof(io_uring_buf)),
+            m_storage(count * size),
+            m_tail(0)
+        {
+            void *mem = ::mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(mem == MAP_FAILED)
+                throw system::system_error(system::error_code(errno, system::system_category()));
+
+            // io_uring_buf_ring is not used: in C++ its flexible array member lands one entry
+            // further than the kernel expects, the empty struct in front of it takes space
+            m_bufs = static_cast<io_uring_buf *>(mem);
+
+            io_uring_buf_reg reg;
+            std::memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = reinterpret_cast<std::uint64_t>(mem);
+            reg.ring_entries = count;
+            reg.bgid = group;
+
+            if(::syscall(__NR_io_uring_register, m_ring.fd(), IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+            {
+                int err = errno;
+                ::munmap(mem, m_ring_size);
+                throw system::system_error(system::error_code(err, system::system_category()));
+            }
+
+            for(unsigned id = 0; id < count; ++id)
+                add(static_cast<std::uint16_t>(id));
+            publish();
+        }
+
+        ~ProvidedBuffers()
+        {
+            io_uring_buf_reg reg;
+            std::memset(&reg, 0, sizeof(reg));
+            reg.bgid = m_group;
+
+            ::syscall(__NR_io_uring_register, m_ring.fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            ::munmap(m_bufs, m_ring_size);
+        }
+
+        std::uint16_t group() const { return m_group; }
+
+        /* Buffer a receive completion filled. */
+        static std::uint16_t bufferId(const io_uring_cqe &cqe)
+        {
+            return static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+
+        const char *data(std::uint16_t id) const { return m_storage.data() + id * m_size; }
+
+        /* Gives buffer back to the kernel. */
+        void recycle(std::uint16_t id)
+        {
+            add(id);
+            publish();
+        }
+};
+
+inline bool IoUring::supported()
+{
+    try
+    {
+        IoUring ring(4);
+
+        std::vector<char> storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+
+        if(::syscall(__NR_io_uring_register, ring.fd(), IORING_REGISTER_PROBE, probe, 256) < 0)
+            return false;
+
+        for(unsigned op: {IORING_OP_ACCEPT, IORING_OP_CONNECT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ,
+                    IORING_OP_TIMEOUT, IORING_OP_ASYNC_CANCEL})
+        {
+            if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+                return false;
+        }
+
+        // buffer rings arrived with multishot accept (5.19), kernels without one lack both
+        ProvidedBuffers buffers(ring, 0, 1, 64);
+        return true;
+    }
+    catch(system::system_error &)
+    {
+        return false;
+    }
+}
+
+#endif // NET_HAS_IO_URING
+
+#endif // !NET_IOURING
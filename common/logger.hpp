@@ -0,0 +1,317 @@
+#ifndef NET_LOGGER
+#define NET_LOGGER
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+enum class LogLevel : int
+{
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off
+};
+
+/*
+ * Asynchronous logger for the I/O hot path. A log call formats into a fixed size slot of the
+ * calling thread's own single producer ring buffer and returns without touching the output
+ * stream. A background thread drains every ring and writes batches out, outside the lock.
+ *
+ * A thread's first call allocates its ring (about 120 KiB) and takes the lock once to register
+ * it; later calls take no lock and allocate nothing themselves. Arguments are built by the
+ * caller, so error paths logging ec.message() still allocate that string.
+ *
+ * Messages below the level, over the per-thread rate limit, or finding the ring full are
+ * dropped and counted (see dropped()); a line reporting new drops is written by the flusher.
+ */
+class Logger {
+    public:
+        static constexpr std::size_t MESSAGE_SIZE{232};
+        static constexpr std::size_t RING_SIZE{512};     // slots per thread, power of two
+
+    private:
+        struct Entry
+        {
+            LogLevel m_level;
+            std::uint32_t m_size;
+            char m_text[MESSAGE_SIZE];
+        };
+
+        /* Single producer (owning thread), single consumer (flusher) ring. */
+        struct Ring
+        {
+            std::array<Entry, RING_SIZE> m_entries;
+            std::atomic<std::uint64_t> m_head{0};        // next slot flusher reads
+            std::atomic<std::uint64_t> m_tail{0};        // next slot producer writes
+            std::atomic<bool> m_retired{false};          // owning thread exited
+
+            // rate limiter, touched only by the owning thread
+            std::chrono::steady_clock::time_point m_window;
+            std::uint32_t m_in_window{0};
+        };
+
+        /* Hands the thread's ring to the flusher for a final drain when the thread exits. */
+        struct RingHandle
+        {
+            std::shared_ptr<Ring> m_ring;
+
+            ~RingHandle()
+            {
+                if(m_ring)
+                    m_ring->m_retired.store(true, std::memory_order_release);
+            }
+        };
+
+        std::atomic<int> m_level;
+        std::atomic<std::uint32_t> m_rate_limit;         // messages per second per thread, 0 unlimited
+        std::atomic<std::uint64_t> m_dropped;
+
+        std::ostream *m_os;
+        std::chrono::milliseconds m_flush_interval;
+
+        std::mutex m_gaurd;                              // new rings, output stream and stop flag
+        std::list<std::shared_ptr<Ring>> m_new_rings;    // registered since the flusher last looked
+        std::list<std::shared_ptr<Ring>> m_rings;        // flusher's own, no lock
+        bool m_stopped;
+        std::condition_variable m_wakeup;
+        std::unique_ptr<std::thread> m_flusher;
+
+        Logger()
+            :m_level(static_cast<int>(LogLevel::Info)),
+            m_rate_limit(0),
+            m_dropped(0),
+            m_os(&std::cout),
+            m_flush_interval(5),
+            m_stopped(false)
+        {
+            m_flusher.reset(new std::thread([this]() { run(); }));
+        }
+
+        Ring *ring()
+        {
+            thread_local RingHandle handle;
+
+            if(!handle.m_ring)
+            {
+                handle.m_ring = std::make_shared<Ring>();
+
+                std::lock_guard<std::mutex> lock(m_gaurd);
+                m_new_rings.push_back(handle.m_ring);
+            }
+
+            return handle.m_ring.get();
+        }
+
+        static void append(Entry &e, std::string_view text)
+        {
+            std::size_t n = std::min(text.size(), MESSAGE_SIZE - e.m_size);
+            std::memcpy(e.m_text + e.m_size, text.data(), n);
+            e.m_size += static_cast<std::uint32_t>(n);
+        }
+
+        static void append(Entry &e, const char *text) { append(e, std::string_view(text)); }
+        static void append(Entry &e, const std::string &text) { append(e, std::string_view(text)); }
+        static void append(Entry &e, char c) { append(e, std::string_view(&c, 1)); }
+
+        template <typename T>
+        static typename std::enable_if<std::is_integral<T>::value>::type append(Entry &e, T value)
+        {
+            char buf[24];
+            std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), value);
+            append(e, std::string_view(buf, r.ptr - buf));
+        }
+
+        template <typename T>
+        static typename std::enable_if<std::is_floating_point<T>::value>::type append(Entry &e, T value)
+        {
+            char buf[32];
+            int n = std::snprintf(buf, sizeof(buf), "%g", static_cast<double>(value));
+            append(e, std::string_view(buf, n > 0 ? n : 0));
+        }
+
+        /* Token window limiter, true if message may be logged. */
+        bool admit(Ring &ring)
+        {
+            std::uint32_t limit = m_rate_limit.load(std::memory_order_relaxed);
+            if(limit == 0)
+                return true;
+
+            auto now = std::chrono::steady_clock::now();
+            if(now - ring.m_window >= std::chrono::seconds(1))
+            {
+                ring.m_window = now;
+                ring.m_in_window = 0;
+            }
+
+            return ++ring.m_in_window <= limit;
+        }
+
+        /* Moves every ring's pending entries into out, drops retired and drained rings. */
+        void drain(std::string &out)
+        {
+            static const char *levels[] = {"[debug] ", "[info] ", "[warn] ", "[error] "};
+
+            for(auto it = m_rings.begin(); it != m_rings.end();)
+            {
+                Ring &ring = **it;
+                bool retired = ring.m_retired.load(std::memory_order_acquire);
+
+                std::uint64_t head = ring.m_head.load(std::memory_order_relaxed);
+                std::uint64_t tail = ring.m_tail.load(std::memory_order_acquire);
+
+                for(; head != tail; ++head)
+                {
+                    const Entry &e = ring.m_entries[head & (RING_SIZE - 1)];
+
+                    out += levels[static_cast<int>(e.m_level)];
+                    out.append(e.m_text, e.m_size);
+                    out += '\n';
+                }
+
+                ring.m_head.store(head, std::memory_order_release);
+
+                if(retired)
+                    it = m_rings.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        /* Flusher loop, takes new rings and the stream under the lock, drains and writes without it. */
+        void run()
+        {
+            std::string batch;
+            std::uint64_t reported_drops{0};
+
+            while(true)
+            {
+                std::unique_lock<std::mutex> lock(m_gaurd);
+                bool stopped = m_wakeup.wait_for(lock, m_flush_interval, [this]() { return m_stopped; });
+
+                m_rings.splice(m_rings.end(), m_new_rings);
+                std::ostream *os = m_os;
+                lock.unlock();
+
+                batch.clear();
+                drain(batch);
+
+                std::uint64_t drops = m_dropped.load(std::memory_order_relaxed);
+                if(drops != reported_drops)
+                {
+                    batch += "[warn] logger dropped " + std::to_string(drops - reported_drops) + " messages\n";
+                    reported_drops = drops;
+                }
+
+                if(!batch.empty())
+                {
+                    os->write(batch.data(), batch.size());
+                    os->flush();
+                }
+
+                if(stopped)
+                    return;
+            }
+        }
+
+    public:
+
+        static Logger &instance()
+        {
+            static Logger logger;
+            return logger;
+        }
+
+        /* Flushes whatever is queued and stops the flusher. */
+        ~Logger()
+        {
+            std::unique_lock<std::mutex> lock(m_gaurd);
+            m_stopped = true;
+            lock.unlock();
+
+            m_wakeup.notify_all();
+            m_flusher->join();
+        }
+
+        void setLevel(LogLevel level) { m_level.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+        /* Messages per second each thread may log, 0 for no limit. */
+        void setRateLimit(std::uint32_t per_second) { m_rate_limit.store(per_second, std::memory_order_relaxed); }
+
+        /* Redirects output from the next batch on, stream must outlive the logger. */
+        void setOutput(std::ostream &os)
+        {
+            std::lock_guard<std::mutex> lock(m_gaurd);
+            m_os = &os;
+        }
+
+        bool enabled(LogLevel level) const
+        {
+            return static_cast<int>(level) >= m_level.load(std::memory_order_relaxed);
+        }
+
+        /* Messages lost to the level filter excluded; rate limit and full ring included. */
+        std::uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+        /*
+         * Formats args, concatenated, into the calling thread's ring; never blocks.
+         * Strings, characters, integers and floating point values are supported, text past
+         * MESSAGE_SIZE is truncated.
+         */
+        template <typename... Args>
+        void log(LogLevel level, const Args &... args)
+        {
+            if(!enabled(level))
+                return;
+
+            Ring &r = *ring();
+            if(!admit(r))
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            std::uint64_t tail = r.m_tail.load(std::memory_order_relaxed);
+            if(tail - r.m_head.load(std::memory_order_acquire) >= RING_SIZE)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            Entry &e = r.m_entries[tail & (RING_SIZE - 1)];
+            e.m_level = level;
+            e.m_size = 0;
+            (append(e, args), ...);
+
+            r.m_tail.store(tail + 1, std::memory_order_release);
+        }
+
+        template <typename... Args>
+        static void debug(const Args &... args) { instance().log(LogLevel::Debug, args...); }
+
+        template <typename... Args>
+        static void info(const Args &... args) { instance().log(LogLevel::Info, args...); }
+
+        template <typename... Args>
+        static void warn(const Args &... args) { instance().log(LogLevel::Warn, args...); }
+
+        template <typename... Args>
+        static void error(const Args &... args) { instance().log(LogLevel::Error, args...); }
+};
+
+#endif // !NET_LOGGER
@@ -0,0 +1,310 @@
+#ifndef NET_METRICS
+#define NET_METRICS
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "histogram.hpp"
+
+/*
+ * Which component a measurement belongs to.
+ */
+enum class MetricScope : std::size_t
+{
+    AsyncServer,
+    SyncServer,
+    AsyncClient,
+    CoroutineServer,
+    CoroutineClient,
+    UdpServer,
+    COUNT
+};
+
+/*
+ * Per request stages, each recorded as a latency in nanoseconds.
+ *
+ * Accept: server, accept completion until the connection is first read (queue wait in TCPServer_M).
+ *         client, connect.
+ * FirstByte: waiting for the first bytes of a request (server) or response (client).
+ * ReadComplete: first byte until the whole message is parsed.
+ * ComputeWait: server, parsed requests waiting for a compute pool thread.
+ * Process: request handler.
+ * ResumeWait: server, processed response waiting to be picked up by its I/O thread.
+ * WriteComplete: write start until the write completes.
+ */
+enum class MetricStage : std::size_t
+{
+    Accept,
+    FirstByte,
+    ReadComplete,
+    ComputeWait,
+    Process,
+    ResumeWait,
+    WriteComplete,
+    COUNT
+};
+
+/*
+ * Point in time values, summed over all threads.
+ */
+enum class MetricGauge : std::size_t
+{
+    ActiveSessions,
+    QueueDepth,                                          // work waiting for a pool thread
+    BytesIn,
+    BytesOut,
+    Rejected,                                            // connections turned away under overload
+    Dropped,                                             // broadcast subscribers closed for falling behind
+    COUNT
+};
+
+/* Coarser than the benchmark histogram (~6% error) to keep per-thread shards small. */
+typedef BasicLatencyHistogram<4> MetricHistogram;
+
+static constexpr std::size_t METRIC_SCOPES{static_cast<std::size_t>(MetricScope::COUNT)};
+static constexpr std::size_t METRIC_STAGES{static_cast<std::size_t>(MetricStage::COUNT)};
+static constexpr std::size_t METRIC_GAUGES{static_cast<std::size_t>(MetricGauge::COUNT)};
+
+/*
+ * Merged view of every thread's metrics.
+ */
+struct MetricsSnapshot
+{
+    std::array<std::array<MetricHistogram, METRIC_STAGES>, METRIC_SCOPES> m_stages;
+    std::array<std::array<std::int64_t, METRIC_GAUGES>, METRIC_SCOPES> m_gauges{};
+
+    const MetricHistogram &stage(MetricScope scope, MetricStage stage) const
+    {
+        return m_stages[static_cast<std::size_t>(scope)][static_cast<std::size_t>(stage)];
+    }
+
+    std::int64_t gauge(MetricScope scope, MetricGauge gauge) const
+    {
+        return m_gauges[static_cast<std::size_t>(scope)][static_cast<std::size_t>(gauge)];
+    }
+
+    /* Text dump, one line per stage and one per scope for gauges; idle scopes are skipped. */
+    void print(std::ostream &os) const
+    {
+        static const char *scopes[] = {"async_server", "sync_server", "async_client", "coroutine_server",
+            "coroutine_client", "udp_server"};
+        static const char *stages[] = {"accept", "first_byte", "read_complete", "compute_wait", "process",
+            "resume_wait", "write_complete"};
+        static const char *gauges[] = {"active_sessions", "queue_depth", "bytes_in", "bytes_out", "rejected",
+            "dropped"};
+
+        for(std::size_t s = 0; s < METRIC_SCOPES; ++s)
+        {
+            bool used = false;
+            for(std::size_t g = 0; g < METRIC_GAUGES; ++g)
+                used = used || m_gauges[s][g] != 0;
+            for(std::size_t t = 0; t < METRIC_STAGES; ++t)
+                used = used || m_stages[s][t].count() != 0;
+
+            if(!used)
+                continue;
+
+            os << scopes[s];
+            for(std::size_t g = 0; g < METRIC_GAUGES; ++g)
+                os << ' ' << gauges[g] << '=' << m_gauges[s][g];
+            os << '\n';
+
+            for(std::size_t t = 0; t < METRIC_STAGES; ++t)
+            {
+                const MetricHistogram &h = m_stages[s][t];
+                if(h.count() == 0)
+                    continue;
+
+                os << std::fixed << std::setprecision(1)
+                    << scopes[s] << '.' << stages[t] << " count=" << h.count()
+                    << " p50_us=" << h.percentile(50) / 1000.0
+                    << " p99_us=" << h.percentile(99) / 1000.0
+                    << " p999_us=" << h.percentile(99.9) / 1000.0
+                    << " max_us=" << h.max() / 1000.0 << '\n';
+            }
+        }
+
+        os << std::flush;
+    }
+};
+
+/*
+ * Process wide metrics registry. Every thread records into its own shard, a thread_local
+ * set of histograms and gauges only that thread writes, so recording is a couple of relaxed
+ * atomic load/stores with no contention. snapshot() sums all shards, live and exited.
+ */
+class Metrics {
+    private:
+        struct Shard
+        {
+            std::array<std::array<std::array<std::atomic<std::uint64_t>, MetricHistogram::BUCKETS>,
+                METRIC_STAGES>, METRIC_SCOPES> m_stages{};
+            std::array<std::array<std::atomic<std::int64_t>, METRIC_GAUGES>, METRIC_SCOPES> m_gauges{};
+
+            Shard()
+            {
+                std::lock_guard<std::mutex> lock(registry().m_gaurd);
+                registry().m_shards.push_back(this);
+            }
+
+            ~Shard()
+            {
+                std::lock_guard<std::mutex> lock(registry().m_gaurd);
+                addTo(registry().m_retired);
+                registry().m_shards.remove(this);
+            }
+
+            void addTo(MetricsSnapshot &snapshot) const
+            {
+                for(std::size_t s = 0; s < METRIC_SCOPES; ++s)
+                {
+                    for(std::size_t t = 0; t < METRIC_STAGES; ++t)
+                    {
+                        for(std::size_t i = 0; i < MetricHistogram::BUCKETS; ++i)
+                        {
+                            std::uint64_t count = m_stages[s][t][i].load(std::memory_order_relaxed);
+                            if(count != 0)
+                                snapshot.m_stages[s][t].add(i, count);
+                        }
+                    }
+
+                    for(std::size_t g = 0; g < METRIC_GAUGES; ++g)
+                        snapshot.m_gauges[s][g] += m_gauges[s][g].load(std::memory_order_relaxed);
+                }
+            }
+        };
+
+        struct Registry
+        {
+            std::mutex m_gaurd;
+            std::list<Shard *> m_shards;
+            MetricsSnapshot m_retired;                   // totals of threads that have exited
+        };
+
+        static Registry &registry()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        static Shard &shard()
+        {
+            thread_local std::unique_ptr<Shard> shard(new Shard);
+            return *shard;
+        }
+
+        /* Single writer increment, no read-modify-write needed. */
+        template <typename T>
+        static void bump(std::atomic<T> &value, T delta)
+        {
+            value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        }
+
+    public:
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+        static TimePoint now()
+        {
+            return std::chrono::steady_clock::now();
+        }
+
+        /* Records latency of a stage. */
+        static void record(MetricScope scope, MetricStage stage, std::chrono::steady_clock::duration latency)
+        {
+            std::uint64_t ns = static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+
+            bump<std::uint64_t>(shard().m_stages[static_cast<std::size_t>(scope)][static_cast<std::size_t>(stage)]
+                    [MetricHistogram::indexOf(ns)], 1);
+        }
+
+        /* Records latency of a stage that started at since. */
+        static void recordSince(MetricScope scope, MetricStage stage, TimePoint since)
+        {
+            record(scope, stage, now() - since);
+        }
+
+        /* Adjusts a gauge; increments and decrements may come from different threads. */
+        static void add(MetricScope scope, MetricGauge gauge, std::int64_t delta)
+        {
+            bump<std::int64_t>(shard().m_gauges[static_cast<std::size_t>(scope)][static_cast<std::size_t>(gauge)], delta);
+        }
+
+        /* Sum over all threads, consistent per counter, not across counters. */
+        static MetricsSnapshot snapshot()
+        {
+            std::lock_guard<std::mutex> lock(registry().m_gaurd);
+
+            MetricsSnapshot snapshot = registry().m_retired;
+            for(Shard *shard: registry().m_shards)
+                shard->addTo(snapshot);
+
+            return snapshot;
+        }
+};
+
+/*
+ * Background thread printing a metrics snapshot every interval.
+ *
+ * @behavior: starts on construction, stops and joins on destruction or stop().
+ */
+class MetricsReporter {
+    private:
+        std::ostream &m_os;
+        std::chrono::milliseconds m_interval;
+        bool m_stopped;
+        std::mutex m_gaurd;
+        std::condition_variable m_wakeup;
+        std::unique_ptr<std::thread> m_thread;
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(m_gaurd);
+
+            while(!m_wakeup.wait_for(lock, m_interval, [this]() { return m_stopped; }))
+            {
+                lock.unlock();
+                Metrics::snapshot().print(m_os);
+                lock.lock();
+            }
+        }
+
+    public:
+
+        /* Constructor */
+        MetricsReporter(std::chrono::milliseconds interval, std::ostream &os = std::cout)
+            :m_os(os),
+            m_interval(interval),
+            m_stopped(false)
+        {
+            m_thread.reset(new std::thread([this]() { run(); }));
+        }
+
+        ~MetricsReporter()
+        {
+            stop();
+        }
+
+        void stop()
+        {
+            std::unique_lock<std::mutex> lock(m_gaurd);
+            m_stopped = true;
+            lock.unlock();
+
+            m_wakeup.notify_all();
+
+            if(m_thread && m_thread->joinable())
+                m_thread->join();
+        }
+};
+
+#endif // !NET_METRICS
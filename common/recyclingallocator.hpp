@@ -0,0 +1,228 @@
+#ifndef NET_RECYCLINGALLOCATOR
+#define NET_RECYCLINGALLOCATOR
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Per-thread free lists of memory blocks, bucketed by power of two size class. Blocks freed on
+ * a thread are kept for the next allocation of the same class on that thread, so objects that
+ * are allocated and freed on the same threads, like server sessions, their buffers and
+ * completion handlers, are mostly served without touching malloc once warmed up. Objects freed
+ * on another thread than the one that allocated them land in the freeing thread's cache: a
+ * thread that only allocates, such as the caller of AsyncTCPClient whose sessions are freed on
+ * the I/O threads, misses every time. Blocks bigger than the largest class go straight to
+ * operator new.
+ *
+ * Every block of a class is allocated at the full class size, cached or not, as any block may
+ * end up in some thread's free list of that class.
+ *
+ * Hits and misses are counted per thread and summed by stats().
+ */
+class Recycler {
+    public:
+        static constexpr std::size_t MIN_CLASS_BITS{6};            // 64 bytes
+        static constexpr std::size_t MAX_CLASS_BITS{17};           // 128 KiB, fits a max size frame buffer
+        static constexpr std::size_t CLASSES{MAX_CLASS_BITS - MIN_CLASS_BITS + 1};
+        static constexpr std::size_t MAX_CACHED_PER_CLASS{64};
+
+        struct Stats
+        {
+            std::uint64_t hits{0};                       // allocations served from a free list
+            std::uint64_t misses{0};                     // allocations that went to operator new
+        };
+
+    private:
+        struct ThreadCache
+        {
+            std::array<std::vector<void *>, CLASSES> m_free;
+            std::atomic<std::uint64_t> m_hits{0};
+            std::atomic<std::uint64_t> m_misses{0};
+
+            ThreadCache()
+            {
+                std::lock_guard<std::mutex> lock(registry().m_gaurd);
+                registry().m_caches.push_back(this);
+            }
+
+            ~ThreadCache()
+            {
+                for(std::size_t c = 0; c < CLASSES; ++c)
+                    for(void *block: m_free[c])
+                        ::operator delete(block);
+
+                std::lock_guard<std::mutex> lock(registry().m_gaurd);
+                registry().m_retired.hits += m_hits.load(std::memory_order_relaxed);
+                registry().m_retired.misses += m_misses.load(std::memory_order_relaxed);
+                registry().m_caches.remove(this);
+
+                alive() = false;
+            }
+        };
+
+        struct Registry
+        {
+            std::mutex m_gaurd;
+            std::list<ThreadCache *> m_caches;
+            Stats m_retired;                             // counts of threads that have exited
+        };
+
+        static Registry &registry()
+        {
+            static Registry registry;
+            return registry;
+        }
+
+        /* False once this thread's cache is destroyed, late frees then bypass it. */
+        static bool &alive()
+        {
+            thread_local bool alive{true};
+            return alive;
+        }
+
+        static ThreadCache *cache()
+        {
+            if(!alive())
+                return nullptr;
+
+            thread_local ThreadCache cache;
+            return &cache;
+        }
+
+        /* Size class for size bytes, CLASSES if too large to be recycled. */
+        static std::size_t classOf(std::size_t size)
+        {
+            std::size_t bits = MIN_CLASS_BITS;
+            while(bits <= MAX_CLASS_BITS && (std::size_t(1) << bits) < size)
+                ++bits;
+
+            return bits - MIN_CLASS_BITS;
+        }
+
+    public:
+
+        static void *allocate(std::size_t size)
+        {
+            std::size_t c = classOf(size);
+            ThreadCache *tc = cache();
+
+            if(c >= CLASSES)
+                return ::operator new(size);
+
+            // thread exiting, still class sized since a live thread may cache it when freed
+            if(tc == nullptr)
+                return ::operator new(std::size_t(1) << (c + MIN_CLASS_BITS));
+
+            if(!tc->m_free[c].empty())
+            {
+                void *block = tc->m_free[c].back();
+                tc->m_free[c].pop_back();
+
+                tc->m_hits.store(tc->m_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return block;
+            }
+
+            tc->m_misses.store(tc->m_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return ::operator new(std::size_t(1) << (c + MIN_CLASS_BITS));
+        }
+
+        static void deallocate(void *block, std::size_t size)
+        {
+            std::size_t c = classOf(size);
+            ThreadCache *tc = cache();
+
+            if(c >= CLASSES || tc == nullptr || tc->m_free[c].size() >= MAX_CACHED_PER_CLASS)
+            {
+                ::operator delete(block);
+                return;
+            }
+
+            tc->m_free[c].push_back(block);
+        }
+
+        /* Hit and miss totals over all threads, live and exited. */
+        static Stats stats()
+        {
+            std::lock_guard<std::mutex> lock(registry().m_gaurd);
+
+            Stats total = registry().m_retired;
+            for(ThreadCache *tc: registry().m_caches)
+            {
+                total.hits += tc->m_hits.load(std::memory_order_relaxed);
+                total.misses += tc->m_misses.load(std::memory_order_relaxed);
+            }
+
+            return total;
+        }
+};
+
+/*
+ * Standard allocator over Recycler, for std::allocate_shared and containers.
+ */
+template <typename T>
+class RecyclingAllocator {
+    public:
+        using value_type = T;
+
+        RecyclingAllocator() noexcept = default;
+
+        template <typename U>
+        RecyclingAllocator(const RecyclingAllocator<U> &) noexcept {}
+
+        T *allocate(std::size_t n)
+        {
+            return static_cast<T *>(Recycler::allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T *p, std::size_t n) noexcept
+        {
+            Recycler::deallocate(p, n * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const RecyclingAllocator<U> &) const noexcept { return true; }
+
+        template <typename U>
+        bool operator!=(const RecyclingAllocator<U> &) const noexcept { return false; }
+};
+
+/*
+ * Completion handler wrapper exposing RecyclingAllocator as its associated allocator, asio
+ * then takes the memory for the pending operation from the recycler as well.
+ */
+template <typename Handler>
+class RecyclingHandler {
+    private:
+        Handler m_handler;
+
+    public:
+        using allocator_type = RecyclingAllocator<void>;
+
+        RecyclingHandler(Handler handler)
+            :m_handler(std::move(handler))
+        {}
+
+        allocator_type get_allocator() const noexcept { return allocator_type(); }
+
+        template <typename... Args>
+        void operator()(Args &&... args)
+        {
+            m_handler(std::forward<Args>(args)...);
+        }
+};
+
+template <typename Handler>
+RecyclingHandler<typename std::decay<Handler>::type> makeRecyclingHandler(Handler &&handler)
+{
+    return RecyclingHandler<typename std::decay<Handler>::type>(std::forward<Handler>(handler));
+}
+
+#endif // !NET_RECYCLINGALLOCATOR
@@ -0,0 +1,50 @@
+#ifndef NET_REQUESTHANDLER
+#define NET_REQUESTHANDLER
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "logger.hpp"
+
+/*
+ * Request logic plugged into the servers at compile time. A handler is any type callable as
+ *
+ *     void operator()(std::string_view request, std::string &response)
+ *
+ * request is one unframed message, a view into the connection's receive buffer that is only
+ * valid during the call. response is the connection's output buffer: it may already hold the
+ * frame header and the responses to earlier pipelined requests, so the handler only appends its
+ * payload, and the server frames it in place once the call returns.
+ *
+ * Servers are templates on the handler type, so the call is resolved and inlined at compile
+ * time. A server owns one handler and calls it from all of its I/O and compute threads at once,
+ * it must be safe to call concurrently.
+ */
+template <typename Handler, typename = void>
+struct IsRequestHandler : std::false_type {};
+
+template <typename Handler>
+struct IsRequestHandler<Handler, std::void_t<decltype(std::declval<Handler &>()(
+        std::declval<std::string_view>(), std::declval<std::string &>()))>> : std::true_type {};
+
+#ifdef __cpp_concepts
+/* The same check as a concept, for constraining C++20 code built on the servers. */
+template <typename Handler>
+concept RequestHandler = IsRequestHandler<Handler>::value;
+#endif
+
+/* Default handler: logs the request and answers "Hello Client". */
+struct HelloHandler
+{
+    void operator()(std::string_view request, std::string &response) const
+    {
+        // parse request and process it
+        Logger::info(request);
+
+        response.append("Hello Client");
+    }
+};
+
+#endif // !NET_REQUESTHANDLER
@@ -0,0 +1,535 @@
+#ifndef NET_SHMRING
+#define NET_SHMRING
+
+/*
+ * Shared memory transport for a client and server on the same host: the client maps a memfd
+ * holding one ring per direction and hands it, with an eventfd doorbell per side, to the server
+ * over a Unix domain socket. Linux only (memfd, eventfd, SCM_RIGHTS), check NET_HAS_SHM.
+ */
+#if defined(__linux__)
+#define NET_HAS_SHM 1
+#endif
+
+#ifdef NET_HAS_SHM
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace boost;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+              "shared memory rings need lock free atomics, the two processes share no lock");
+
+/*
+ * Control block of a ring, at the start of its region of the segment. Indices count bytes ever
+ * written and consumed, so head - tail is the fill level; each sits on its own cache line since
+ * the two processes write them from different cores.
+ */
+struct ShmRingControl
+{
+    alignas(64) std::atomic<std::uint64_t> m_head;       // written by the producer only
+    alignas(64) std::atomic<std::uint64_t> m_tail;       // written by the consumer only
+    alignas(64) std::atomic<std::uint32_t> m_reader_waiting;   // consumer ran dry and waits on its doorbell
+    std::atomic<std::uint32_t> m_writer_waiting;         // producer found the ring full and waits on its doorbell
+};
+
+/*
+ * Single producer, single consumer ring of records in shared memory. A record is an 8 byte
+ * header, payload size and request id, and the payload, padded to 8 bytes. A record never wraps:
+ * when it does not fit before the end of the data area a skip marker fills the rest, so the
+ * consumer always gets the payload as one view straight into the ring, without a copy.
+ *
+ * Neither side makes a system call per record. A side only rings the other's doorbell when the
+ * other flagged that it is about to sleep, see wakeConsumer and wakeProducer; while both keep up
+ * the rings are handed over through memory alone.
+ *
+ * @behavior: one thread pushes and one thread pops at a time, on either side of the mapping.
+ */
+class ShmRing {
+    private:
+        static constexpr std::uint32_t SKIP{0xFFFFFFFFu};
+        static constexpr std::size_t HEADER_SIZE{8};
+
+        ShmRingControl *m_control;
+        char *m_data;
+        std::uint64_t m_capacity;                        // power of two
+        std::uint64_t m_next_tail;                       // consumer: tail once the front record is popped
+
+        static std::size_t recordSize(std::size_t payload)
+        {
+            return (HEADER_SIZE + payload + 7) & ~static_cast<std::size_t>(7);
+        }
+
+    public:
+
+        ShmRing()
+            :m_control(nullptr),
+            m_data(nullptr),
+            m_capacity(0),
+            m_next_tail(0)
+        {}
+
+        /* Ring over region, which holds its control block followed by capacity bytes of data. */
+        ShmRing(void *region, std::uint64_t capacity)
+            :m_control(static_cast<ShmRingControl *>(region)),
+            m_data(static_cast<char *>(region) + sizeof(ShmRingControl)),
+            m_capacity(capacity),
+            m_next_tail(0)
+        {}
+
+        /* Bytes of segment a ring of capacity takes. */
+        static std::size_t footprint(std::uint64_t capacity)
+        {
+            return sizeof(ShmRingControl) + capacity;
+        }
+
+        /* Starts the ring empty, with no consumer yet: the first push rings the doorbell. */
+        void reset()
+        {
+            new(m_control) ShmRingControl();
+            m_control->m_head.store(0, std::memory_order_relaxed);
+            m_control->m_tail.store(0, std::memory_order_relaxed);
+            m_control->m_reader_waiting.store(1, std::memory_order_relaxed);
+            m_control->m_writer_waiting.store(0, std::memory_order_relaxed);
+        }
+
+        /* Largest payload a record may carry, half the ring so a skip marker never starves it. */
+        std::size_t maxPayload() const
+        {
+            return m_capacity / 2 - HEADER_SIZE;
+        }
+
+        bool empty() const
+        {
+            return m_control->m_tail.load(std::memory_order_relaxed) == m_control->m_head.load(std::memory_order_acquire);
+        }
+
+        /*
+         * Producer: appends a record.
+         *
+         * @return: false if the ring has no room for it right now, or payload is over maxPayload.
+         */
+        bool push(std::uint32_t id, std::string_view payload)
+        {
+            if(payload.size() > maxPayload())
+                return false;
+
+            std::uint64_t head = m_control->m_head.load(std::memory_order_relaxed);
+            std::uint64_t tail = m_control->m_tail.load(std::memory_order_acquire);
+            std::size_t size = recordSize(payload.size());
+
+            std::uint64_t offset = head & (m_capacity - 1);
+            std::uint64_t skip = m_capacity - offset < size ? m_capacity - offset : 0;
+
+            if(head + skip + size - tail > m_capacity)
+                return false;
+
+            if(skip != 0)
+            {
+                std::memcpy(m_data + offset, &SKIP, sizeof(SKIP));
+                head += skip;
+                offset = 0;
+            }
+
+            std::uint32_t header[2] = {static_cast<std::uint32_t>(payload.size()), id};
+            std::memcpy(m_data + offset, header, HEADER_SIZE);
+            std::memcpy(m_data + offset + HEADER_SIZE, payload.data(), payload.size());
+
+            m_control->m_head.store(head + size, std::memory_order_release);
+            return true;
+        }
+
+        /*
+         * Consumer: oldest record, left in the ring until pop.
+         *
+         * @param: {std::uint32_t &} id: request id of the record.
+         *         {std::string_view &} payload: view into the ring, valid until pop.
+         *
+         * @return: false if the ring is empty, or its front record is corrupt.
+         */
+        bool front(std::uint32_t &id, std::string_view &payload)
+        {
+            std::uint64_t tail = m_control->m_tail.load(std::memory_order_relaxed);
+            std::uint64_t head = m_control->m_head.load(std::memory_order_acquire);
+
+            // the other process writes the ring, a corrupt one must not lead reads out of it
+            if(tail == head || head - tail > m_capacity)
+                return false;
+
+            std::uint64_t offset = tail & (m_capacity - 1);
+            std::uint32_t header[2];
+            std::memcpy(header, m_data + offset, sizeof(std::uint32_t));
+
+            if(header[0] == SKIP)
+            {
+                tail += m_capacity - offset;
+                offset = 0;
+            }
+
+            std::memcpy(header, m_data + offset, HEADER_SIZE);
+            if(header[0] > maxPayload() || tail + recordSize(header[0]) > head)
+                return false;
+
+            id = header[1];
+            payload = std::string_view(m_data + offset + HEADER_SIZE, header[0]);
+            m_next_tail = tail + recordSize(header[0]);
+            return true;
+        }
+
+        /* Consumer: releases the record front returned, its room goes back to the producer. */
+        void pop()
+        {
+            m_control->m_tail.store(m_next_tail, std::memory_order_release);
+        }
+
+        /*
+         * Consumer: flags it is about to wait on its doorbell. A record pushed meanwhile is
+         * caught by the check that follows, or rings the doorbell.
+         *
+         * @return: true if the ring is still empty and the consumer may wait, false to keep reading.
+         */
+        bool prepareWait()
+        {
+            m_control->m_reader_waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if(!empty())
+            {
+                m_control->m_reader_waiting.store(0, std::memory_order_relaxed);
+                return false;
+            }
+
+            return true;
+        }
+
+        /*
+         * Producer: flags it waits for room after a failed push.
+         *
+         * @return: true if the ring is still short of room and the producer may wait, false to retry.
+         */
+        bool prepareWaitForSpace(std::size_t payload)
+        {
+            m_control->m_writer_waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            std::uint64_t head = m_control->m_head.load(std::memory_order_relaxed);
+            std::uint64_t tail = m_control->m_tail.load(std::memory_order_acquire);
+
+            // room for the record and a skip marker in front of it, whatever the offset
+            if(head - tail + 2 * recordSize(payload) <= m_capacity)
+            {
+                m_control->m_writer_waiting.store(0, std::memory_order_relaxed);
+                return false;
+            }
+
+            return true;
+        }
+
+        /* Producer, after pushing: true once if the consumer waits and its doorbell must be rung. */
+        bool wakeConsumer()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            return m_control->m_reader_waiting.load(std::memory_order_relaxed) != 0
+                && m_control->m_reader_waiting.exchange(0, std::memory_order_relaxed) != 0;
+        }
+
+        /* Consumer, after popping: true once if the producer waits for room and must be rung. */
+        bool wakeProducer()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            return m_control->m_writer_waiting.load(std::memory_order_relaxed) != 0
+                && m_control->m_writer_waiting.exchange(0, std::memory_order_relaxed) != 0;
+        }
+};
+
+/*
+ * Mapping of a shared memory segment: a small header and two rings, requests from client to
+ * server and responses back. The client creates it, the server attaches to the memfd it got.
+ */
+class ShmSegment : public asio::noncopyable {
+    private:
+        static constexpr std::uint64_t MAGIC{0x6e65742d73686d31ull};    // "net-shm1"
+        static constexpr std::size_t HEADER_SIZE{64};
+
+        struct Header
+        {
+            std::uint64_t m_magic;
+            std::uint64_t m_capacity;                    // of each ring
+        };
+
+        void *m_base;
+        std::size_t m_size;
+        ShmRing m_requests;
+        ShmRing m_responses;
+
+        static std::size_t sizeFor(std::uint64_t capacity)
+        {
+            return HEADER_SIZE + 2 * ShmRing::footprint(capacity);
+        }
+
+        bool map(int fd, std::size_t size, system::error_code &ec)
+        {
+            void *base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if(base == MAP_FAILED)
+            {
+                ec = system::error_code(errno, system::system_category());
+                return false;
+            }
+
+            m_base = base;
+            m_size = size;
+            return true;
+        }
+
+        void placeRings(std::uint64_t capacity)
+        {
+            char *base = static_cast<char *>(m_base);
+            m_requests = ShmRing(base + HEADER_SIZE, capacity);
+            m_responses = ShmRing(base + HEADER_SIZE + ShmRing::footprint(capacity), capacity);
+        }
+
+    public:
+
+        /* Seals a segment carries, fixing its size for good. */
+        static constexpr int SEALS{F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL};
+
+        /* Smallest and largest ring capacity a server accepts. */
+        static constexpr std::uint64_t MIN_CAPACITY{4096};
+        static constexpr std::uint64_t MAX_CAPACITY{std::uint64_t(1) << 28};
+
+        ShmSegment()
+            :m_base(nullptr),
+            m_size(0)
+        {}
+
+        ~ShmSegment()
+        {
+            if(m_base != nullptr)
+                ::munmap(m_base, m_size);
+        }
+
+        /*
+         * Creates and maps a segment with two empty rings.
+         *
+         * @param: {std::uint64_t} capacity: bytes of each ring, rounded up to a power of two.
+         * @return: memfd of the segment, for the caller to pass on and close; -1 with ec set on error.
+         */
+        int create(std::uint64_t capacity, system::error_code &ec)
+        {
+            std::uint64_t rounded = MIN_CAPACITY;
+            while(rounded < capacity && rounded < MAX_CAPACITY)
+                rounded <<= 1;
+
+            int fd = ::memfd_create("net-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if(fd < 0)
+            {
+                ec = system::error_code(errno, system::system_category());
+                return -1;
+            }
+
+            // sealed at its size, the server relies on it never shrinking under its mapping
+            std::size_t size = sizeFor(rounded);
+            if(::ftruncate(fd, size) != 0 || ::fcntl(fd, F_ADD_SEALS, SEALS) != 0 || !map(fd, size, ec))
+            {
+                if(!ec)
+                    ec = system::error_code(errno, system::system_category());
+                ::close(fd);
+                return -1;
+            }
+
+            Header *header = static_cast<Header *>(m_base);
+            header->m_magic = MAGIC;
+            header->m_capacity = rounded;
+
+            placeRings(rounded);
+            m_requests.reset();
+            m_responses.reset();
+
+            return fd;
+        }
+
+        /*
+         * Maps a segment a client created, checking it is one. The segment must be sealed against
+         * resizing, a client truncating it later would otherwise fault the server on its next
+         * ring access.
+         *
+         * @param: {int} fd: memfd of the segment, still owned by the caller.
+         */
+        void attach(int fd, system::error_code &ec)
+        {
+            int seals = ::fcntl(fd, F_GET_SEALS);
+            if(seals < 0 || (seals & SEALS) != SEALS)
+            {
+                ec = asio::error::invalid_argument;
+                return;
+            }
+
+            struct stat st;
+            if(::fstat(fd, &st) != 0)
+            {
+                ec = system::error_code(errno, system::system_category());
+                return;
+            }
+
+            std::size_t size = static_cast<std::size_t>(st.st_size);
+            if(size < HEADER_SIZE || !map(fd, size, ec))
+            {
+                if(!ec)
+                    ec = asio::error::invalid_argument;
+                return;
+            }
+
+            const Header *header = static_cast<const Header *>(m_base);
+            std::uint64_t capacity = header->m_capacity;
+
+            if(header->m_magic != MAGIC || capacity < MIN_CAPACITY || capacity > MAX_CAPACITY
+                    || (capacity & (capacity - 1)) != 0 || size != sizeFor(capacity))
+            {
+                ec = asio::error::invalid_argument;
+                return;
+            }
+
+            placeRings(capacity);
+        }
+
+        /* Client to server. */
+        ShmRing &requests() { return m_requests; }
+
+        /* Server to client. */
+        ShmRing &responses() { return m_responses; }
+};
+
+/* Wakes the side waiting on doorbell fd, an eventfd. */
+inline void ringDoorbell(int fd)
+{
+    ::eventfd_write(fd, 1);
+}
+
+/* New doorbell, non-blocking so its counter can be read by an asio descriptor. */
+inline int makeDoorbell(system::error_code &ec)
+{
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(fd < 0)
+        ec = system::error_code(errno, system::system_category());
+
+    return fd;
+}
+
+/* Number of descriptors a handshake carries: the segment, then client and server doorbells. */
+static constexpr std::size_t SHM_HANDSHAKE_FDS{3};
+
+/*
+ * Client side of the handshake: passes the segment and both doorbells over a connected Unix
+ * domain socket.
+ */
+inline void sendShmHandshake(int sock, const int (&fds)[SHM_HANDSHAKE_FDS], system::error_code &ec)
+{
+    char tag = 'S';
+    iovec iov{&tag, 1};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+    std::memset(control, 0, sizeof(control));
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    while(::sendmsg(sock, &msg, MSG_NOSIGNAL) < 0)
+    {
+        if(errno != EINTR)
+        {
+            ec = system::error_code(errno, system::system_category());
+            return;
+        }
+    }
+}
+
+/*
+ * Server side of the handshake, without blocking.
+ *
+ * @param: {int (&)[]} fds: filled with the descriptors, owned by the caller from then on.
+ *         {system::error_code &} ec: would_block if the handshake has not arrived yet,
+ *                                    eof if the client left, invalid_argument if it was malformed.
+ */
+inline void receiveShmHandshake(int sock, int (&fds)[SHM_HANDSHAKE_FDS], system::error_code &ec)
+{
+    char tag = 0;
+    iovec iov{&tag, 1};
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))];
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do
+    {
+        n = ::recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    } while(n < 0 && errno == EINTR);
+
+    if(n < 0)
+    {
+        ec = system::error_code(errno, system::system_category());
+        return;
+    }
+
+    if(n == 0)
+    {
+        ec = asio::error::eof;
+        return;
+    }
+
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if(tag != 'S' || cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+            || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+    {
+        // descriptors of a malformed handshake still arrived, close them
+        if(cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                ::close(fd);
+            }
+        }
+
+        ec = asio::error::invalid_argument;
+        return;
+    }
+
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+}
+
+#endif // NET_HAS_SHM
+
+#endif // !NET_SHMRING
@@ -0,0 +1,174 @@
+#ifndef NET_SOCKETTUNING
+#define NET_SOCKETTUNING
+
+#include <boost/asio.hpp>
+
+#include <string>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+using namespace boost;
+
+/*
+ * Socket options every server and client applies to its sockets. Zero or false leaves the
+ * kernel default, so a default constructed profile changes nothing but the listen backlog.
+ *
+ * Options are best effort: one the kernel refuses or does not know (SO_BUSY_POLL above
+ * net.core.busy_read without CAP_NET_ADMIN, anything Linux only elsewhere) is skipped.
+ */
+struct SocketTuning
+{
+    std::string name{"default"};
+    bool no_delay{false};                                // TCP_NODELAY, small messages go out without waiting for Nagle
+    int send_buffer{0};                                  // SO_SNDBUF bytes
+    int receive_buffer{0};                               // SO_RCVBUF bytes, set on listeners before listen so accepted sockets inherit it
+    int defer_accept{0};                                 // TCP_DEFER_ACCEPT seconds, listeners only wake accept once data has arrived
+    int fast_open{0};                                    // TCP_FASTOPEN queue on listeners; clients use TCP_FASTOPEN_CONNECT when set
+    int busy_poll{0};                                    // SO_BUSY_POLL microseconds a blocking read spins on the device queue
+    bool quick_ack{false};                               // TCP_QUICKACK on connect and accept, the kernel may drop back to delayed acks later
+    int backlog{30};                                     // listen backlog
+
+    /* Request/response over few connections: no batching anywhere, spend CPU to cut wakeup latency. */
+    static SocketTuning lowLatency()
+    {
+        SocketTuning tuning;
+        tuning.name = "low_latency";
+        tuning.no_delay = true;
+        tuning.quick_ack = true;
+        tuning.busy_poll = 50;
+        tuning.defer_accept = 1;
+        tuning.fast_open = 256;
+        tuning.backlog = 1024;
+        return tuning;
+    }
+
+    /* Bulk transfers and many connections: big buffers and a deep backlog, Nagle left on. */
+    static SocketTuning highThroughput()
+    {
+        SocketTuning tuning;
+        tuning.name = "high_throughput";
+        tuning.send_buffer = 4 * 1024 * 1024;
+        tuning.receive_buffer = 4 * 1024 * 1024;
+        tuning.defer_accept = 1;
+        tuning.backlog = 4096;
+        return tuning;
+    }
+
+    /*
+     * Preset by name, as given on benchmark command lines.
+     *
+     * @param: {std::string} name: default, low_latency or high_throughput.
+     * @return: matching preset, default for an unknown name.
+     */
+    static SocketTuning byName(const std::string &name)
+    {
+        if(name == "low_latency")
+            return lowLatency();
+        if(name == "high_throughput")
+            return highThroughput();
+
+        return SocketTuning();
+    }
+};
+
+/* Integer socket option, failures ignored. */
+inline void setSocketOption(int fd, int level, int option, int value)
+{
+    ::setsockopt(fd, level, option, &value, sizeof(value));
+}
+
+/*
+ * Tunes a listening socket; call between open and listen.
+ *
+ * @param: {int} fd: native handle of the listening socket.
+ *         {SocketTuning} tuning: profile to apply.
+ */
+inline void tuneListener(int fd, const SocketTuning &tuning)
+{
+    if(tuning.send_buffer > 0)
+        setSocketOption(fd, SOL_SOCKET, SO_SNDBUF, tuning.send_buffer);
+    if(tuning.receive_buffer > 0)
+        setSocketOption(fd, SOL_SOCKET, SO_RCVBUF, tuning.receive_buffer);
+
+#ifdef __linux__
+    if(tuning.defer_accept > 0)
+        setSocketOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, tuning.defer_accept);
+    if(tuning.fast_open > 0)
+        setSocketOption(fd, IPPROTO_TCP, TCP_FASTOPEN, tuning.fast_open);
+#endif
+}
+
+/*
+ * Tunes a connected socket, accepted or about to connect; buffers are only set on the
+ * connecting side, accepted sockets inherit them from the listener.
+ *
+ * @param: {int} fd: native handle of the socket.
+ *         {SocketTuning} tuning: profile to apply.
+ *         {bool} connecting: socket is opened but not yet connected.
+ */
+inline void tuneConnection(int fd, const SocketTuning &tuning, bool connecting)
+{
+    if(tuning.no_delay)
+        setSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+
+    if(connecting && tuning.send_buffer > 0)
+        setSocketOption(fd, SOL_SOCKET, SO_SNDBUF, tuning.send_buffer);
+    if(connecting && tuning.receive_buffer > 0)
+        setSocketOption(fd, SOL_SOCKET, SO_RCVBUF, tuning.receive_buffer);
+
+#ifdef __linux__
+    if(tuning.busy_poll > 0)
+        setSocketOption(fd, SOL_SOCKET, SO_BUSY_POLL, tuning.busy_poll);
+    if(tuning.quick_ack)
+        setSocketOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+    if(connecting && tuning.fast_open > 0)
+        setSocketOption(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1);
+#endif
+}
+
+/*
+ * Tunes a datagram socket, client or server: buffers and busy polling, the TCP only options
+ * have no meaning there and are left out.
+ *
+ * @param: {int} fd: native handle of the socket.
+ *         {SocketTuning} tuning: profile to apply.
+ */
+inline void tuneDatagram(int fd, const SocketTuning &tuning)
+{
+    if(tuning.send_buffer > 0)
+        setSocketOption(fd, SOL_SOCKET, SO_SNDBUF, tuning.send_buffer);
+    if(tuning.receive_buffer > 0)
+        setSocketOption(fd, SOL_SOCKET, SO_RCVBUF, tuning.receive_buffer);
+
+#ifdef __linux__
+    if(tuning.busy_poll > 0)
+        setSocketOption(fd, SOL_SOCKET, SO_BUSY_POLL, tuning.busy_poll);
+#endif
+}
+
+/* Asio acceptor overload, acceptor must be open. */
+template <typename Protocol, typename Executor>
+void tuneListener(asio::basic_socket_acceptor<Protocol, Executor> &acceptor, const SocketTuning &tuning)
+{
+    tuneListener(acceptor.native_handle(), tuning);
+}
+
+/* Asio socket overload, socket must be open. */
+template <typename Protocol, typename Executor>
+void tuneConnection(asio::basic_stream_socket<Protocol, Executor> &sock, const SocketTuning &tuning, bool connecting)
+{
+    tuneConnection(sock.native_handle(), tuning, connecting);
+}
+
+/* Asio datagram socket overload, socket must be open. */
+template <typename Protocol, typename Executor>
+void tuneDatagram(asio::basic_datagram_socket<Protocol, Executor> &sock, const SocketTuning &tuning)
+{
+    tuneDatagram(sock.native_handle(), tuning);
+}
+
+#endif // !NET_SOCKETTUNING
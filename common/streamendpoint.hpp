@@ -0,0 +1,159 @@
+#ifndef NET_STREAMENDPOINT
+#define NET_STREAMENDPOINT
+
+#include <boost/asio.hpp>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "sockettuning.hpp"
+
+using namespace boost;
+
+/*
+ * Servers and clients talk over any stream socket: TCP, or a Unix domain socket for clients on
+ * the same host, which skips the TCP/IP loopback stack. asio's generic stream protocol carries
+ * either address family behind one socket type, so the handler code is the same for both; the
+ * family is picked by the endpoint a socket is opened for.
+ */
+typedef asio::generic::stream_protocol StreamProtocol;
+typedef StreamProtocol::socket StreamSocket;
+typedef asio::basic_socket_acceptor<StreamProtocol> StreamAcceptor;
+typedef StreamProtocol::endpoint StreamEndpoint;
+
+/* TCP endpoint, listening on any ip4 address if ip is empty. */
+inline StreamEndpoint tcpEndpoint(const std::string &ip, unsigned short port)
+{
+    if(ip.empty())
+        return asio::ip::tcp::endpoint(asio::ip::address_v4::any(), port);
+
+    return asio::ip::tcp::endpoint(asio::ip::address::from_string(ip), port);
+}
+
+/* Unix domain stream socket endpoint at path. */
+inline StreamEndpoint localEndpoint(const std::string &path)
+{
+    return asio::local::stream_protocol::endpoint(path);
+}
+
+inline bool isLocal(const StreamEndpoint &ep)
+{
+    return ep.protocol().family() == AF_UNIX;
+}
+
+/* Socket file path of a Unix domain endpoint, empty for TCP and abstract sockets. */
+inline std::string localPath(const StreamEndpoint &ep)
+{
+    if(!isLocal(ep))
+        return std::string();
+
+    const sockaddr_un *addr = reinterpret_cast<const sockaddr_un *>(ep.data());
+    std::size_t max = ep.size() - offsetof(sockaddr_un, sun_path);
+
+    return std::string(addr->sun_path, ::strnlen(addr->sun_path, max));
+}
+
+/*
+ * Endpoint a server listens on.
+ *
+ * @param: {unsigned short} port: TCP port on any ip4 address.
+ *         {std::string} local_path: Unix domain socket path, used instead of port when not empty.
+ */
+inline StreamEndpoint listenEndpoint(unsigned short port, const std::string &local_path)
+{
+    return local_path.empty() ? tcpEndpoint("", port) : localEndpoint(local_path);
+}
+
+/*
+ * Removes the socket file at path if it was left behind by a server that is gone, so binding it
+ * again succeeds. A probe connect tells: refused means nobody listens any more. Anything else at
+ * path, a regular file or the socket of a server still running, is left alone and bind then
+ * reports the address in use.
+ */
+inline void removeStaleSocket(const std::string &path)
+{
+    struct stat st;
+    if(path.empty() || ::lstat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode))
+        return;
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    if(path.size() >= sizeof(addr.sun_path))
+        return;
+
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.data(), path.size());
+
+    // non-blocking, a live server with a full backlog answers EAGAIN rather than stalling us
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return;
+
+    bool stale = ::connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0
+        && errno == ECONNREFUSED;
+    ::close(fd);
+
+    if(stale)
+        ::unlink(path.c_str());
+}
+
+/*
+ * Removes the socket file of a Unix domain listener, for servers to call as they stop; nothing
+ * for TCP. Only a socket is removed, in case something else took the path meanwhile.
+ */
+inline void removeListenerFile(const StreamAcceptor &acceptor)
+{
+    system::error_code ec;
+    StreamEndpoint ep = acceptor.local_endpoint(ec);
+    if(ec)
+        return;
+
+    std::string path = localPath(ep);
+
+    struct stat st;
+    if(!path.empty() && ::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        ::unlink(path.c_str());
+}
+
+/*
+ * Opens, tunes and binds a listening socket, listen is left to the caller.
+ * A Unix domain socket file left behind by an earlier run is removed first (see removeStaleSocket),
+ * TCP sets SO_REUSEADDR instead.
+ *
+ * @param: {StreamAcceptor &} acceptor: closed acceptor.
+ *         {StreamEndpoint} ep: endpoint to bind.
+ *         {SocketTuning} tuning: profile to apply.
+ *         {bool} reuse_port: set SO_REUSEPORT, TCP only.
+ *
+ * @throws: system::system_error if the socket cannot be opened or bound.
+ */
+inline void openListener(StreamAcceptor &acceptor, const StreamEndpoint &ep, const SocketTuning &tuning,
+                         bool reuse_port = false)
+{
+    acceptor.open(ep.protocol());
+
+    if(isLocal(ep))
+    {
+        removeStaleSocket(localPath(ep));
+    }
+    else
+    {
+        acceptor.set_option(StreamAcceptor::reuse_address(true));
+
+        if(reuse_port)
+            acceptor.set_option(asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+    }
+
+    tuneListener(acceptor.native_handle(), tuning);
+    acceptor.bind(ep);
+}
+
+#endif // !NET_STREAMENDPOINT
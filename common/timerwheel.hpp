@@ -0,0 +1,373 @@
+#ifndef NET_TIMERWHEEL
+#define NET_TIMERWHEEL
+
+#include <boost/asio.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace boost;
+
+/*
+ * Handle to a scheduled timer, stays safe to cancel after the timer fired or was reused.
+ */
+struct TimerId
+{
+    std::uint32_t m_index{0};
+    std::uint32_t m_generation{0};                       // 0 never names a live timer
+    std::uint32_t m_lane{0};
+
+    bool valid() const { return m_generation != 0; }
+};
+
+/*
+ * Called when a timer expires, with the owner it was scheduled for. Runs on the wheel's
+ * io_service thread, outside the wheel lock.
+ */
+typedef void(*TimerHandler) (const std::shared_ptr<void> &owner);
+
+/*
+ * Hierarchical timing wheel shared by every connection on an io_service. One steady_timer
+ * ticks the wheel; scheduling and cancelling a deadline are O(1) list operations on a slab of
+ * preallocated entries, instead of one steady_timer (and timer queue insert) per operation.
+ *
+ * LEVELS wheels of SLOTS slots each: level 0 holds deadlines less than SLOTS ticks out, level n
+ * those less than SLOTS^(n+1) ticks out. When a lower wheel wraps, the next slot of the wheel
+ * above is cascaded down. Deadlines further out than the top level are clamped to it.
+ *
+ * A wheel shared by several threads, as in a shared pool, is split into lanes, each a complete
+ * wheel under its own lock. A thread schedules on the lane it was assigned on first use and
+ * the TimerId remembers the lane for cancel, so threads rearming deadlines mostly take a lock
+ * nobody else does. The ticker advances every lane.
+ *
+ * Timers hold a weak reference to their owner; an owner destroyed before its deadline simply
+ * never sees the handler.
+ */
+class TimerWheel : public asio::noncopyable {
+    private:
+        static constexpr unsigned int SLOT_BITS{6};
+        static constexpr std::size_t SLOTS{1u << SLOT_BITS};
+        static constexpr std::size_t LEVELS{4};
+        static constexpr std::int32_t NIL{-1};
+
+        struct Entry
+        {
+            std::uint64_t m_expiry{0};                   // in ticks
+            std::int32_t m_prev{NIL};
+            std::int32_t m_next{NIL};
+            std::uint32_t m_generation{1};
+            std::uint16_t m_bucket{0};                   // level * SLOTS + slot, while scheduled
+            bool m_scheduled{false};
+
+            std::weak_ptr<void> m_owner;
+            TimerHandler m_handler{nullptr};
+        };
+
+        struct Expired
+        {
+            std::weak_ptr<void> m_owner;
+            TimerHandler m_handler;
+        };
+
+        /* One wheel and its lock, on its own cache lines so lanes do not contend through them. */
+        struct alignas(64) Lane
+        {
+            std::mutex m_gaurd;
+            std::uint64_t m_now{0};                      // ticks processed since m_start
+            std::vector<Entry> m_entries;
+            std::vector<std::int32_t> m_free;
+            std::array<std::int32_t, LEVELS * SLOTS> m_buckets;
+            std::vector<Expired> m_expired;              // reused between ticks
+            std::size_t m_pending{0};
+
+            Lane()
+            {
+                m_buckets.fill(NIL);
+            }
+
+            void link(std::int32_t index)
+            {
+                Entry &e = m_entries[index];
+                std::uint64_t delta = e.m_expiry > m_now ? e.m_expiry - m_now : 0;
+
+                std::size_t level = 0;
+                while(level + 1 < LEVELS && delta >= (std::uint64_t(1) << (SLOT_BITS * (level + 1))))
+                    ++level;
+
+                // clamp deadlines past the top wheel to its last slot
+                std::uint64_t horizon = std::uint64_t(1) << (SLOT_BITS * LEVELS);
+                if(delta >= horizon)
+                    e.m_expiry = m_now + horizon - 1;
+
+                std::size_t slot = (e.m_expiry >> (SLOT_BITS * level)) & (SLOTS - 1);
+                std::size_t bucket = level * SLOTS + slot;
+
+                e.m_bucket = static_cast<std::uint16_t>(bucket);
+                e.m_prev = NIL;
+                e.m_next = m_buckets[bucket];
+                if(e.m_next != NIL)
+                    m_entries[e.m_next].m_prev = index;
+
+                m_buckets[bucket] = index;
+                e.m_scheduled = true;
+            }
+
+            void unlink(std::int32_t index)
+            {
+                Entry &e = m_entries[index];
+
+                if(e.m_prev != NIL)
+                    m_entries[e.m_prev].m_next = e.m_next;
+                else
+                    m_buckets[e.m_bucket] = e.m_next;
+
+                if(e.m_next != NIL)
+                    m_entries[e.m_next].m_prev = e.m_prev;
+
+                e.m_scheduled = false;
+            }
+
+            /* Returns entry to the free list, bumping generation so old TimerIds go stale. */
+            void release(std::int32_t index)
+            {
+                Entry &e = m_entries[index];
+
+                e.m_owner.reset();
+                e.m_handler = nullptr;
+                if(++e.m_generation == 0)
+                    e.m_generation = 1;
+
+                m_free.push_back(index);
+                --m_pending;
+            }
+
+            /* Detaches every entry of a bucket, returning head of the detached list. */
+            std::int32_t takeBucket(std::size_t bucket)
+            {
+                std::int32_t head = m_buckets[bucket];
+                m_buckets[bucket] = NIL;
+                return head;
+            }
+
+            /* Advances wheel one tick, moving expired entries to m_expired. */
+            void advance()
+            {
+                ++m_now;
+
+                // cascade higher wheels whose lower wheel just wrapped, top down
+                for(std::size_t level = LEVELS - 1; level > 0; --level)
+                {
+                    if((m_now & ((std::uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0)
+                        continue;
+
+                    std::size_t slot = (m_now >> (SLOT_BITS * level)) & (SLOTS - 1);
+                    std::int32_t index = takeBucket(level * SLOTS + slot);
+
+                    while(index != NIL)
+                    {
+                        std::int32_t next = m_entries[index].m_next;
+                        link(index);
+                        index = next;
+                    }
+                }
+
+                std::int32_t index = takeBucket(m_now & (SLOTS - 1));
+                while(index != NIL)
+                {
+                    Entry &e = m_entries[index];
+                    std::int32_t next = e.m_next;
+
+                    e.m_scheduled = false;
+                    m_expired.push_back(Expired{std::move(e.m_owner), e.m_handler});
+                    release(index);
+
+                    index = next;
+                }
+            }
+        };
+
+        asio::steady_timer m_ticker;
+        std::chrono::steady_clock::duration m_tick;
+        std::chrono::steady_clock::time_point m_start;
+        std::atomic<bool> m_stopped;
+
+        std::unique_ptr<Lane[]> m_lanes;
+        std::size_t m_lane_count;
+        std::vector<Expired> m_firing;                   // ticker's own, reused between ticks
+
+        /* Lane of the calling thread, threads are dealt out round robin on first use. */
+        Lane &lane(std::uint32_t &index)
+        {
+            static std::atomic<std::uint32_t> next_thread{0};
+            thread_local std::uint32_t thread = next_thread.fetch_add(1, std::memory_order_relaxed);
+
+            index = static_cast<std::uint32_t>(thread % m_lane_count);
+            return m_lanes[index];
+        }
+
+        void onTick(const system::error_code &ec)
+        {
+            if(ec == asio::error::operation_aborted || m_stopped.load(std::memory_order_acquire))
+                return;
+
+            std::uint64_t target = (std::chrono::steady_clock::now() - m_start) / m_tick;
+
+            for(std::size_t i = 0; i < m_lane_count; ++i)
+            {
+                Lane &l = m_lanes[i];
+                std::lock_guard<std::mutex> lock(l.m_gaurd);
+
+                while(l.m_now < target)
+                    l.advance();
+
+                // moved out under the lock, the lane's vector keeps its capacity
+                for(Expired &timer: l.m_expired)
+                    m_firing.push_back(std::move(timer));
+                l.m_expired.clear();
+            }
+
+            for(Expired &timer: m_firing)
+            {
+                if(std::shared_ptr<void> owner = timer.m_owner.lock())
+                    timer.m_handler(owner);
+            }
+            m_firing.clear();
+
+            if(!m_stopped.load(std::memory_order_acquire))
+                arm(target);
+        }
+
+        void arm(std::uint64_t now)
+        {
+            m_ticker.expires_at(m_start + m_tick * (now + 1));
+            m_ticker.async_wait([this](const system::error_code &ec)
+                    {
+                        onTick(ec);
+                    });
+        }
+
+    public:
+
+        /*
+         * Constructor
+         *
+         * @param: {asio::io_service &} ios: event loop the wheel ticks on and handlers run on.
+         *         {std::chrono::milliseconds} tick: resolution, deadlines fire up to one tick late.
+         *         {std::size_t} lanes: independently locked wheels, the number of threads
+         *                              scheduling on it; one when a single thread does.
+         */
+        TimerWheel(asio::io_service &ios, std::chrono::milliseconds tick = std::chrono::milliseconds(10),
+                   std::size_t lanes = 1)
+            :m_ticker(ios),
+            m_tick(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+            m_start(std::chrono::steady_clock::now()),
+            m_stopped(true),
+            m_lanes(new Lane[lanes > 0 ? lanes : 1]),
+            m_lane_count(lanes > 0 ? lanes : 1)
+        {}
+
+        /* Starts ticking, call once before the io_service runs. */
+        void start()
+        {
+            m_stopped.store(false, std::memory_order_release);
+            arm(0);
+        }
+
+        /*
+         * Stops ticking, pending timers never fire. Safe from any thread: the ticker is not
+         * touched here, its outstanding wait completes within a tick and is not re-armed.
+         */
+        void stop()
+        {
+            m_stopped.store(true, std::memory_order_release);
+        }
+
+        /*
+         * Schedules handler to run with owner once timeout has passed.
+         *
+         * @param: {std::chrono::steady_clock::duration} timeout: time from now.
+         *         {std::weak_ptr<void>} owner: object the timer belongs to.
+         *         {TimerHandler} handler: called with locked owner, skipped if owner is gone.
+         *
+         * @return: handle for cancel.
+         */
+        TimerId schedule(std::chrono::steady_clock::duration timeout, std::weak_ptr<void> owner, TimerHandler handler)
+        {
+            // round up, a deadline never fires early
+            std::uint64_t ticks = (std::chrono::steady_clock::now() - m_start + timeout + m_tick
+                    - std::chrono::steady_clock::duration(1)) / m_tick;
+
+            std::uint32_t lane_index;
+            Lane &l = lane(lane_index);
+            std::lock_guard<std::mutex> lock(l.m_gaurd);
+
+            std::int32_t index;
+            if(!l.m_free.empty())
+            {
+                index = l.m_free.back();
+                l.m_free.pop_back();
+            }
+            else
+            {
+                index = static_cast<std::int32_t>(l.m_entries.size());
+                l.m_entries.emplace_back();
+            }
+
+            Entry &e = l.m_entries[index];
+            e.m_expiry = ticks > l.m_now ? ticks : l.m_now + 1;
+            e.m_owner = std::move(owner);
+            e.m_handler = handler;
+
+            l.link(index);
+            ++l.m_pending;
+
+            return TimerId{static_cast<std::uint32_t>(index), e.m_generation, lane_index};
+        }
+
+        /*
+         * Cancels timer, no-op if it already fired or was cancelled. Any thread may cancel,
+         * the lane is the one the timer was scheduled on.
+         *
+         * @param: {TimerId &} id: reset to invalid.
+         */
+        void cancel(TimerId &id)
+        {
+            if(!id.valid())
+                return;
+
+            Lane &l = m_lanes[id.m_lane];
+            std::lock_guard<std::mutex> lock(l.m_gaurd);
+
+            if(id.m_index < l.m_entries.size())
+            {
+                Entry &e = l.m_entries[id.m_index];
+                if(e.m_generation == id.m_generation && e.m_scheduled)
+                {
+                    l.unlink(id.m_index);
+                    l.release(id.m_index);
+                }
+            }
+
+            id = TimerId();
+        }
+
+        /* Timers scheduled and not yet fired or cancelled. */
+        std::size_t pending()
+        {
+            std::size_t total = 0;
+            for(std::size_t i = 0; i < m_lane_count; ++i)
+            {
+                std::lock_guard<std::mutex> lock(m_lanes[i].m_gaurd);
+                total += m_lanes[i].m_pending;
+            }
+
+            return total;
+        }
+};
+
+#endif // !NET_TIMERWHEEL
@@ -2,32 +2,107 @@
 #define SYNC_TCPCLIENT
 
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "../common/framing.hpp"
+#include "../common/sockettuning.hpp"
+#include "../common/streamendpoint.hpp"
 
 using namespace boost;
 
 /*
  * A Synchronous Transmission Control Protocol Client.
- * Connects to a Synchronous TCP server, on a given port.
+ * Connects to a Synchronous TCP server, on a given port or Unix domain socket. Messages are
+ * newline delimited, or length prefixed if constructed with Framing::LengthPrefixed.
+ * Requests may be pipelined: sendBatch writes many in one gathered write, receiveBatch parses
+ * their responses out of as few reads as they arrive in.
  *
  * @behavior: connects to server and reads or writes messages.
  */
 class TCPClient {
     private:
         asio::io_service ios;
-        asio::ip::tcp::endpoint ep;
-        asio::ip::tcp::socket sock;
+        StreamEndpoint ep;
+        StreamSocket sock;
+
+        Framing framing;
+        FrameBuffer recv_buf;                            // kept across calls, holds bytes read past a response
+        char send_header[FRAME_HEADER_SIZE];
+        std::vector<char> batch_headers;                 // length prefixes of a batch, reused across batches
+        std::vector<iovec> batch_iov;
+
+        /*
+         * Writes every buffer of iov, IOV_MAX at a time, picking up after short writes.
+         *
+         * @throws: system::system_error on write error.
+         */
+        void writeGathered(std::vector<iovec> &iov)
+        {
+            std::size_t first = 0;
+
+            while(first < iov.size())
+            {
+                if(iov[first].iov_len == 0)
+                {
+                    ++first;
+                    continue;
+                }
+
+                // sendmsg rather than writev, a closed peer must not raise SIGPIPE
+                msghdr msg{};
+                msg.msg_iov = &iov[first];
+                msg.msg_iovlen = std::min<std::size_t>(iov.size() - first, IOV_MAX);
+
+                ssize_t n = ::sendmsg(sock.native_handle(), &msg, MSG_NOSIGNAL);
+                if(n < 0)
+                {
+                    if(errno == EINTR)
+                        continue;
+
+                    throw system::system_error(system::error_code(errno, system::system_category()));
+                }
+
+                // skip fully written buffers, advance into a partly written one
+                std::size_t written = static_cast<std::size_t>(n);
+                while(written > 0 && written >= iov[first].iov_len)
+                    written -= iov[first++].iov_len;
+
+                if(written > 0)
+                {
+                    iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + written;
+                    iov[first].iov_len -= written;
+                }
+            }
+        }
 
     public:
 
-        /* Constructor, opens socket on endpoint. */
-        TCPClient(std::string ip, unsigned short port)
-        :ep(asio::ip::address::from_string(ip), port),
-        sock(ios)
+        /* Constructor, opens and tunes socket for endpoint, TCP or Unix domain (see localEndpoint). */
+        TCPClient(const StreamEndpoint &ep, Framing framing = Framing::Newline,
+                  const SocketTuning &tuning = SocketTuning())
+        :ep(ep),
+        sock(ios),
+        framing(framing),
+        recv_buf(framing)
         {
             sock.open(ep.protocol());
+            tuneConnection(sock, tuning, true);
         }
 
+        TCPClient(std::string ip, unsigned short port, Framing framing = Framing::Newline,
+                  const SocketTuning &tuning = SocketTuning())
+        :TCPClient(tcpEndpoint(ip, port), framing, tuning)
+        {}
+
         /* Connect to endpoint. */
         void connect()
         {
@@ -41,24 +116,84 @@ class TCPClient {
             sock.close();
         }
 
-        /* Sends message to server ending with a newline character. */
+        /*
+         * Sends message to server, in newline framing message must end with a newline character.
+         * In length prefixed framing the header and message go out in one gathered write, the
+         * message is not copied.
+         */
         void sendRequest(const std::string & request)
         {
-            asio::write(sock, asio::buffer(request));
+            if(framing == Framing::Newline)
+            {
+                asio::write(sock, asio::buffer(request));
+                return;
+            }
+
+            writeFrameHeader(request.size(), send_header);
+            std::array<asio::const_buffer, 2> bufs{asio::buffer(send_header), asio::buffer(request)};
+            asio::write(sock, bufs);
         }
 
-        /* Reads from socket until a newline character is encountered. */
+        /* Reads one message from socket, returned without delimiter or header. */
         std::string receiveRequest()
         {
-            asio::streambuf buf;
-            asio::read_until(sock, buf, '\n');
+            return std::string(readFrame(sock, recv_buf));
+        }
+
+        /*
+         * Sends requests back to back without waiting for responses. Requests are not copied, they
+         * go out in gathered writes of up to IOV_MAX buffers each, interleaved with their length
+         * prefixes in length prefixed framing. The socket is written directly, asio caps a
+         * gathered write at 64 buffers.
+         *
+         * @param: {std::vector<std::string>} requests: messages, in newline framing each must end
+         *                                             with a newline character.
+         * @throws: system::system_error on write error.
+         */
+        void sendBatch(const std::vector<std::string> & requests)
+        {
+            batch_iov.clear();
+
+            if(framing == Framing::Newline)
+            {
+                for(const std::string &request: requests)
+                    batch_iov.push_back(iovec{const_cast<char *>(request.data()), request.size()});
+            }
+            else
+            {
+                // headers are all written before any buffer points into them, so they never move
+                batch_headers.resize(requests.size() * FRAME_HEADER_SIZE);
 
-            std::istream is(&buf);
-            std::string response;
+                for(std::size_t i = 0; i < requests.size(); ++i)
+                {
+                    char *header = batch_headers.data() + i * FRAME_HEADER_SIZE;
+                    writeFrameHeader(requests[i].size(), header);
+
+                    batch_iov.push_back(iovec{header, FRAME_HEADER_SIZE});
+                    batch_iov.push_back(iovec{const_cast<char *>(requests[i].data()), requests[i].size()});
+                }
+            }
+
+            writeGathered(batch_iov);
+        }
+
+        /*
+         * Reads count messages, responses to an earlier sendBatch. Each read takes whatever has
+         * arrived and every complete message in it is parsed before the socket is read again.
+         *
+         * @param: {std::size_t} count: number of messages to read.
+         * @return: messages in the order received, without delimiter or header.
+         * @throws: system::system_error on read error, EOF or oversized frame.
+         */
+        std::vector<std::string> receiveBatch(std::size_t count)
+        {
+            std::vector<std::string> responses;
+            responses.reserve(count);
 
-            std::getline(is, response);
+            while(responses.size() < count)
+                responses.emplace_back(readFrame(sock, recv_buf));
 
-            return response;
+            return responses;
         }
 };
 #endif // !SYNC_TCPCLIENT
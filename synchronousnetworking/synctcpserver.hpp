@@ -7,45 +7,62 @@
 #include <atomic>
 #include <thread>
 
+#include "../common/framing.hpp"
+#include "../common/logger.hpp"
+#include "../common/requesthandler.hpp"
+#include "../common/sockettuning.hpp"
+#include "../common/streamendpoint.hpp"
+
 using namespace boost;
 /*
  * Service handles incoming client request.
  *
- * @param: {asio::ip::tcp::socket} &sock: refrence to client socket to process.
+ * @param: {StreamSocket} &sock: refrence to client socket to process.
  *
- * @behavior: reads from socket and prints clients message to stdout.
+ * @behavior: reads from socket and responds with what handler appends, framed in place.
+ *            Receive and response buffers are allocated once and reused for every client.
  */
+template <typename Handler>
 class Service {
+    private:
+        Handler &handler;
+        Framing framing;
+        FrameBuffer buf;
+        std::string response;
+
     public:
 
         /* Constructor */
-        Service(){}
+        Service(Handler &handler, Framing framing = Framing::Newline)
+        :handler(handler),
+        framing(framing),
+        buf(framing)
+        {}
 
         /* Takes socket and reads message: read_until may throw exception.
          * socket get's deallocted via destrutor from wherever it was initiated from.
          *
-         * @param: {asio::ip::tcp::socket} &sock: client socket
+         * @param: {StreamSocket} &sock: client socket
          *
          * @behavior: reads clients message or throws Error
          */
-        void HandleClient(asio::ip::tcp::socket &sock)
+        void HandleClient(StreamSocket &sock)
         {
             try
             {
-                asio::streambuf buf;
-                asio::read_until(sock, buf, '\n');
-
-                std::istream is(&buf);
-                std::string request;
-
-                std::getline(is, request);
-
-                std::cout << request << std::endl;
+                buf.clear();
+                std::string_view request = readFrame(sock, buf);
+
+                response.clear();
+                std::size_t frame = beginFrame(framing, response);
+                handler(request, response);
+                endFrame(framing, response, frame);
+                asio::write(sock, asio::buffer(response));
             }
             catch (const system::system_error &ec)
             {
-                std::cerr << "Error Occured Handling client: " << ec.code()
-                    << "Error Message: " << ec.what() << std::endl;
+                Logger::error("Error Occured Handling client: ", ec.code().value(),
+                        " Error Message: ", ec.what());
             }
         }
 };
@@ -53,19 +70,30 @@ class Service {
 /*
  * A Iterative Transmission Control Protocol synchronous server.
  * Server class accepts clients on given port, listening on any ip4
- * address on host machine. Creates a thread and starts listening for connections,
+ * address on host machine, or on a Unix domain socket for clients on the same host.
+ * Creates a thread and starts listening for connections,
  * once a connection is accepted class Service is invoked to handle client.
  *
  * @param: {unsigned short} port: port for server to listen on.
+ *         {StreamEndpoint} ep: instead of port, endpoint to listen on (see localEndpoint).
+ *         {Framing} framing: wire format of requests and responses.
+ *         {SocketTuning} tuning: socket options, and the backlog the kernel queues while a client is being handled.
+ *         {Handler} handler: answers every request (see requesthandler.hpp), TCPServer answers with HelloHandler.
  *
  * @behavior: listens for connections and handles client. Due to servers synchronous
  *          behavior will block while handling client request.
  */
-class TCPServer {
+template <typename Handler>
+class BasicTCPServer {
     private:
+        static_assert(IsRequestHandler<Handler>::value,
+                      "Handler must be callable as void(std::string_view request, std::string &response)");
+
         asio::io_service ios;
-        asio::ip::tcp::acceptor acceptor;
-        const int BACKLOG_SIZE{30};
+        StreamAcceptor acceptor;
+        SocketTuning tuning_;
+        Handler handler_;
+        Service<Handler> srv;
 
         std::atomic<bool> stopserver;
         std::unique_ptr<std::thread> thread_;
@@ -79,13 +107,13 @@ class TCPServer {
         {
             while(!stopserver)
             {
-                asio::ip::tcp::socket sock(ios);
+                StreamSocket sock(ios);
 
                 // will hang on accept until a new connection is made.
                 // when server is signaled to stop.
                 acceptor.accept(sock);
+                tuneConnection(sock, tuning_, false);
 
-                Service srv;
                 srv.HandleClient(sock);
             }
         }
@@ -93,13 +121,23 @@ class TCPServer {
     public:
 
         /* Constructor */
-        TCPServer(unsigned short port)
-        :acceptor(ios, asio::ip::tcp::endpoint(asio::ip::address_v4::any(), port)),
+        BasicTCPServer(const StreamEndpoint &ep, Framing framing = Framing::Newline,
+                       const SocketTuning &tuning = SocketTuning(), Handler handler = Handler())
+        :acceptor(ios),
+        tuning_(tuning),
+        handler_(std::move(handler)),
+        srv(handler_, framing),
         stopserver(false)
         {
-            acceptor.listen(BACKLOG_SIZE);
+            openListener(acceptor, ep, tuning_);
+            acceptor.listen(tuning_.backlog);
         }
 
+        BasicTCPServer(unsigned short port, Framing framing = Framing::Newline,
+                       const SocketTuning &tuning = SocketTuning(), Handler handler = Handler())
+        :BasicTCPServer(tcpEndpoint("", port), framing, tuning, std::move(handler))
+        {}
+
         /* Start thread to listen for connections */
         void start()
         {
@@ -114,6 +152,11 @@ class TCPServer {
         {
             stopserver.store(true);
             thread_->join();
+
+            // only now, the connection that wakes accept still needs the socket file
+            removeListenerFile(acceptor);
         }
 };
+
+typedef BasicTCPServer<HelloHandler> TCPServer;
 #endif // !SYNC_TCPSERVER
@@ -5,122 +5,354 @@
 #include <memory>
 #include <atomic>
 #include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+#include "../common/framing.hpp"
+#include "../common/logger.hpp"
+#include "../common/metrics.hpp"
+#include "../common/requesthandler.hpp"
+#include "../common/sockettuning.hpp"
+#include "../common/streamendpoint.hpp"
 
 using namespace boost;
 
+/*
+ * What TCPServer_M does with a new connection while the worker queue is full.
+ *
+ * Block: accept thread waits for room, further clients queue up in the kernel backlog.
+ * Reject: connection is closed immediately and counted.
+ */
+enum class OverflowPolicy
+{
+    Block,
+    Reject
+};
+
+/*
+ * Settings for TCPServer_M's worker pool.
+ */
+struct WorkerPoolOptions
+{
+    std::size_t workers{std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 2};
+    std::size_t queue_capacity{128};                     // accepted sockets waiting for a worker
+    OverflowPolicy policy{OverflowPolicy::Block};
+    Framing framing{Framing::Newline};
+    SocketTuning tuning;                                 // socket options; its backlog holds clients while the accept thread is blocked
+    std::string local_path;                              // listen on this Unix domain socket instead of the TCP port
+};
+
+/*
+ * Accepted client waiting for a worker.
+ */
+struct QueuedClient
+{
+    std::shared_ptr<StreamSocket> m_sock;
+    Metrics::TimePoint m_accepted_at;
+};
+
+/*
+ * Fixed capacity queue of accepted sockets, shared by the accept thread and the workers.
+ *
+ * @behavior: push blocks or fails when full depending on caller, pop blocks until a socket is
+ *            available or the queue is closed and drained.
+ */
+class SocketQueue {
+    private:
+        std::deque<QueuedClient> m_queue;
+        std::size_t m_capacity;
+        bool m_closed;
+
+        std::mutex m_gaurd;
+        std::condition_variable m_not_empty;
+        std::condition_variable m_not_full;
+
+    public:
+
+        /* Constructor */
+        SocketQueue(std::size_t capacity)
+        :m_capacity(capacity ? capacity : 1),
+        m_closed(false)
+        {}
+
+        /* Waits for room and enqueues socket, returns false if queue was closed. */
+        bool push(QueuedClient client)
+        {
+            std::unique_lock<std::mutex> lock(m_gaurd);
+            m_not_full.wait(lock, [this]() { return m_closed || m_queue.size() < m_capacity; });
+
+            if(m_closed)
+                return false;
+
+            m_queue.push_back(std::move(client));
+            lock.unlock();
+
+            Metrics::add(MetricScope::SyncServer, MetricGauge::QueueDepth, 1);
+
+            m_not_empty.notify_one();
+            return true;
+        }
+
+        /* Enqueues socket only if there is room, returns false otherwise. */
+        bool tryPush(QueuedClient client)
+        {
+            std::unique_lock<std::mutex> lock(m_gaurd);
+
+            if(m_closed || m_queue.size() >= m_capacity)
+                return false;
+
+            m_queue.push_back(std::move(client));
+            lock.unlock();
+
+            Metrics::add(MetricScope::SyncServer, MetricGauge::QueueDepth, 1);
+
+            m_not_empty.notify_one();
+            return true;
+        }
+
+        /* Waits for a client, returns false once queue is closed and empty. */
+        bool pop(QueuedClient &client)
+        {
+            std::unique_lock<std::mutex> lock(m_gaurd);
+            m_not_empty.wait(lock, [this]() { return m_closed || !m_queue.empty(); });
+
+            if(m_queue.empty())
+                return false;
+
+            client = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+
+            m_not_full.notify_one();
+            Metrics::add(MetricScope::SyncServer, MetricGauge::QueueDepth, -1);
+            return true;
+        }
+
+        /* Wakes all waiters, workers finish queued sockets then exit. */
+        void close()
+        {
+            std::unique_lock<std::mutex> lock(m_gaurd);
+            m_closed = true;
+            lock.unlock();
+
+            m_not_empty.notify_all();
+            m_not_full.notify_all();
+        }
+
+        std::size_t size()
+        {
+            std::unique_lock<std::mutex> lock(m_gaurd);
+            return m_queue.size();
+        }
+};
+
 /*
  * Service handles incoming client request.
  *
- * @behavior: creates detached thread, reads from socket and prints clients message to stdout.
+ * @behavior: reads from socket and responds with what handler appends, runs on a worker thread.
+ *            Stage latencies are recorded under MetricScope::SyncServer; the read is blocking, so
+ *            its whole duration is reported as ReadComplete.
  */
+template <typename Handler>
 class Service_M {
     private:
+        Handler &handler;
+        Framing framing;
+        FrameBuffer buf;
+        std::string response;
+
+    public:
+
+        /* Constructor */
+        Service_M(Handler &handler, Framing framing = Framing::Newline)
+        :handler(handler),
+        framing(framing),
+        buf(framing)
+        {}
 
         /* Takes socket and reads message: read_until may throw exception.
          * socket get's deallocted via destrutor from wherever it was initiated from.
          *
-         * @param: {shared_ptr<asio::ip::tcp::socket>} sock: shared pointer to client socket.
+         * @param: {shared_ptr<StreamSocket>} sock: shared pointer to client socket.
          *
          * @behavior: reads clients message or throws Error
          */
-        void HandleClient(std::shared_ptr<asio::ip::tcp::socket> sock) {
+        void HandleClient(std::shared_ptr<StreamSocket> sock) {
+
+            Metrics::add(MetricScope::SyncServer, MetricGauge::ActiveSessions, 1);
 
             try {
-                asio::streambuf buf;
-                asio::read_until(*sock.get(), buf, '\n');
+                Metrics::TimePoint started = Metrics::now();
 
-                std::istream is(&buf);
-                std::string request;
+                buf.clear();
+                std::string_view request = readFrame(*sock.get(), buf);
 
-                std::getline(is, request);
+                Metrics::recordSince(MetricScope::SyncServer, MetricStage::ReadComplete, started);
+                Metrics::add(MetricScope::SyncServer, MetricGauge::BytesIn, request.size());
+                started = Metrics::now();
 
-                std::cout << request << std::endl;
-            } catch(system::system_error& ec){
+                response.clear();
+                std::size_t frame = beginFrame(framing, response);
+                handler(request, response);
+                endFrame(framing, response, frame);
 
-            }
-            delete this;
-        }
+                Metrics::recordSince(MetricScope::SyncServer, MetricStage::Process, started);
+                started = Metrics::now();
 
-    public:
+                asio::write(*sock.get(), asio::buffer(response));
 
-        /* Constructor */
-        Service_M(){}
+                Metrics::recordSince(MetricScope::SyncServer, MetricStage::WriteComplete, started);
+                Metrics::add(MetricScope::SyncServer, MetricGauge::BytesOut, response.size());
+            } catch(system::system_error& ec){
 
-        /*
-         * Takes shared pointer to socket, invokes thread and detaches thread. Thread is called
-         * with function to handle client.
-         *
-         * @param: {shared_ptr<asio::ip::tcp::socket>} sock: shared pointer to client socket.
-         *
-         * @behavior: creates thread and detaches.
-         */
-        void StartHandlingClient(std::shared_ptr<asio::ip::tcp::socket> sock) {
-            std::thread thread_(([this, sock]() { HandleClient(sock);}));
+            }
 
-            thread_.detach();
+            Metrics::add(MetricScope::SyncServer, MetricGauge::ActiveSessions, -1);
         }
 };
 
 /*
  * A Multithreaded Transmission Control Protocol synchronous server.
  * Server class accepts clients on given port, listening on any ip4
- * address on host machine. Creates a thread and starts listening for connections,
- * once a connection is accepted class Service is invoked in a new thread to handle client.
+ * address on host machine, or on WorkerPoolOptions::local_path. Creates a thread and starts listening for connections,
+ * once a connection is accepted it is queued for a fixed pool of worker threads, each
+ * worker handles one client at a time using class Service_M.
  *
  * @param: {unsigned short} port: port for server to listen on.
+ *         {WorkerPoolOptions} options: worker count, queue capacity, overflow policy, framing and socket tuning.
+ *         {Handler} handler: answers every request, shared by all workers; TCPServer_M answers with HelloHandler.
  *
- * @behavior: listens for connections and handles client in new thread.
+ * @behavior: listens for connections and handles clients on worker threads.
  *            Although synchronous in nature, due to multithreading the server
- *            can continue to process clients.
+ *            can continue to process clients. Thread count and memory stay bounded,
+ *            when the queue is full new clients wait or are rejected.
  */
-class TCPServer_M {
+template <typename Handler>
+class BasicTCPServer_M {
     private:
+        static_assert(IsRequestHandler<Handler>::value,
+                      "Handler must be callable as void(std::string_view request, std::string &response)");
+
         asio::io_service ios;
-        asio::ip::tcp::acceptor acceptor;
-        const int BACKLOG_SIZE{30};
+        StreamAcceptor acceptor;
+
+        WorkerPoolOptions options_;
+        Handler handler_;
+        SocketQueue queue_;
+        std::atomic<std::size_t> rejected_;
 
         std::atomic<bool> stopserver;
         std::unique_ptr<std::thread> thread_;
+        std::vector<std::unique_ptr<std::thread>> workers_;
 
-        /* Start listening for client connections, once accepted pass client socket to
-         * service class for processing.
+        /* Start listening for client connections, once accepted queue client socket for
+         * a worker to process.
          *
-         * @behavior: accepts connection and launches a new thread to handle client.
+         * @behavior: accepts connection and hands it to the worker pool.
          */
         void run()
         {
             while(!stopserver)
             {
-                std::shared_ptr<asio::ip::tcp::socket> sock(new asio::ip::tcp::socket(ios));
+                std::shared_ptr<StreamSocket> sock(new StreamSocket(ios));
                 acceptor.accept(*sock.get());
+                tuneConnection(*sock, options_.tuning, false);
 
-                (new  Service_M)->StartHandlingClient(sock);
+                QueuedClient client{sock, Metrics::now()};
+
+                if(options_.policy == OverflowPolicy::Block)
+                {
+                    queue_.push(client);
+                }
+                else if(!queue_.tryPush(client))
+                {
+                    system::error_code ignored_ec;
+                    sock->shutdown(asio::socket_base::shutdown_both, ignored_ec);
+                    sock->close(ignored_ec);
+
+                    ++rejected_;
+                    Metrics::add(MetricScope::SyncServer, MetricGauge::Rejected, 1);
+                }
+            }
+        }
+
+        /* Worker loop, handles queued clients until queue is closed. */
+        void work()
+        {
+            Service_M<Handler> srv(handler_, options_.framing);
+
+            QueuedClient client;
+
+            while(queue_.pop(client))
+            {
+                Metrics::recordSince(MetricScope::SyncServer, MetricStage::Accept, client.m_accepted_at);
+                srv.HandleClient(client.m_sock);
+                client.m_sock.reset();
             }
         }
 
     public:
 
         /* Constructor */
-        TCPServer_M(unsigned short port)
-        :acceptor(ios, asio::ip::tcp::endpoint(asio::ip::address_v4::any(), port)),
+        BasicTCPServer_M(unsigned short port, const WorkerPoolOptions &options = WorkerPoolOptions(),
+                         Handler handler = Handler())
+        :acceptor(ios),
+        options_(options),
+        handler_(std::move(handler)),
+        queue_(options.queue_capacity),
+        rejected_(0),
         stopserver(false)
         {
-            acceptor.listen(BACKLOG_SIZE);
+            openListener(acceptor, listenEndpoint(port, options_.local_path), options_.tuning);
+            acceptor.listen(options_.tuning.backlog);
         }
 
-        /* Start thread to listen for connections */
+        /* Start worker threads and thread to listen for connections */
         void start()
         {
+            std::size_t workers = options_.workers ? options_.workers : 1;
+
+            for(std::size_t i = 0; i < workers; ++i)
+            {
+                workers_.emplace_back(new std::thread([this]()
+                            {
+                                work();
+                            }));
+            }
+
             thread_.reset(new std::thread([this]()
                         {
                             run();
                         }));
         }
 
-        /* Stop server */
+        /* Stop server, queued clients are still handled before workers exit */
         void stop()
         {
             stopserver.store(true);
             thread_->join();
+
+            // only now, the connection that wakes accept still needs the socket file
+            removeListenerFile(acceptor);
+
+            queue_.close();
+            for(auto &worker: workers_)
+                worker->join();
+        }
+
+        /* Number of connections closed because the queue was full. */
+        std::size_t rejected() const
+        {
+            return rejected_.load();
+        }
+
+        /* Number of accepted clients waiting for a worker. */
+        std::size_t queued()
+        {
+            return queue_.size();
         }
 };
+
+typedef BasicTCPServer_M<HelloHandler> TCPServer_M;
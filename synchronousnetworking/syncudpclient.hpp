@@ -0,0 +1,150 @@
+#ifndef SYNC_UDPCLIENT
+#define SYNC_UDPCLIENT
+
+#include <boost/asio.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "../common/datagram.hpp"
+#include "../common/sockettuning.hpp"
+
+using namespace boost;
+
+/*
+ * A Synchronous User Datagram Protocol Client, the datagram counterpart of TCPClient.
+ * Talks to an AsyncUDPServer on a given port; every message is one datagram, no delimiter
+ * or header. sendBatch and receiveBatch move many datagrams per system call.
+ *
+ * Datagrams may be lost: receives give up after receive_timeout and report what did arrive.
+ *
+ * @behavior: connects socket to server, so only its datagrams are received, and reads or writes messages.
+ */
+class UDPClient {
+    private:
+        asio::io_service ios;
+        asio::ip::udp::endpoint ep;
+        asio::ip::udp::socket sock;
+
+        DatagramBatch recv_batch;                        // reused by every receive
+        DatagramQueue send_queue;
+
+    public:
+
+        /*
+         * Constructor, opens and tunes socket for endpoint.
+         *
+         * @param: {std::size_t} batch: most datagrams received per system call.
+         *         {std::chrono::milliseconds} receive_timeout: how long a receive waits for a datagram, zero waits forever.
+         */
+        UDPClient(std::string ip, unsigned short port, std::size_t batch = 64,
+                  std::chrono::milliseconds receive_timeout = std::chrono::milliseconds(1000),
+                  const SocketTuning &tuning = SocketTuning())
+        :ep(asio::ip::address::from_string(ip), port),
+        sock(ios),
+        recv_batch(batch ? batch : 1, 2048)
+        {
+            sock.open(ep.protocol());
+            tuneDatagram(sock, tuning);
+
+            timeval tv;
+            tv.tv_sec = receive_timeout.count() / 1000;
+            tv.tv_usec = (receive_timeout.count() % 1000) * 1000;
+            ::setsockopt(sock.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        }
+
+        /* Connect to endpoint, no packet is sent. */
+        void connect()
+        {
+            sock.connect(ep);
+        }
+
+        void close()
+        {
+            sock.close();
+        }
+
+        /* Sends message to server as one datagram. */
+        void sendRequest(const std::string & request)
+        {
+            sock.send(asio::buffer(request));
+        }
+
+        /*
+         * Reads one message.
+         *
+         * @return: message.
+         * @throws: system::system_error, timed_out if nothing arrived within receive_timeout.
+         */
+        std::string receiveRequest()
+        {
+            char data[2048];
+
+            // asio would poll again past SO_RCVTIMEO, so the socket is read directly
+            ssize_t n = ::recv(sock.native_handle(), data, sizeof(data), 0);
+            if(n < 0)
+            {
+                system::error_code ec(errno, system::system_category());
+                if(ec == asio::error::would_block)
+                    ec = asio::error::timed_out;
+
+                throw system::system_error(ec);
+            }
+
+            return std::string(data, n);
+        }
+
+        /*
+         * Sends requests as one datagram each, in as few system calls as the socket buffer allows.
+         *
+         * @throws: system::system_error on send error.
+         */
+        void sendBatch(const std::vector<std::string> & requests)
+        {
+            for(const std::string &request: requests)
+                send_queue.push(request);
+
+            system::error_code ec;
+            send_queue.send(sock.native_handle(), true, ec);
+            send_queue.clear();
+
+            if(ec)
+                throw system::system_error(ec);
+        }
+
+        /*
+         * Reads up to count messages, each read takes every datagram already queued.
+         *
+         * @param: {std::size_t} count: number of messages expected.
+         * @return: messages in the order received, fewer than count if the rest did not arrive
+         *          within receive_timeout.
+         * @throws: system::system_error on receive error.
+         */
+        std::vector<std::string> receiveBatch(std::size_t count)
+        {
+            std::vector<std::string> responses;
+            responses.reserve(count);
+
+            while(responses.size() < count)
+            {
+                system::error_code ec;
+                std::size_t n = recv_batch.receive(sock.native_handle(), true, ec, count - responses.size());
+
+                if(ec == asio::error::would_block)
+                    break;
+                if(ec)
+                    throw system::system_error(ec);
+
+                for(std::size_t i = 0; i < n; ++i)
+                    responses.emplace_back(recv_batch.data(i));
+            }
+
+            return responses;
+        }
+};
+#endif // !SYNC_UDPCLIENT